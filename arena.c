@@ -0,0 +1,91 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include "arena.h"
+
+#define ALIGN_UP(n) (((n) + (ARENA_ALIGNMENT - 1)) & ~((size_t) (ARENA_ALIGNMENT - 1)))
+#define BLOCK_HEADER_SIZE ALIGN_UP(sizeof(ArenaBlock))
+#define BLOCK_DATA(block) (((char*) (block)) + BLOCK_HEADER_SIZE)
+
+ArenaBlock* createArenaBlock(size_t size) {
+  ArenaBlock* block = (ArenaBlock*) malloc(BLOCK_HEADER_SIZE + size);
+
+  if (block == NULL) return NULL;
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+Arena* createArena(size_t blockSize) {
+  Arena* arena = (Arena*) malloc(sizeof(Arena));
+
+  if (arena == NULL) return NULL;
+  arena->blockSize = blockSize;
+  arena->first = createArenaBlock(blockSize);
+  if (arena->first == NULL) {
+    free(arena);
+    return NULL;
+  }
+  arena->current = arena->first;
+  return arena;
+}
+
+void* arenaAlloc(Arena* arena, size_t size) {
+  ArenaBlock* block = arena->current;
+  ArenaBlock* next;
+  void* p;
+
+  size = ALIGN_UP(size);
+
+  // Walk the chain: after a reset, blocks allocated by earlier jobs are reused
+  while (block->used + size > block->size) {
+    next = block->next;
+    if (next == NULL) {
+      next = createArenaBlock(size > arena->blockSize ? size : arena->blockSize);
+      if (next == NULL) return NULL;
+      block->next = next;
+    }
+    block = next;
+    block->used = 0;
+    arena->current = block;
+  }
+
+  p = BLOCK_DATA(block) + block->used;
+  block->used += size;
+  return p;
+}
+
+// Blocks allocated so far and bytes in use up to the current block
+void arenaUsage(Arena* arena, long* blocks, size_t* bytes) {
+  ArenaBlock* block;
+  int inUse = 1;
+
+  *blocks = 0;
+  *bytes = 0;
+  for (block = arena->first; block != NULL; block = block->next) {
+    (*blocks) ++;
+    if (inUse) *bytes += block->used;
+    if (block == arena->current) inUse = 0;
+  }
+}
+
+void resetArena(Arena* arena) {
+  arena->current = arena->first;
+  arena->first->used = 0;
+}
+
+void freeArena(Arena* arena) {
+  ArenaBlock* block = arena->first;
+
+  while (block != NULL) {
+    ArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  free(arena);
+}
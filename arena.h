@@ -0,0 +1,37 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGNMENT 8
+
+struct ArenaBlock_ {
+  struct ArenaBlock_ *next;
+  size_t size;
+  size_t used;
+};
+
+typedef struct ArenaBlock_ ArenaBlock;
+
+struct Arena_ {
+  ArenaBlock *first;      // chain of blocks, kept across resets
+  ArenaBlock *current;    // block that is currently being filled
+  size_t blockSize;
+};
+
+typedef struct Arena_ Arena;
+
+Arena* createArena(size_t blockSize);
+void* arenaAlloc(Arena* arena, size_t size);
+void resetArena(Arena* arena);
+void arenaUsage(Arena* arena, long* blocks, size_t* bytes);
+void freeArena(Arena* arena);
+
+#endif
@@ -0,0 +1,76 @@
+#!/bin/sh
+# Correctness checks of the compiler and the VM.
+# Every bench/check/*.kpl is compiled with kplc, with and without the
+# optimizer (-O0), and run with kplrun on its .in file (no input when there
+# is none). Both runs must write the .out file and exit with the status in
+# the .status file (0 when there is none). The .args file, if any, holds
+# more kplrun options. A program with an .err file must not compile: kplc
+# must fail and print the .err file. With a .reused file, the optimizer
+# must reuse that many computations (kplc -stats). A run is killed after
+# $CHECK_TIMEOUT seconds (default 20) when the timeout command is available.
+#
+# Usage: sh bench/check.sh [kplc] [kplrun]   (run from the repository root)
+
+KPLC=${1:-./kplc}
+KPLRUN=${2:-./kplrun}
+LIMIT=${CHECK_TIMEOUT:-20}
+DIR=$(dirname "$0")/check
+TMP=${TMPDIR:-/tmp}/kplcheck.$$
+status=0
+
+mkdir -p "$TMP"
+trap 'rm -rf "$TMP"' EXIT
+
+TIMEOUT=
+if command -v timeout > /dev/null 2>&1; then TIMEOUT="timeout $LIMIT"; fi
+
+for src in "$DIR"/*.kpl; do
+  name=$(basename "$src" .kpl)
+  input=/dev/null
+  [ -f "$DIR/$name.in" ] && input="$DIR/$name.in"
+  args=
+  [ -f "$DIR/$name.args" ] && args=$(cat "$DIR/$name.args")
+  expected=0
+  [ -f "$DIR/$name.status" ] && expected=$(cat "$DIR/$name.status")
+  reused=
+  [ -f "$DIR/$name.reused" ] && reused=$(cat "$DIR/$name.reused")
+  for level in -O0 -O; do
+    if [ "$level" = "-O0" ]; then flags=-O0; else flags=; fi
+    [ "$level" = "-O" ] && [ -n "$reused" ] && flags=-stats
+    if [ -f "$DIR/$name.err" ]; then
+      if "$KPLC" "$src" "$TMP/$name" $flags > "$TMP/$name.log"; then
+        printf "%-12s %-4s compiled, expected an error\n" "$name" "$level"
+        status=1
+      elif ! cmp -s "$TMP/$name.log" "$DIR/$name.err"; then
+        printf "%-12s %-4s WRONG error\n" "$name" "$level"
+        cat "$TMP/$name.log"
+        status=1
+      else
+        printf "%-12s %-4s ok\n" "$name" "$level"
+      fi
+      continue
+    fi
+    if ! "$KPLC" "$src" "$TMP/$name" $flags > "$TMP/$name.log"; then
+      printf "%-12s %-4s compile error\n" "$name" "$level"
+      cat "$TMP/$name.log"
+      status=1
+      continue
+    fi
+    $TIMEOUT "$KPLRUN" "$TMP/$name" $args < "$input" > "$TMP/$name.result" 2> /dev/null
+    rc=$?
+    count=$(sed -n 's/.*optimizer: \([0-9]*\) computations reused.*/\1/p' "$TMP/$name.log")
+    if [ "$rc" != "$expected" ]; then
+      printf "%-12s %-4s exit status %s, expected %s\n" "$name" "$level" "$rc" "$expected"
+      status=1
+    elif ! cmp -s "$TMP/$name.result" "$DIR/$name.out"; then
+      printf "%-12s %-4s WRONG output\n" "$name" "$level"
+      status=1
+    elif [ "$flags" = "-stats" ] && [ "$count" != "$reused" ]; then
+      printf "%-12s %-4s %s computations reused, expected %s\n" "$name" "$level" "$count" "$reused"
+      status=1
+    else
+      printf "%-12s %-4s ok\n" "$name" "$level"
+    fi
+  done
+done
+exit $status
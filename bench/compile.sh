@@ -0,0 +1,48 @@
+#!/bin/sh
+# Compiler throughput benchmark.
+# For every size in $COMPILE_BENCH_SIZES (lines, default 1000 to 1000000)
+# a program is generated with bench/kplgen and compiled with kplc -stats=json.
+# The report gives the phase times, the peak RSS and, from one size to the
+# next, the scaling exponent k of time ~ lines^k (1 is linear, 2 quadratic).
+# Extra arguments are passed to kplgen, e.g. -globals=20000 -depth=8.
+#
+# Usage: sh bench/compile.sh [kplc] [kplgen] [kplgen options...]
+
+KPLC=${1:-./kplc}
+KPLGEN=${2:-bench/kplgen}
+[ $# -ge 2 ] && shift 2 || shift $#
+SIZES=${COMPILE_BENCH_SIZES:-"1000 10000 100000 1000000"}
+TMP=${TMPDIR:-/tmp}/kplcbench.$$
+
+mkdir -p "$TMP"
+trap 'rm -rf "$TMP"' EXIT
+
+field() {
+  sed -n "s/.*\"$1\": {\"wall_ms\": \([0-9.]*\).*/\1/p" "$TMP/stats.json"
+}
+
+printf "%9s %10s %10s %10s %10s %10s %12s %8s\n" lines scan_ms parse_ms write_ms total_ms rss_kb lines/s k
+prevLines=
+prevTotal=
+for size in $SIZES; do
+  "$KPLGEN" -lines="$size" "$@" > "$TMP/gen.kpl" || exit 1
+  lines=$(wc -l < "$TMP/gen.kpl" | tr -d ' ')
+  if ! "$KPLC" "$TMP/gen.kpl" "$TMP/gen" -stats=json > "$TMP/stats.json"; then
+    echo "kplc failed on $lines lines"
+    head -5 "$TMP/stats.json"
+    exit 1
+  fi
+  scan=$(field scan)
+  parse=$(field 'parse+semantic+codegen')
+  write=$(field serialize)
+  total=$(field total)
+  rss=$(sed -n 's/.*"peak_rss_kb": \([0-9]*\).*/\1/p' "$TMP/stats.json")
+  echo "$lines $scan $parse $write $total $rss $prevLines $prevTotal" | awk '{
+    rate = ($5 > 0) ? $1 / ($5 / 1000) : 0;
+    k = "-";
+    if ($7 != "" && $7 != $1 && $8 > 0 && $5 > 0) k = sprintf("%.2f", log($5 / $8) / log($1 / $7));
+    printf "%9d %10.1f %10.1f %10.1f %10.1f %10d %12.0f %8s\n", $1, $2, $3, $4, $5, $6, rate, k
+  }'
+  prevLines=$lines
+  prevTotal=$total
+done
@@ -0,0 +1,197 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+// Generates a valid KPL program of a given shape on stdout, for measuring
+// the compiler on large inputs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int lines = 1000;       // approximate size of the program
+int globals = 100;      // global INTEGER variables
+int consts = 100;       // entries of the CONST section
+int types = 20;         // entries of the TYPE section
+int depth = 4;          // nesting depth of procedures
+int exprLen = 8;        // terms per expression
+int dims = 3;           // dimensions of the global array
+int statements = 10;    // statements per procedure body
+unsigned long seed = 1;
+
+int lineCount = 0;
+
+int randomInt(int n) {
+  seed = seed * 1103515245 + 12345;
+  return (int) ((seed >> 16) % (unsigned long) n);
+}
+
+void line(char* format, int a, int b) {
+  printf(format, a, b);
+  putchar('\n');
+  lineCount ++;
+}
+
+void indent(int level) {
+  int i;
+  for (i = 0; i < level; i ++) printf("  ");
+}
+
+// A term is a constant, a global, a local of any enclosing level, an
+// array element or a parameter
+void printTerm(int proc, int level) {
+  int i;
+
+  switch (randomInt(5)) {
+  case 0: printf("C%d", randomInt(consts)); break;
+  case 1: printf("G%d", randomInt(globals)); break;
+  case 2: printf("V%d", randomInt(level + 1)); break;
+  case 3:
+    printf("M");
+    for (i = 0; i < dims; i ++) printf("(. %d .)", randomInt(4));
+    break;
+  default: printf("A%d", randomInt(level + 1)); break;
+  }
+}
+
+void printExpression(int proc, int level) {
+  static char* ops[] = { " + ", " - ", " * " };
+  int i;
+
+  printTerm(proc, level);
+  for (i = 1; i < exprLen; i ++) {
+    printf("%s", ops[randomInt(3)]);
+    printTerm(proc, level);
+  }
+}
+
+void printStatement(int proc, int level) {
+  indent(level + 1);
+  switch (randomInt(4)) {
+  case 0:
+    printf("G%d := ", randomInt(globals));
+    printExpression(proc, level);
+    break;
+  case 1:
+    printf("V%d := (", randomInt(level + 1));
+    printExpression(proc, level);
+    printf(") MOD 1000");
+    break;
+  case 2:
+    printf("IF V%d > G%d THEN V%d := ", level, randomInt(globals), level);
+    printExpression(proc, level);
+    printf(" ELSE V%d := 0", level);
+    break;
+  default:
+    printf("M(. 1 .)");
+    {
+      int i;
+      for (i = 1; i < dims; i ++) printf("(. %d .)", randomInt(4));
+    }
+    printf(" := ");
+    printExpression(proc, level);
+    break;
+  }
+  lineCount ++;
+}
+
+// Procedure P<proc>L<level>, holding the next level nested inside it.
+// Level k declares the parameter Ak and the local Vk.
+void printProcedure(int proc, int level) {
+  int i;
+
+  indent(level);
+  printf("PROCEDURE P%dL%d(A%d : INTEGER);\n", proc, level, level);
+  lineCount ++;
+  indent(level);
+  line("VAR V%d : INTEGER;", level, 0);
+  if (level + 1 < depth)
+    printProcedure(proc, level + 1);
+  indent(level);
+  line("BEGIN", 0, 0);
+  indent(level + 1);
+  printf("V%d := A%d", level, level);
+  for (i = 0; i < statements; i ++) {
+    printf(";\n");
+    printStatement(proc, level);
+  }
+  if (level + 1 < depth) {
+    printf(";\n");
+    indent(level + 1);
+    printf("CALL P%dL%d(V%d)", proc, level + 1, level);
+  }
+  printf("\n");
+  lineCount ++;
+  indent(level);
+  line("END;", 0, 0);
+}
+
+int option(char* arg, char* name, int* value) {
+  int len = strlen(name);
+  if ((strncmp(arg, name, len) == 0) && (arg[len] == '=')) {
+    *value = atoi(arg + len + 1);
+    return 1;
+  }
+  return 0;
+}
+
+void printUsage(void) {
+  printf("Usage: kplgen [-lines=N] [-globals=N] [-consts=N] [-types=N] [-depth=N]\n");
+  printf("              [-expr=N] [-dims=N] [-statements=N] [-seed=N]\n");
+  printf("   writes a KPL program of about N lines to stdout\n");
+}
+
+int main(int argc, char* argv[]) {
+  int procs, linesPerProc, i, s = 1;
+
+  for (i = 1; i < argc; i ++)
+    if (!option(argv[i], "-lines", &lines) && !option(argv[i], "-globals", &globals) &&
+	!option(argv[i], "-consts", &consts) && !option(argv[i], "-types", &types) &&
+	!option(argv[i], "-depth", &depth) && !option(argv[i], "-expr", &exprLen) &&
+	!option(argv[i], "-dims", &dims) && !option(argv[i], "-statements", &statements) &&
+	!option(argv[i], "-seed", &s)) {
+      printUsage();
+      return 1;
+    }
+  if (globals < 1) globals = 1;
+  if (consts < 1) consts = 1;
+  if (types < 1) types = 1;
+  if (depth < 1) depth = 1;
+  if (exprLen < 1) exprLen = 1;
+  if (dims < 1) dims = 1;
+  if (statements < 0) statements = 0;
+  seed = s;
+
+  line("PROGRAM GEN;", 0, 0);
+
+  line("CONST", 0, 0);
+  for (i = 0; i < consts; i ++)
+    line("  C%d = %d;", i, randomInt(100) + 1);
+
+  // T1 .. T<dims> nest to the global array, the rest widen the section
+  line("TYPE", 0, 0);
+  line("  T0 = INTEGER;", 0, 0);
+  for (i = 1; i < types || i <= dims; i ++)
+    if (i <= dims) line("  T%d = ARRAY(. 4 .) OF T%d;", i, i - 1);
+    else line("  T%d = ARRAY(. %d .) OF INTEGER;", i, i);
+
+  line("VAR", 0, 0);
+  for (i = 0; i < globals; i ++)
+    line("  G%d : INTEGER;", i, 0);
+  line("  M : T%d;", dims, 0);
+
+  linesPerProc = depth * (statements + 6);
+  procs = (lines - lineCount - globals - 3) / linesPerProc;
+  if (procs < 1) procs = 1;
+  for (i = 0; i < procs; i ++)
+    printProcedure(i, 0);
+
+  line("BEGIN", 0, 0);
+  for (i = 0; i < procs; i ++)
+    line("  CALL P%dL0(%d);", i, i);
+  line("  CALL WRITELN", 0, 0);
+  line("END.", 0, 0);
+  return 0;
+}
@@ -0,0 +1,86 @@
+#!/bin/sh
+# Deterministic performance regression gate.
+# Every bench/*.kpl (on its .in file) and every example that has an input
+# file in bench/perf/ is compiled with kplc and run with kplrun -stats. The
+# instructions executed, the peak stack (words) and the calls made do not
+# depend on the machine, so they are compared with bench/perf/baseline.txt
+# and the check fails when any of them grows by more than $PERF_THRESHOLD
+# percent (default 1). Programs missing from the baseline also fail.
+#
+# Usage: sh bench/perfcheck.sh [-update] [kplc] [kplrun]   (run from the repository root)
+#   -update: rewrite the baseline from the current tree instead of checking
+
+UPDATE=0
+if [ "$1" = "-update" ]; then UPDATE=1; shift; fi
+KPLC=${1:-./kplc}
+KPLRUN=${2:-./kplrun}
+THRESHOLD=${PERF_THRESHOLD:-1}
+DIR=$(dirname "$0")
+BASELINE=$DIR/perf/baseline.txt
+TMP=${TMPDIR:-/tmp}/kplperf.$$
+status=0
+
+mkdir -p "$TMP"
+trap 'rm -rf "$TMP"' EXIT
+
+# Lines "program instructions peak_stack calls"
+: > "$TMP/current"
+for src in "$DIR"/*.kpl "$DIR"/perf/*.in; do
+  case "$src" in
+  *.kpl) name=$(basename "$src" .kpl); input="$DIR/$name.in" ;;
+  *) name=$(basename "$src" .in); input=$src; src="$DIR/../$name.kpl" ;;
+  esac
+  if ! "$KPLC" "$src" "$TMP/$name" > "$TMP/$name.log"; then
+    printf "%-10s compile error\n" "$name"
+    cat "$TMP/$name.log"
+    status=1
+    continue
+  fi
+  "$KPLRUN" "$TMP/$name" -stats < "$input" > /dev/null 2> "$TMP/$name.stats"
+  awk -v name="$name" '{ v[$1] = $2 }
+    END { print name, v["instructions"], v["peak_stack"], v["calls"] }' "$TMP/$name.stats" >> "$TMP/current"
+done
+
+if [ $UPDATE -eq 1 ]; then
+  if [ $status -ne 0 ]; then
+    echo "perfcheck: baseline not updated"
+    exit $status
+  fi
+  { echo "# program instructions peak_stack calls"; cat "$TMP/current"; } > "$BASELINE"
+  echo "perfcheck: wrote $BASELINE"
+  exit 0
+fi
+
+grep -v '^#' "$BASELINE" > "$TMP/baseline" 2> /dev/null
+awk -v threshold="$THRESHOLD" '
+  function check(metric, old, new) {
+    limit = old * (1 + threshold / 100)
+    if (new > limit) {
+      printf "%-10s %-12s %12d -> %12d  REGRESSION\n", name, metric, old, new
+      failed = 1
+    } else if (new != old) {
+      printf "%-10s %-12s %12d -> %12d\n", name, metric, old, new
+      changed = 1
+    }
+  }
+  NR == FNR { instructions[$1] = $2; peak[$1] = $3; calls[$1] = $4; next }
+  {
+    name = $1
+    if (!($1 in instructions)) {
+      printf "%-10s no baseline\n", name
+      failed = 1
+      next
+    }
+    check("instructions", instructions[$1], $2)
+    check("peak_stack", peak[$1], $3)
+    check("calls", calls[$1], $4)
+  }
+  END {
+    if (failed) print "perfcheck: FAILED (threshold " threshold "%)"
+    else {
+      if (changed) print "perfcheck: changes within threshold; refresh with make perfbaseline"
+      print "perfcheck: ok"
+    }
+    exit failed
+  }' "$TMP/baseline" "$TMP/current" || status=1
+exit $status
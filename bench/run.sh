@@ -0,0 +1,42 @@
+#!/bin/sh
+# Runtime benchmark of the KPL virtual machine.
+# Every bench/*.kpl is compiled with kplc and run with kplrun -stats on its
+# .in file, $BENCH_RUNS times (default 5). The report gives, per program,
+# the instructions executed, the peak stack (words) and the best and median
+# run time; the output is checked against the .out file.
+#
+# Usage: sh bench/run.sh [kplc] [kplrun]   (run from the repository root)
+
+KPLC=${1:-./kplc}
+KPLRUN=${2:-./kplrun}
+RUNS=${BENCH_RUNS:-5}
+DIR=$(dirname "$0")
+TMP=${TMPDIR:-/tmp}/kplbench.$$
+status=0
+
+mkdir -p "$TMP"
+trap 'rm -rf "$TMP"' EXIT
+
+printf "%-10s %14s %10s %10s %10s  %s\n" program instructions peak_stack best_ms median_ms output
+for src in "$DIR"/*.kpl; do
+  name=$(basename "$src" .kpl)
+  if ! "$KPLC" "$src" "$TMP/$name" > "$TMP/$name.log"; then
+    printf "%-10s compile error\n" "$name"
+    cat "$TMP/$name.log"
+    status=1
+    continue
+  fi
+  : > "$TMP/$name.times"
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+    "$KPLRUN" "$TMP/$name" -stats < "$DIR/$name.in" > "$TMP/$name.result" 2> "$TMP/$name.stats"
+    grep '^wall_ms' "$TMP/$name.stats" | cut -d' ' -f2 >> "$TMP/$name.times"
+    i=$((i + 1))
+  done
+  instructions=$(grep '^instructions' "$TMP/$name.stats" | cut -d' ' -f2)
+  peak=$(grep '^peak_stack' "$TMP/$name.stats" | cut -d' ' -f2)
+  times=$(sort -n "$TMP/$name.times" | awk '{ t[NR] = $1 } END { printf "%.3f %.3f", t[1], t[int((NR + 1) / 2)] }')
+  if cmp -s "$TMP/$name.result" "$DIR/$name.out"; then check=ok; else check=WRONG; status=1; fi
+  printf "%-10s %14s %10s %10s %10s  %s\n" "$name" "$instructions" "$peak" $times "$check"
+done
+exit $status
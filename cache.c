@@ -0,0 +1,136 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "instructions.h"
+#include "executable.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define makeDir(path) _mkdir(path)
+#else
+#include <unistd.h>
+#define makeDir(path) mkdir(path, 0777)
+#endif
+
+#define FNV64_PRIME 1099511628211ULL
+
+unsigned long long hashBytes(unsigned long long h, unsigned char* data, size_t size) {
+  size_t i;
+  for (i = 0; i < size; i ++) {
+    h ^= data[i];
+    h *= FNV64_PRIME;
+  }
+  return h;
+}
+
+// The key covers the source bytes, the compiler version, the output format
+// and the layout of the code the VM runs: the opcode count, the size of an
+// instruction, the container version and the sizes of its records, so that
+// an executable cached before the opcode table or the container changed is
+// never served again.
+// Two FNV-1a streams with different seeds give a 128-bit key.
+int computeCacheKey(char* sourceFile, char* version, int format, char* key) {
+  unsigned long long h1 = 14695981039346656037ULL;
+  unsigned long long h2 = 0x9E3779B97F4A7C15ULL;
+  unsigned int codeFormat[5];
+  unsigned char buf[4096];
+  FILE* f;
+  size_t n;
+
+  f = fopen(sourceFile, "rb");
+  if (f == NULL) return 0;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    h1 = hashBytes(h1, buf, n);
+    h2 = hashBytes(h2, buf, n);
+  }
+  fclose(f);
+
+  h1 = hashBytes(h1, (unsigned char*) version, strlen(version));
+  h2 = hashBytes(h2, (unsigned char*) version, strlen(version));
+  h1 = hashBytes(h1, (unsigned char*) &format, sizeof(format));
+  h2 = hashBytes(h2, (unsigned char*) &format, sizeof(format));
+
+  codeFormat[0] = OP_BP + 1;
+  codeFormat[1] = sizeof(Instruction);
+  codeFormat[2] = EXEC_VERSION;
+  codeFormat[3] = sizeof(ExecHeader);
+  codeFormat[4] = sizeof(SymbolEntry);
+  h1 = hashBytes(h1, (unsigned char*) codeFormat, sizeof(codeFormat));
+  h2 = hashBytes(h2, (unsigned char*) codeFormat, sizeof(codeFormat));
+
+  sprintf(key, "%016llx%016llx", h1, h2);
+  return 1;
+}
+
+int copyFile(char* from, char* to) {
+  FILE* in;
+  FILE* out;
+  char buf[4096];
+  size_t n;
+  int ok = 1;
+
+  in = fopen(from, "rb");
+  if (in == NULL) return 0;
+  out = fopen(to, "wb");
+  if (out == NULL) {
+    fclose(in);
+    return 0;
+  }
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+    if (fwrite(buf, 1, n, out) != n) {
+      ok = 0;
+      break;
+    }
+  fclose(in);
+  if (fclose(out) != 0) ok = 0;
+  return ok;
+}
+
+// On a hit the cached executable is hard-linked (or copied) to outputFile
+int lookupCache(char* cacheDir, char* key, char* outputFile) {
+  char path[MAX_PATH_LEN];
+  struct stat st;
+
+  snprintf(path, MAX_PATH_LEN, "%s/%s", cacheDir, key);
+  if (stat(path, &st) != 0) return 0;
+
+  // Never write through an existing file: it may be a link into the cache
+  remove(outputFile);
+#ifndef _WIN32
+  if (link(path, outputFile) == 0) return 1;
+#endif
+  return copyFile(path, outputFile);
+}
+
+// Publishes outputFile under key. The entry is written to a private
+// temporary file first and renamed into place, so concurrent compilers
+// only ever see complete entries.
+int storeCache(char* cacheDir, char* key, char* outputFile) {
+  char path[MAX_PATH_LEN];
+  char tmpPath[MAX_PATH_LEN];
+
+  makeDir(cacheDir);
+  snprintf(path, MAX_PATH_LEN, "%s/%s", cacheDir, key);
+  // Unique per process and per output, as kplc -j may store from several threads
+  snprintf(tmpPath, MAX_PATH_LEN, "%s/%s.tmp.%d.%08x", cacheDir, key, (int) getpid(),
+	   (unsigned int) hashBytes(0, (unsigned char*) outputFile, strlen(outputFile)));
+
+  if (!copyFile(outputFile, tmpPath)) {
+    remove(tmpPath);
+    return 0;
+  }
+  if (rename(tmpPath, path) != 0) {
+    remove(tmpPath);
+    return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,18 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#define CACHE_KEY_LEN 32
+#define CACHE_ENV "KPLC_CACHE"
+#define MAX_PATH_LEN 1024
+
+int computeCacheKey(char* sourceFile, char* version, int format, char* key);
+int lookupCache(char* cacheDir, char* key, char* outputFile);
+int storeCache(char* cacheDir, char* key, char* outputFile);
+
+#endif
@@ -4,23 +4,17 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "reader.h"
 #include "codegen.h"  
+#include "executable.h"
+#include "compiler.h"
 
-#define CODE_SIZE 10000
-extern SymTab* symtab;
-
-extern Object* readiFunction;
-extern Object* readcFunction;
-extern Object* writeiProcedure;
-extern Object* writecProcedure;
-extern Object* writelnProcedure;
-
-CodeBlock* codeBlock;
 
 int computeNestedLevel(Scope* scope) {
   int level = 0;
-  Scope* tmp = symtab->currentScope;
+  Scope* tmp = compiler->symtab->currentScope;
   while (tmp != scope) {
     tmp = tmp->outer;
     level ++;
@@ -65,12 +59,14 @@ void genReturnValueValue(Object* func) {
 }
 
 void genPredefinedProcedureCall(Object* proc) {
-  if (proc == writeiProcedure)
+  if (proc == compiler->writeiProcedure)
     genWRI();
-  else if (proc == writecProcedure)
+  else if (proc == compiler->writecProcedure)
     genWRC();
-  else if (proc == writelnProcedure)
+  else if (proc == compiler->writelnProcedure)
     genWLN();
+  else if (proc == compiler->writesProcedure)
+    genWRS();
 }
 
 void genProcedureCall(Object* proc) {
@@ -79,10 +75,12 @@ void genProcedureCall(Object* proc) {
 }
 
 void genPredefinedFunctionCall(Object* func) {
-  if (func == readiFunction)
+  if (func == compiler->readiFunction)
     genRI();
-  else if (func == readcFunction)
+  else if (func == compiler->readcFunction)
     genRC();
+  else if (func == compiler->lengthFunction)
+    genLI(); // the length is the first word of the buffer
 }
 
 void genFunctionCall(Object* func) {
@@ -91,185 +89,502 @@ void genFunctionCall(Object* func) {
 }
 
 void genLA(int level, int offset) {
-  emitLA(codeBlock, level, offset);
+  emitLA(compiler->codeBlock, level, offset);
 }
 
 void genLV(int level, int offset) {
-  emitLV(codeBlock, level, offset);
+  emitLV(compiler->codeBlock, level, offset);
 }
 
 void genLC(WORD constant) {
-  emitLC(codeBlock, constant);
+  emitLC(compiler->codeBlock, constant);
 }
 
 void genLI(void) {
-  emitLI(codeBlock);
+  emitLI(compiler->codeBlock);
 }
 
 void genINT(int delta) {
-  emitINT(codeBlock,delta);
+  emitINT(compiler->codeBlock,delta);
 }
 
 void genDCT(int delta) {
-  emitDCT(codeBlock,delta);
+  emitDCT(compiler->codeBlock,delta);
 }
 
-Instruction* genJ(CodeAddress label) {
-  Instruction* inst = codeBlock->code + codeBlock->codeSize;
-  emitJ(codeBlock,label);
-  return inst;
+// Jumps are referred to by their code address rather than by a pointer,
+// since the code buffer may be moved when it grows
+CodeAddress genJ(CodeAddress label) {
+  CodeAddress jmp = compiler->codeBlock->codeSize;
+  emitJ(compiler->codeBlock,label);
+  return jmp;
 }
 
-Instruction* genFJ(CodeAddress label) {
-  Instruction* inst = codeBlock->code + codeBlock->codeSize;
-  emitFJ(codeBlock, label);
-  return inst;
+CodeAddress genFJ(CodeAddress label) {
+  CodeAddress jmp = compiler->codeBlock->codeSize;
+  emitFJ(compiler->codeBlock, label);
+  return jmp;
 }
 
 void genHL(void) {
-  emitHL(codeBlock);
+  emitHL(compiler->codeBlock);
 }
 
 void genST(void) {
-  emitST(codeBlock);
+  emitST(compiler->codeBlock);
 }
 
 void genCALL(int level, CodeAddress label) {
-  emitCALL(codeBlock, level, label);
+  emitCALL(compiler->codeBlock, level, label);
 }
 
 void genEP(void) {
-  emitEP(codeBlock);
+  emitEP(compiler->codeBlock);
 }
 
 void genEF(void) {
-  emitEF(codeBlock);
+  emitEF(compiler->codeBlock);
 }
 
 void genRC(void) {
-  emitRC(codeBlock);
+  emitRC(compiler->codeBlock);
 }
 
 void genRI(void) {
-  emitRI(codeBlock);
+  emitRI(compiler->codeBlock);
 }
 
 void genWRC(void) {
-  emitWRC(codeBlock);
+  emitWRC(compiler->codeBlock);
 }
 
 void genWRI(void) {
-  emitWRI(codeBlock);
+  emitWRI(compiler->codeBlock);
 }
 
 void genWLN(void) {
-  emitWLN(codeBlock);
+  emitWLN(compiler->codeBlock);
 }
 
 void genAD(void) {
-  emitAD(codeBlock);
+  emitAD(compiler->codeBlock);
 }
 
 void genSB(void) {
-  emitSB(codeBlock);
+  emitSB(compiler->codeBlock);
 }
 
 void genML(void) {
-  emitML(codeBlock);
+  emitML(compiler->codeBlock);
 }
 
 void genDV(void) {
-  emitDV(codeBlock);
+  emitDV(compiler->codeBlock);
 }
 
 void genNEG(void) {
-  emitNEG(codeBlock);
+  emitNEG(compiler->codeBlock);
 }
 
 void genCV(void) {
-  emitCV(codeBlock);
+  emitCV(compiler->codeBlock);
 }
 
 void genEQ(void) {
-  emitEQ(codeBlock);
+  emitEQ(compiler->codeBlock);
 }
 
 void genNE(void) {
-  emitNE(codeBlock);
+  emitNE(compiler->codeBlock);
 }
 
 void genGT(void) {
-  emitGT(codeBlock);
+  emitGT(compiler->codeBlock);
 }
 
 void genGE(void) {
-  emitGE(codeBlock);
+  emitGE(compiler->codeBlock);
 }
 
 void genLT(void) {
-  emitLT(codeBlock);
+  emitLT(compiler->codeBlock);
 }
 
 void genLE(void) {
-  emitLE(codeBlock);
+  emitLE(compiler->codeBlock);
 }
 
 // [SỬA ĐỔI] Cài đặt hàm sinh mã cho toán tử mới
 void genMOD(void) {
-  emitCode(codeBlock, OP_MOD, DC_VALUE, DC_VALUE);
+  emitCode(compiler->codeBlock, OP_MOD, DC_VALUE, DC_VALUE);
 }
 
 void genAND(void) {
-  emitCode(codeBlock, OP_AND, DC_VALUE, DC_VALUE);
+  emitCode(compiler->codeBlock, OP_AND, DC_VALUE, DC_VALUE);
 }
 
 void genOR(void) {
-  emitCode(codeBlock, OP_OR, DC_VALUE, DC_VALUE);
+  emitCode(compiler->codeBlock, OP_OR, DC_VALUE, DC_VALUE);
 }
 
 void genNOT(void) {
-  emitCode(codeBlock, OP_NOT, DC_VALUE, DC_VALUE);
+  emitCode(compiler->codeBlock, OP_NOT, DC_VALUE, DC_VALUE);
 }
 // ---------------------------------------------
 
-void updateJ(Instruction* jmp, CodeAddress label) {
-  jmp->q = label;
+void genCPY(int size) {
+  emitCPY(compiler->codeBlock, size);
+}
+
+void genINB(int capacity) {
+  emitINB(compiler->codeBlock, capacity);
 }
 
-void updateFJ(Instruction* jmp, CodeAddress label) {
-  jmp->q = label;
+void genLDB(void) {
+  emitLDB(compiler->codeBlock);
+}
+
+void genSTB(void) {
+  emitSTB(compiler->codeBlock);
+}
+
+void genCPS(void) {
+  emitCPS(compiler->codeBlock);
+}
+
+void genCMPS(void) {
+  emitCMPS(compiler->codeBlock);
+}
+
+void genWRS(void) {
+  emitWRS(compiler->codeBlock);
+}
+
+void genWRK(int offset) {
+  emitWRK(compiler->codeBlock, offset);
+}
+
+void genCPK(int offset) {
+  emitCPK(compiler->codeBlock, offset);
+}
+
+void genPFOR(int reduction, CodeAddress task) {
+  emitPFOR(compiler->codeBlock, reduction, task);
+}
+
+/******************* Loop idioms ******************************/
+
+// A FOR loop whose counter I is a plain variable and whose body is one of
+//   A(. I .) := e                  VFIL
+//   A(. I .) := B(. I .)           VCPY
+//   A(. I .) := A(. I .) + e       VADD (or e + A(. I .))
+//   S := S + A(. I .)              VSUM (or A(. I .) + S)
+// with arrays of one-word elements and e a constant or a variable other
+// than I, runs as a single vector instruction. Such a body writes nothing
+// but array elements, so the limit and e can be evaluated once instead of
+// at every iteration.
+
+// A constant, or the value of a variable other than the counter
+int isLoopInvariant(Instruction* inst, Instruction* counter) {
+  if (inst->op == OP_LC) return 1;
+  return (inst->op == OP_LV) && ((inst->p != counter->p) || (inst->q != counter->q));
+}
+
+int isSameVariable(Instruction* a, Instruction* b) {
+  return (a->p == b->p) && (a->q == b->q);
+}
+
+// Some LV in code[start, end) loads var
+int readsVariable(Instruction* code, int start, int end, Instruction* var) {
+  int k;
+
+  for (k = start; k < end; k ++)
+    if ((code[k].op == OP_LV) && isSameVariable(code + k, var)) return 1;
+  return 0;
+}
+
+// Address of an array element indexed by the counter at code[k]: the array
+// (LA, or LV of a VAR array parameter), LV counter, LC 1, ML, AD. Returns
+// the instruction that loads the array, NULL otherwise.
+Instruction* matchElement(Instruction* code, int k, int end, Instruction* counter) {
+  if (k + 5 > end) return NULL;
+  if ((code[k].op != OP_LA) && ((code[k].op != OP_LV) || !isLoopInvariant(code + k, counter)))
+    return NULL;
+  if ((code[k + 1].op != OP_LV) || !isSameVariable(code + k + 1, counter)) return NULL;
+  if ((code[k + 2].op != OP_LC) || (code[k + 2].q != 1)) return NULL;
+  if ((code[k + 3].op != OP_ML) || (code[k + 4].op != OP_AD)) return NULL;
+  return code + k;
+}
+
+// Called once the body of a FOR loop has been compiled. The loop was
+// compiled as LA I; CV; from; ST; CV; LI; limit (from limitStart to
+// limitEnd); LE; FJ; body (from bodyStart). When the body is an idiom, the
+// code from the CV; LI on is replaced by limit; array; operand; Vxxx and 1
+// is returned: the vector instruction runs the iterations and pops the
+// address of I.
+int genLoopIdiom(CodeAddress forStart, CodeAddress limitStart, CodeAddress limitEnd, CodeAddress bodyStart) {
+  CodeBlock* codeBlock = compiler->codeBlock;
+  Instruction* code = codeBlock->code;
+  int end = codeBlock->codeSize;
+  int n = end - bodyStart;
+  int k = bodyStart;
+  Instruction counter, array, operand;
+  Instruction* element;
+  Instruction* other = NULL;
+  enum OpCode op;
+
+  if (!compiler->optimize || codeBlock->discard) return 0;
+  if ((code[forStart].op != OP_LA) || (code[forStart + 1].op != OP_CV) ||
+      (code[limitStart - 2].op != OP_CV) || (code[limitStart - 1].op != OP_LI))
+    return 0;
+  counter = code[forStart];
+
+  for (k = limitStart; k < limitEnd; k ++)
+    switch (code[k].op) {
+    case OP_LC: case OP_AD: case OP_SB: case OP_ML: case OP_DV: case OP_MOD: case OP_NEG:
+      break;
+    case OP_LV:
+      if (!isLoopInvariant(code + k, &counter)) return 0;
+      break;
+    default:
+      return 0;
+    }
+
+  k = bodyStart;
+  if (code[end - 1].op != OP_ST) return 0;
+  element = matchElement(code, k, end, &counter);
+  if (element != NULL) {
+    array = *element;
+    if ((n == 7) && isLoopInvariant(code + k + 5, &counter)) {
+      op = OP_VFIL;
+      operand = code[k + 5];
+    } else if ((n == 12) && (code[k + 10].op == OP_LI) &&
+	       ((other = matchElement(code, k + 5, end, &counter)) != NULL)) {
+      op = OP_VCPY;
+      operand = *other;
+    } else if ((n == 14) && (code[k + 12].op == OP_AD)) {
+      op = OP_VADD;
+      if ((code[k + 10].op == OP_LI) && isLoopInvariant(code + k + 11, &counter)) {
+	other = matchElement(code, k + 5, end, &counter);
+	operand = code[k + 11];
+      } else if ((code[k + 11].op == OP_LI) && isLoopInvariant(code + k + 5, &counter)) {
+	other = matchElement(code, k + 6, end, &counter);
+	operand = code[k + 5];
+      }
+      if ((other == NULL) || (other->op != element->op) || !isSameVariable(other, element))
+	return 0;
+    } else return 0;
+  } else if ((n == 10) && (code[k].op == OP_LA) && !isSameVariable(code + k, &counter) &&
+	     (code[k + 8].op == OP_AD)) {
+    op = OP_VSUM;
+    operand = code[k];
+    if ((code[k + 1].op == OP_LV) && isSameVariable(code + k + 1, &operand) && (code[k + 7].op == OP_LI))
+      element = matchElement(code, k + 2, end, &counter);
+    else if ((code[k + 7].op == OP_LV) && isSameVariable(code + k + 7, &operand) && (code[k + 6].op == OP_LI))
+      element = matchElement(code, k + 1, end, &counter);
+    if (element == NULL) return 0;
+    array = *element;
+  } else return 0;
+
+  // The loop evaluates its limit before every iteration, the vector
+  // instruction only once: the body must not store into what the limit reads
+  if (readsVariable(code, limitStart, limitEnd, (op == OP_VSUM) ? &operand : &array))
+    return 0;
+
+  n = limitEnd - limitStart;
+  memmove(code + limitStart - 2, code + limitStart, n * sizeof(Instruction));
+  codeBlock->codeSize = limitStart - 2 + n;
+  emitCode(codeBlock, array.op, array.p, array.q);
+  emitCode(codeBlock, operand.op, operand.p, operand.q);
+  emitCode(codeBlock, op, DC_VALUE, DC_VALUE);
+  if (compiler->stats != NULL) compiler->stats->loopsVectorized ++;
+  return 1;
+}
+
+/******************* Constant pool ******************************/
+
+// String literals become the DATA section of the executable: each one is
+// a length word followed by its bytes, packed four to a word like a STRING.
+// A literal is referred to by the word offset of its length.
+
+int growConstants(int minSize) {
+  WORD* constants;
+  int capacity = (compiler->constantCapacity == 0) ? 64 : compiler->constantCapacity;
+
+  while (capacity < minSize) capacity *= 2;
+  if (capacity == compiler->constantCapacity) return 1;
+  constants = (WORD*) realloc(compiler->constants, capacity * sizeof(WORD));
+  if (constants == NULL) {
+    compiler->outOfMemory = 1;
+    return 0;
+  }
+  compiler->constants = constants;
+  compiler->constantCapacity = capacity;
+  return 1;
+}
+
+int beginStringConstant(void) {
+  int offset = compiler->constantSize;
+
+  if (!growConstants(offset + 1)) return offset;
+  compiler->constants[offset] = 0;
+  compiler->constantSize ++;
+  return offset;
+}
+
+void appendStringConstant(int offset, char ch) {
+  int length;
+
+  if (offset >= compiler->constantSize) return;
+  length = compiler->constants[offset];
+  if (length % BYTES_PER_WORD == 0) {
+    if (!growConstants(compiler->constantSize + 1)) return;
+    compiler->constants[compiler->constantSize ++] = 0;
+  }
+  ((unsigned char*) (compiler->constants + offset + 1))[length] = (unsigned char) ch;
+  compiler->constants[offset] ++;
+}
+
+// Removes the last literal, which turned out to be a character constant
+void dropStringConstant(int offset) {
+  if (offset < compiler->constantSize)
+    compiler->constantSize = offset;
+}
+
+// STRING and BYTES variables of the current block start empty, with their
+// capacity in the header
+void genPackedInits(Scope* scope) {
+  ObjectNode* node;
+
+  for (node = scope->objList; node != NULL; node = node->next)
+    if ((node->object->kind == OBJ_VARIABLE) && (node->object->varAttrs->type->typeClass == TP_PACKED)) {
+      genVariableAddress(node->object);
+      genINB(node->object->varAttrs->type->arraySize);
+    }
+}
+
+// jmp is past the end when the code has been discarded after an error
+void updateJ(CodeAddress jmp, CodeAddress label) {
+  if (jmp < compiler->codeBlock->codeSize)
+    compiler->codeBlock->code[jmp].q = label;
+}
+
+void updateFJ(CodeAddress jmp, CodeAddress label) {
+  if (jmp < compiler->codeBlock->codeSize)
+    compiler->codeBlock->code[jmp].q = label;
+}
+
+// Qualified name of a subprogram: the program itself is left out
+void makeSymbolName(Object* obj, char* name) {
+  Scope* outer = NULL;
+
+  if (obj->kind == OBJ_FUNCTION) outer = obj->funcAttrs->scope->outer;
+  else if (obj->kind == OBJ_PROCEDURE) outer = obj->procAttrs->scope->outer;
+
+  if ((outer != NULL) && (outer->owner->kind != OBJ_PROGRAM)) {
+    makeSymbolName(outer->owner, name);
+    strncat(name, ".", SYMBOL_NAME_LEN - strlen(name) - 1);
+    strncat(name, obj->name, SYMBOL_NAME_LEN - strlen(name) - 1);
+  } else {
+    strncpy(name, obj->name, SYMBOL_NAME_LEN - 1);
+    name[SYMBOL_NAME_LEN - 1] = '\0';
+  }
+}
+
+// Records where the code of a program, procedure or function starts; the
+// object must already be declared so that its enclosing scope is known
+void genSymbol(Object* obj, CodeAddress address) {
+  SymbolEntry* symbols;
+  Object** objects;
+  int capacity;
+
+  if (compiler->symbolCount == compiler->symbolCapacity) {
+    capacity = (compiler->symbolCapacity == 0) ? 16 : compiler->symbolCapacity * 2;
+    symbols = (SymbolEntry*) realloc(compiler->symbols, capacity * sizeof(SymbolEntry));
+    if (symbols == NULL) {
+      compiler->outOfMemory = 1;
+      return;
+    }
+    compiler->symbols = symbols;
+    objects = (Object**) realloc(compiler->symbolObjects, capacity * sizeof(Object*));
+    if (objects == NULL) {
+      compiler->outOfMemory = 1;
+      return;
+    }
+    compiler->symbolObjects = objects;
+    compiler->symbolCapacity = capacity;
+  }
+  memset(compiler->symbols + compiler->symbolCount, 0, sizeof(SymbolEntry));
+  compiler->symbols[compiler->symbolCount].address = address;
+  makeSymbolName(obj, compiler->symbols[compiler->symbolCount].name);
+  compiler->symbolObjects[compiler->symbolCount] = obj;
+  compiler->symbolCount ++;
+}
+
+void setEntryPoint(CodeAddress address) {
+  compiler->entryPoint = address;
 }
 
 CodeAddress getCurrentCodeAddress(void) {
-  return codeBlock->codeSize;
+  return compiler->codeBlock->codeSize;
 }
 
 int isPredefinedFunction(Object* func) {
-  return ((func == readiFunction) || (func == readcFunction));
+  return ((func == compiler->readiFunction) || (func == compiler->readcFunction) ||
+	  (func == compiler->lengthFunction));
 }
 
 int isPredefinedProcedure(Object* proc) {
-  return ((proc == writeiProcedure) || (proc == writecProcedure) || (proc == writelnProcedure));
+  return ((proc == compiler->writeiProcedure) || (proc == compiler->writecProcedure) || (proc == compiler->writelnProcedure) ||
+	  (proc == compiler->writesProcedure));
 }
 
 void initCodeBuffer(void) {
-  codeBlock = createCodeBlock(CODE_SIZE);
+  compiler->codeBlock = createCodeBlock(INIT_CODE_SIZE);
+  compiler->outOfMemory = 0;
+  compiler->symbolCount = 0;
+  compiler->constantSize = 0;
 }
 
 void printCodeBuffer(void) {
-  printCodeBlock(codeBlock);
+  printCodeBlock(compiler->codeBlock);
 }
 
 void cleanCodeBuffer(void) {
-  freeCodeBlock(codeBlock);
+  freeCodeBlock(compiler->codeBlock);
+  compiler->codeBlock = NULL;
 }
 
-int serialize(char* fileName) {
+int serialize(char* fileName, int format) {
   FILE* f;
+  Section sections[2];
+  int sectionCount = 1;
 
   f = fopen(fileName, "wb");
   if (f == NULL) return IO_ERROR;
-  saveCode(codeBlock, f);
+  switch (format) {
+  case CODE_FORMAT_COMPACT:
+    saveCompactCode(compiler->codeBlock, f);
+    break;
+  case CODE_FORMAT_EXEC:
+    sections[0].type = SECTION_SYMBOLS;
+    sections[0].data = compiler->symbols;
+    sections[0].size = compiler->symbolCount * sizeof(SymbolEntry);
+    if (compiler->constantSize > 0) {
+      sections[1].type = SECTION_DATA;
+      sections[1].data = compiler->constants;
+      sections[1].size = compiler->constantSize * sizeof(WORD);
+      sectionCount ++;
+    }
+    if (!saveExecutable(compiler->codeBlock, compiler->entryPoint, sections, sectionCount, f)) {
+      fclose(f);
+      return IO_ERROR;
+    }
+    break;
+  default:
+    saveCode(compiler->codeBlock, f);
+    break;
+  }
   fclose(f);
   return IO_SUCCESS;
 }
\ No newline at end of file
@@ -9,6 +9,8 @@
 #include "symtab.h"
 #include "instructions.h"
 
+#define INIT_CODE_SIZE 1024
+
 #define RESERVED_WORDS 4
 
 #define PROCEDURE_PARAM_COUNT(proc) (proc->procAttrs->numOfParams)
@@ -59,8 +61,8 @@ void genLC(WORD constant);
 void genLI(void);
 void genINT(int delta);
 void genDCT(int delta);
-Instruction* genJ(CodeAddress label);
-Instruction* genFJ(CodeAddress label);
+CodeAddress genJ(CodeAddress label);
+CodeAddress genFJ(CodeAddress label);
 void genHL(void);
 void genST(void);
 void genCALL(int level, CodeAddress label);
@@ -91,9 +93,32 @@ void genOR(void);
 void genNOT(void);
 // --------------------------------------
 
-void updateJ(Instruction* jmp, CodeAddress label);
-void updateFJ(Instruction* jmp, CodeAddress label);
-
+void genCPY(int size);
+void genINB(int capacity);
+void genLDB(void);
+void genSTB(void);
+void genCPS(void);
+void genCMPS(void);
+void genWRS(void);
+void genWRK(int offset);
+void genCPK(int offset);
+void genPFOR(int reduction, CodeAddress task);
+
+int isLoopInvariant(Instruction* inst, Instruction* counter);
+int isSameVariable(Instruction* a, Instruction* b);
+Instruction* matchElement(Instruction* code, int k, int end, Instruction* counter);
+int genLoopIdiom(CodeAddress forStart, CodeAddress limitStart, CodeAddress limitEnd, CodeAddress bodyStart);
+
+int beginStringConstant(void);
+void appendStringConstant(int offset, char ch);
+void dropStringConstant(int offset);
+void genPackedInits(Scope* scope);
+
+void updateJ(CodeAddress jmp, CodeAddress label);
+void updateFJ(CodeAddress jmp, CodeAddress label);
+
+void genSymbol(Object* obj, CodeAddress address);
+void setEntryPoint(CodeAddress address);
 CodeAddress getCurrentCodeAddress(void);
 int isPredefinedProcedure(Object* proc);
 int isPredefinedFunction(Object* func);
@@ -102,6 +127,6 @@ void initCodeBuffer(void);
 void printCodeBuffer(void);
 void cleanCodeBuffer(void);
 
-int serialize(char* fileName);
+int serialize(char* fileName, int format);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "compiler.h"
+
+THREAD_LOCAL Compiler* compiler = NULL;
+
+Compiler* createCompiler(void) {
+  Compiler* c = (Compiler*) malloc(sizeof(Compiler));
+
+  memset(c, 0, sizeof(Compiler));
+  c->optimize = 1;
+  return c;
+}
+
+void freeCompiler(Compiler* c) {
+  if (c->symArena != NULL)
+    freeArena(c->symArena);
+  if (c->codeBlock != NULL)
+    freeCodeBlock(c->codeBlock);
+  free(c->symbols);
+  free(c->symbolObjects);
+  free(c->constants);
+  free(c->calls);
+  if (c->stats != NULL)
+    freeStats(c->stats);
+  free(c);
+}
+
+void setCompiler(Compiler* c) {
+  compiler = c;
+}
@@ -0,0 +1,108 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __COMPILER_H__
+#define __COMPILER_H__
+
+#include <stdio.h>
+#include <setjmp.h>
+#include "token.h"
+#include "symtab.h"
+#include "instructions.h"
+#include "executable.h"
+#include "arena.h"
+#include "error.h"
+#include "stats.h"
+
+#if defined(__GNUC__)
+#define THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL
+#endif
+
+#define MAX_DIAGNOSTICS 20
+
+// Result of compile() besides IO_ERROR and IO_SUCCESS
+#define COMPILE_ERROR 2
+
+// A call of a user subprogram, kept until every subprogram is compiled: a
+// recursive callee is called before all its effects are known
+struct SubprogramCall_ {
+  Scope* caller;
+  Scope* callee;
+  int parallel;                 // made inside a PARALLEL FOR
+  int lineNo, colNo;
+};
+
+typedef struct SubprogramCall_ SubprogramCall;
+
+// All the state of one compilation. Every thread binds its own Compiler
+// with setCompiler, so several programs can be compiled at the same time.
+struct Compiler_ {
+  // reader: either a file or a buffer in memory
+  FILE *inputStream;
+  char *inputBuffer;
+  int inputSize, inputPos;
+  int lineNo, colNo;
+  int currentChar;
+
+  // parser
+  Token *currentToken;
+  Token *lookAhead;
+  int packedLValue;             // the last compileLValue selected a byte of a STRING/BYTES
+  Scope* parallelScope;         // scope of the innermost PARALLEL FOR being compiled, NULL outside
+  SubprogramCall* calls;        // for checkParallelCalls
+  int callCount, callCapacity;
+
+  // symbol table
+  Arena* symArena;
+  SymTab* symtab;
+  Type* intType;
+  Type* charType;
+  Type* typeTable[TYPE_TABLE_SIZE];
+  Object* writeiProcedure;
+  Object* writecProcedure;
+  Object* writelnProcedure;
+  Object* readiFunction;
+  Object* readcFunction;
+  Object* writesProcedure;
+  Object* lengthFunction;
+
+  // code generator
+  CodeBlock* codeBlock;
+  CodeAddress entryPoint;
+  SymbolEntry* symbols;         // for the SYMBOLS section of the executable
+  Object** symbolObjects;       // the subprogram of each symbol, for the optimizer
+  int symbolCount, symbolCapacity;
+  WORD* constants;              // string literals, for the DATA section
+  int constantSize, constantCapacity;   // in words
+  int optimize;                 // run optimizeCode after a successful compile (kplc -O0 clears it)
+  int outOfMemory;              // the symbol table, the code, its symbols or its constants are incomplete
+
+  // counters and phase timings, NULL unless requested (kplc -stats)
+  Stats* stats;
+
+  // An error jumps to the innermost recovery point of the parser
+  // (recoverJump), or back to compile() when there is none or when
+  // maxErrors (0: MAX_DIAGNOSTICS) diagnostics have been reported
+  jmp_buf errorJump;
+  jmp_buf* recoverJump;
+  int maxErrors;
+  Diagnostic diagnostics[MAX_DIAGNOSTICS];
+  int diagnosticCount;
+};
+
+typedef struct Compiler_ Compiler;
+
+extern THREAD_LOCAL Compiler* compiler;
+
+Compiler* createCompiler(void);
+void freeCompiler(Compiler* c);
+void setCompiler(Compiler* c);
+
+#endif
@@ -25,6 +25,11 @@ void printType(Type* type) {
     printType(type->elementType);
     printf(")");
     break;
+  case TP_PACKED:
+    if (type->elementType == NULL) printf("Packed(%d)", type->arraySize);
+    else if (type->elementType->typeClass == TP_CHAR) printf("Str(%d)", type->arraySize);
+    else printf("Bytes(%d)", type->arraySize);
+    break;
   }
 }
 
@@ -63,6 +68,8 @@ void printObject(Object* obj, int indent) {
     pad(indent);
     if (obj->paramAttrs->kind == PARAM_VALUE) 
       printf("Param %s : ", obj->name);
+    else if (obj->paramAttrs->kind == PARAM_CONST)
+      printf("Param CONST %s : ", obj->name);
     else
       printf("Param VAR %s : ", obj->name);
     printType(obj->paramAttrs->type);
@@ -6,16 +6,18 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "error.h"
+#include "compiler.h"
 
-#define NUM_OF_ERRORS 29
+#define NUM_OF_ERRORS 35
 
 struct ErrorMessage {
   ErrorCode errorCode;
   char *message;
 };
 
-struct ErrorMessage errors[29] = {
+struct ErrorMessage errors[NUM_OF_ERRORS] = {
   {ERR_END_OF_COMMENT, "End of comment expected."},
   {ERR_IDENT_TOO_LONG, "Identifier too long."},
   {ERR_INVALID_CONSTANT_CHAR, "Invalid char constant."},
@@ -44,21 +46,117 @@ struct ErrorMessage errors[29] = {
   {ERR_UNDECLARED_PROCEDURE, "Undeclared procedure."},
   {ERR_DUPLICATE_IDENT, "Duplicate identifier."},
   {ERR_TYPE_INCONSISTENCY, "Type inconsistency"},
-  {ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, "The number of arguments and the number of parameters are inconsistent."}
+  {ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, "The number of arguments and the number of parameters are inconsistent."},
+  {ERR_READONLY_PARAMETER, "A CONST parameter can not be modified."},
+  {ERR_END_OF_STRING, "End of string expected."},
+  {ERR_PARALLEL_IO, "No input or output inside a PARALLEL FOR."},
+  {ERR_PARALLEL_ASSIGNMENT, "Only array elements and the loop's own variables can be assigned inside a PARALLEL FOR."},
+  {ERR_PARALLEL_CALL, "A subprogram that assigns variables outside its own block can not be called inside a PARALLEL FOR."},
+  {ERR_OUT_OF_MEMORY, "Out of memory: the program could not be compiled."}
 };
 
-void error(ErrorCode err, int lineNo, int colNo) {
+int errorLimit(void) {
+  if ((compiler->maxErrors <= 0) || (compiler->maxErrors > MAX_DIAGNOSTICS))
+    return MAX_DIAGNOSTICS;
+  return compiler->maxErrors;
+}
+
+// Records a diagnostic in the current compiler. A second error at the same
+// position is usually a consequence of the first one and is dropped. Once
+// there is an error no code is generated any more. When the limit is
+// reached the compilation is abandoned.
+void recordDiagnostic(int lineNo, int colNo, char* message) {
+  Diagnostic* d;
+
+  if (compiler->diagnosticCount > 0) {
+    d = compiler->diagnostics + compiler->diagnosticCount - 1;
+    if ((d->lineNo == lineNo) && (d->colNo == colNo)) return;
+  } else if (compiler->codeBlock != NULL)
+    discardCode(compiler->codeBlock);
+
+  d = compiler->diagnostics + compiler->diagnosticCount ++;
+  d->lineNo = lineNo;
+  d->colNo = colNo;
+  strncpy(d->message, message, MAX_ERROR_LEN - 1);
+  d->message[MAX_ERROR_LEN - 1] = '\0';
+
+  if (compiler->diagnosticCount >= errorLimit())
+    longjmp(compiler->errorJump, 1);
+}
+
+// Records the error and abandons the current construct: control goes to the
+// parser's recovery point, or back to the setjmp in compile()
+void abortCompile(int lineNo, int colNo, char* message) {
+  recordDiagnostic(lineNo, colNo, message);
+  if (compiler->recoverJump != NULL)
+    longjmp(*(compiler->recoverJump), 1);
+  longjmp(compiler->errorJump, 1);
+}
+
+char* errorMessage(ErrorCode err) {
   int i;
   for (i = 0 ; i < NUM_OF_ERRORS; i ++) 
-    if (errors[i].errorCode == err) {
-      printf("%d-%d:%s\n", lineNo, colNo, errors[i].message);
-      exit(0);
-    }
+    if (errors[i].errorCode == err)
+      return errors[i].message;
+  return "";
+}
+
+void error(ErrorCode err, int lineNo, int colNo) {
+  abortCompile(lineNo, colNo, errorMessage(err));
+}
+
+// Lexical errors do not disturb the parser: the scanner skips the bad
+// characters and goes on
+void reportError(ErrorCode err, int lineNo, int colNo) {
+  recordDiagnostic(lineNo, colNo, errorMessage(err));
+}
+
+// Memory ran out: the compilation can not go on. Recovery points are
+// skipped, control goes straight back to the setjmp in compile()
+void outOfMemory(void) {
+  Token* token = (compiler->currentToken != NULL) ? compiler->currentToken : compiler->lookAhead;
+
+  compiler->outOfMemory = 1;
+  if (token != NULL)
+    recordDiagnostic(token->lineNo, token->colNo, errorMessage(ERR_OUT_OF_MEMORY));
+  else recordDiagnostic(1, 1, errorMessage(ERR_OUT_OF_MEMORY));
+  longjmp(compiler->errorJump, 1);
 }
 
 void missingToken(TokenType tokenType, int lineNo, int colNo) {
-  printf("%d-%d:Missing %s\n", lineNo, colNo, tokenToString(tokenType));
-  exit(0);
+  char message[MAX_ERROR_LEN];
+  snprintf(message, MAX_ERROR_LEN, "Missing %s", tokenToString(tokenType));
+  abortCompile(lineNo, colNo, message);
+}
+
+// The scanner reads one token ahead of the parser, so its diagnostics may
+// be recorded out of order; put them back in source order
+void sortDiagnostics(void) {
+  Diagnostic d;
+  int i, j;
+
+  for (i = 1; i < compiler->diagnosticCount; i ++) {
+    d = compiler->diagnostics[i];
+    j = i - 1;
+    while ((j >= 0) && ((compiler->diagnostics[j].lineNo > d.lineNo) ||
+			((compiler->diagnostics[j].lineNo == d.lineNo) && (compiler->diagnostics[j].colNo > d.colNo)))) {
+      compiler->diagnostics[j + 1] = compiler->diagnostics[j];
+      j --;
+    }
+    compiler->diagnostics[j + 1] = d;
+  }
+}
+
+// fileName, if not NULL, prefixes every line
+void printDiagnostics(char* fileName) {
+  Diagnostic* d;
+  int i;
+
+  for (i = 0; i < compiler->diagnosticCount; i ++) {
+    d = compiler->diagnostics + i;
+    if (fileName != NULL) printf("%s:", fileName);
+    printf("%d-%d:%s\n", d->lineNo, d->colNo, d->message);
+  }
 }
 
 void assert(char *msg) {
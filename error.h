@@ -8,6 +8,8 @@
 #define __ERROR_H__
 #include "token.h"
 
+#define MAX_ERROR_LEN 128
+
 typedef enum {
   ERR_END_OF_COMMENT,
   ERR_IDENT_TOO_LONG,
@@ -37,11 +39,31 @@ typedef enum {
   ERR_UNDECLARED_PROCEDURE,
   ERR_DUPLICATE_IDENT,
   ERR_TYPE_INCONSISTENCY,
-  ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY
+  ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY,
+  ERR_READONLY_PARAMETER,
+  ERR_END_OF_STRING,
+  ERR_PARALLEL_IO,
+  ERR_PARALLEL_ASSIGNMENT,
+  ERR_PARALLEL_CALL,
+  ERR_OUT_OF_MEMORY
 } ErrorCode;
 
+struct Diagnostic_ {
+  int lineNo, colNo;
+  char message[MAX_ERROR_LEN];
+};
+
+typedef struct Diagnostic_ Diagnostic;
+
+void recordDiagnostic(int lineNo, int colNo, char* message);
+void abortCompile(int lineNo, int colNo, char* message);
+char* errorMessage(ErrorCode err);
 void error(ErrorCode err, int lineNo, int colNo);
+void reportError(ErrorCode err, int lineNo, int colNo);
+void outOfMemory(void);
 void missingToken(TokenType tokenType, int lineNo, int colNo);
+void sortDiagnostics(void);
+void printDiagnostics(char* fileName);
 void assert(char *msg);
 
 #endif
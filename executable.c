@@ -0,0 +1,220 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "executable.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define PAGE_ALIGN(n) ((((n) + EXEC_PAGE_SIZE - 1) / EXEC_PAGE_SIZE) * EXEC_PAGE_SIZE)
+
+unsigned int checksum(void* data, size_t size) {
+  unsigned char* p = (unsigned char*) data;
+  unsigned int h = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < size; i ++) {
+    h ^= p[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// Lays out the header followed by the code section and the extra sections,
+// each starting on a page boundary so that the file can be mapped as is.
+// Returns a malloc'ed image of *size bytes, or NULL.
+unsigned char* buildExecutable(CodeBlock* codeBlock, CodeAddress entryPoint, Section* extra, int extraCount, size_t* size) {
+  ExecHeader header;
+  Section sections[MAX_SECTIONS];
+  unsigned char* image;
+  unsigned int offset;
+  int count, i;
+
+  if (extraCount > MAX_SECTIONS - 1) return NULL;
+
+  sections[0].type = SECTION_CODE;
+  sections[0].data = codeBlock->code;
+  sections[0].size = codeBlock->codeSize * sizeof(Instruction);
+  for (i = 0; i < extraCount; i ++)
+    sections[i + 1] = extra[i];
+  count = extraCount + 1;
+
+  memset(&header, 0, sizeof(ExecHeader));
+  memcpy(header.magic, EXEC_MAGIC, EXEC_MAGIC_LEN);
+  header.version = EXEC_VERSION;
+  header.endianTag = EXEC_ENDIAN_TAG;
+  header.entryPoint = entryPoint;
+  header.sectionCount = count;
+
+  offset = PAGE_ALIGN(sizeof(ExecHeader));
+  for (i = 0; i < count; i ++) {
+    header.sections[i].type = sections[i].type;
+    header.sections[i].offset = offset;
+    header.sections[i].size = sections[i].size;
+    header.sections[i].checksum = checksum(sections[i].data, sections[i].size);
+    offset = PAGE_ALIGN(offset + sections[i].size);
+  }
+
+  *size = header.sections[count - 1].offset + sections[count - 1].size;
+  image = (unsigned char*) calloc(*size, 1);
+  if (image == NULL) return NULL;
+  memcpy(image, &header, sizeof(ExecHeader));
+  for (i = 0; i < count; i ++)
+    memcpy(image + header.sections[i].offset, sections[i].data, sections[i].size);
+  return image;
+}
+
+int saveExecutable(CodeBlock* codeBlock, CodeAddress entryPoint, Section* extra, int extraCount, FILE* f) {
+  unsigned char* image;
+  size_t size;
+  int ok;
+
+  image = buildExecutable(codeBlock, entryPoint, extra, extraCount, &size);
+  if (image == NULL) return 0;
+  ok = (fwrite(image, 1, size, f) == size);
+  free(image);
+  return ok;
+}
+
+int loadImage(char* fileName, Executable* exe) {
+#ifndef _WIN32
+  struct stat st;
+  int fd;
+  void* image;
+
+  fd = open(fileName, O_RDONLY);
+  if (fd < 0) return 0;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return 0;
+  }
+  exe->imageSize = st.st_size;
+  if (exe->imageSize > 0) {
+    image = mmap(NULL, exe->imageSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (image != MAP_FAILED) {
+      close(fd);
+      exe->image = (unsigned char*) image;
+      exe->mapped = 1;
+      return 1;
+    }
+  }
+  close(fd);
+#endif
+  {
+    // No mmap (or an unmappable file): read the whole image instead
+    FILE* f = fopen(fileName, "rb");
+    long size;
+
+    if (f == NULL) return 0;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    exe->imageSize = (size > 0) ? size : 0;
+    exe->image = (unsigned char*) malloc(exe->imageSize + 1);
+    exe->mapped = 0;
+    if ((exe->image == NULL) || (fread(exe->image, 1, exe->imageSize, f) != exe->imageSize)) {
+      free(exe->image);
+      fclose(f);
+      return 0;
+    }
+    fclose(f);
+    return 1;
+  }
+}
+
+void releaseImage(Executable* exe) {
+#ifndef _WIN32
+  if (exe->mapped) {
+    munmap(exe->image, exe->imageSize);
+    return;
+  }
+#endif
+  free(exe->image);
+}
+
+int validateExecutable(Executable* exe) {
+  ExecHeader* header = exe->header;
+  SectionHeader* section;
+  unsigned int i;
+
+  if ((header->version != EXEC_VERSION) || (header->endianTag != EXEC_ENDIAN_TAG))
+    return 0;
+  if (header->sectionCount > MAX_SECTIONS)
+    return 0;
+
+  for (i = 0; i < header->sectionCount; i ++) {
+    section = header->sections + i;
+    if ((section->offset % EXEC_PAGE_SIZE) != 0) return 0;
+    if ((section->offset > exe->imageSize) || (section->size > exe->imageSize - section->offset))
+      return 0;
+    if (checksum(exe->image + section->offset, section->size) != section->checksum)
+      return 0;
+  }
+  return 1;
+}
+
+int openExecutable(char* fileName, Executable** result) {
+  Executable* exe = (Executable*) malloc(sizeof(Executable));
+  unsigned int size;
+
+  *result = NULL;
+  if (exe == NULL) return EXEC_OUT_OF_MEMORY;
+  // The code block is never grown or discarded: every flag starts cleared
+  memset(exe, 0, sizeof(Executable));
+  if (!loadImage(fileName, exe)) {
+    free(exe);
+    return EXEC_IO_ERROR;
+  }
+
+  if ((exe->imageSize < EXEC_MAGIC_LEN) || (memcmp(exe->image, EXEC_MAGIC, EXEC_MAGIC_LEN) != 0)) {
+    closeExecutable(exe);
+    return EXEC_NOT_CONTAINER;
+  }
+
+  exe->header = (ExecHeader*) exe->image;
+  if ((exe->imageSize < sizeof(ExecHeader)) || !validateExecutable(exe)) {
+    closeExecutable(exe);
+    return EXEC_BAD_FORMAT;
+  }
+
+  exe->code.code = (Instruction*) findSection(exe, SECTION_CODE, &size);
+  if ((exe->code.code == NULL) || ((size % sizeof(Instruction)) != 0)) {
+    closeExecutable(exe);
+    return EXEC_BAD_FORMAT;
+  }
+  exe->code.codeSize = size / sizeof(Instruction);
+  exe->code.maxSize = exe->code.codeSize;
+  if (exe->header->entryPoint >= (unsigned int) exe->code.codeSize) {
+    closeExecutable(exe);
+    return EXEC_BAD_FORMAT;
+  }
+
+  *result = exe;
+  return EXEC_OK;
+}
+
+void closeExecutable(Executable* exe) {
+  releaseImage(exe);
+  free(exe);
+}
+
+void* findSection(Executable* exe, enum SectionType type, unsigned int* size) {
+  unsigned int i;
+
+  for (i = 0; i < exe->header->sectionCount; i ++)
+    if (exe->header->sections[i].type == (unsigned int) type) {
+      if (size != NULL) *size = exe->header->sections[i].size;
+      return exe->image + exe->header->sections[i].offset;
+    }
+  return NULL;
+}
@@ -0,0 +1,94 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __EXECUTABLE_H__
+#define __EXECUTABLE_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include "instructions.h"
+
+#define EXEC_MAGIC "KPLX"
+#define EXEC_MAGIC_LEN 4
+#define EXEC_VERSION 1
+#define EXEC_ENDIAN_TAG 0x01020304
+#define EXEC_PAGE_SIZE 4096
+#define MAX_SECTIONS 8
+
+// Results of openExecutable
+#define EXEC_OK 0
+#define EXEC_IO_ERROR 1
+#define EXEC_NOT_CONTAINER 2    // no container header: raw or compact code
+#define EXEC_BAD_FORMAT 3
+#define EXEC_OUT_OF_MEMORY 4
+
+enum SectionType {
+  SECTION_NONE,
+  SECTION_CODE,      // array of Instruction
+  SECTION_DATA,      // read-only constants
+  SECTION_SYMBOLS,   // procedure/function names and code addresses
+  SECTION_LINES      // code address to source line table
+};
+
+struct SectionHeader_ {
+  unsigned int type;
+  unsigned int offset;    // from the start of the file, page aligned
+  unsigned int size;      // in bytes
+  unsigned int checksum;  // FNV-1a of the section bytes
+};
+
+typedef struct SectionHeader_ SectionHeader;
+
+struct ExecHeader_ {
+  char magic[EXEC_MAGIC_LEN];
+  unsigned int version;
+  unsigned int endianTag;     // EXEC_ENDIAN_TAG as written by the producer
+  unsigned int entryPoint;    // code address where execution starts
+  unsigned int sectionCount;
+  SectionHeader sections[MAX_SECTIONS];
+};
+
+typedef struct ExecHeader_ ExecHeader;
+
+// Record of the SYMBOLS section: the entry address of the program or of a
+// procedure/function. Nested subprograms are named OUTER.INNER.
+#define SYMBOL_NAME_LEN 60
+
+struct SymbolEntry_ {
+  unsigned int address;
+  char name[SYMBOL_NAME_LEN];
+};
+
+typedef struct SymbolEntry_ SymbolEntry;
+
+// A section to be written by saveExecutable
+struct Section_ {
+  enum SectionType type;
+  void* data;
+  unsigned int size;
+};
+
+typedef struct Section_ Section;
+
+struct Executable_ {
+  ExecHeader* header;     // points into image
+  unsigned char* image;   // file contents, mapped read-only when possible
+  size_t imageSize;
+  int mapped;
+  CodeBlock code;         // view of the code section; not owned
+};
+
+typedef struct Executable_ Executable;
+
+unsigned int checksum(void* data, size_t size);
+
+unsigned char* buildExecutable(CodeBlock* codeBlock, CodeAddress entryPoint, Section* extra, int extraCount, size_t* size);
+int saveExecutable(CodeBlock* codeBlock, CodeAddress entryPoint, Section* extra, int extraCount, FILE* f);
+int openExecutable(char* fileName, Executable** exe);
+void closeExecutable(Executable* exe);
+void* findSection(Executable* exe, enum SectionType type, unsigned int* size);
+
+#endif
@@ -0,0 +1,454 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "frames.h"
+#include "codegen.h"
+#include "compiler.h"
+#include "optimize.h"
+
+// Stack frame compaction, run after value numbering.
+//
+// Every variable of a subprogram, and every temporary added by value
+// numbering, gets the range of instructions of the body where its value is
+// live: from its first access to its last one, an address pushed by LA
+// being in use until the instruction that pops it (or until the CALL when
+// it is passed as a VAR argument). The code of a body is laid out in the
+// order it runs but for its loops, so a range that meets a loop is widened
+// to the whole loop. Words used by nested subprograms (PARALLEL FOR tasks
+// among them, whose code sits inside the body that runs them and is left
+// out of it) are live in the whole body. The slots are then placed again, first fit in the order their
+// ranges start, so that slots whose ranges do not meet share words of the
+// frame, and the LA/LV/SV that address them are rewritten. The value of a
+// variable before its first assignment is undefined; it may now be the
+// value another variable left in the same words.
+
+int stackPops(Instruction* inst) {
+  switch (inst->op) {
+  case OP_LI: case OP_FJ: case OP_WRC: case OP_WRI: case OP_NEG: case OP_NOT:
+  case OP_INB: case OP_WRS: case OP_CPK:
+    return 1;
+  case OP_ST: case OP_AD: case OP_SB: case OP_ML: case OP_DV: case OP_MOD:
+  case OP_EQ: case OP_NE: case OP_GT: case OP_LT: case OP_GE: case OP_LE:
+  case OP_AND: case OP_OR: case OP_CPY: case OP_LDB: case OP_CPS: case OP_CMPS:
+    return 2;
+  case OP_STB:
+    return 3;
+  case OP_VFIL: case OP_VCPY: case OP_VADD: case OP_VSUM:
+    return 4;
+  case OP_DCT:
+    return inst->q;
+  case OP_PFOR:
+    return (inst->p != REDUCE_NONE) ? 3 : 2;
+  default:
+    return 0;
+  }
+}
+
+int stackPushes(FrameCompactor* fc, Instruction* inst) {
+  switch (inst->op) {
+  case OP_LA: case OP_LV: case OP_LC: case OP_LI: case OP_RC: case OP_RI: case OP_CV:
+  case OP_AD: case OP_SB: case OP_ML: case OP_DV: case OP_MOD: case OP_NEG:
+  case OP_EQ: case OP_NE: case OP_GT: case OP_LT: case OP_GE: case OP_LE:
+  case OP_AND: case OP_OR: case OP_NOT: case OP_LDB: case OP_CMPS:
+    return 1;
+  case OP_INT:
+    return inst->q;
+  case OP_CALL:
+    return ((inst->q >= 0) && (inst->q < fc->codeSize)) ? fc->returnsValue[inst->q] : 0;
+  default:
+    return 0;
+  }
+}
+
+// Stack depth before every instruction of a body, the frame left out
+void computeDepths(FrameCompactor* fc, Frame* frame) {
+  Instruction* inst;
+  int k, d, next;
+
+  for (k = frame->body; k <= frame->end; k ++)
+    fc->depth[k] = -1;
+  fc->depth[frame->body] = 0;
+
+  for (k = frame->body; k <= frame->end; k ++) {
+    inst = fc->code + k;
+    d = fc->depth[k];
+    if (d < 0) continue;
+    next = (k == frame->body) ? 0 : d - stackPops(inst) + stackPushes(fc, inst);
+    if (next < 0) next = 0;
+
+    if (((inst->op == OP_J) || (inst->op == OP_FJ)) &&
+	(inst->q > k) && (inst->q <= frame->end) && (fc->depth[inst->q] < 0))
+      fc->depth[inst->q] = (inst->op == OP_FJ) ? d - 1 : d;
+    if ((inst->op != OP_J) && (inst->op != OP_EP) && (inst->op != OP_EF) && (inst->op != OP_HL) &&
+	(k < frame->end) && (fc->depth[k + 1] < 0))
+      fc->depth[k + 1] = next;
+  }
+}
+
+// Loops of a body: the target and the jump of every backward jump
+void findLoops(FrameCompactor* fc, Frame* frame) {
+  Instruction* inst;
+  int k;
+
+  fc->loopCount = 0;
+  for (k = frame->body; k <= frame->end; k ++) {
+    if (fc->taskEnd[k] >= 0) {
+      k = fc->taskEnd[k];
+      continue;
+    }
+    inst = fc->code + k;
+    if (((inst->op == OP_J) || (inst->op == OP_FJ)) && (inst->q >= frame->body) && (inst->q <= k)) {
+      fc->loops[2 * fc->loopCount] = inst->q;
+      fc->loops[2 * fc->loopCount + 1] = k;
+      fc->loopCount ++;
+    }
+  }
+}
+
+// Last instruction that uses the address pushed by the LA at k
+int addressConsumer(FrameCompactor* fc, Frame* frame, int k) {
+  int d = fc->depth[k];
+  int m;
+
+  for (m = k + 1; m <= frame->end; m ++) {
+    if (fc->depth[m] < 0) continue;
+    if (fc->depth[m] - stackPops(fc->code + m) <= d) {
+      // arguments are popped by a DCT just before the CALL that uses them
+      if ((fc->code[m].op == OP_DCT) && (m < frame->end) && (fc->code[m + 1].op == OP_CALL))
+	return m + 1;
+      return m;
+    }
+  }
+  return frame->end;
+}
+
+// Slot addressed by an LA/LV/SV of the body of frame f, -1 if none; the
+// frame it belongs to goes into *owner
+int findSlot(FrameCompactor* fc, int f, Instruction* inst, int* owner) {
+  Frame* frame;
+  int level;
+
+  if ((inst->op != OP_LA) && (inst->op != OP_LV) && (inst->op != OP_SV)) return -1;
+  for (level = inst->p; (level > 0) && (f >= 0); level --)
+    f = fc->frames[f].outer;
+  if (f < 0) return -1;
+  frame = fc->frames + f;
+  if ((inst->q < 0) || (inst->q >= frame->size)) return -1;
+  *owner = f;
+  return frame->owner[inst->q];
+}
+
+void collectRanges(FrameCompactor* fc, int f) {
+  Frame* frame = fc->frames + f;
+  FrameSlot* slot;
+  int k, s, g, last;
+
+  computeDepths(fc, frame);
+  for (k = frame->body; k <= frame->end; k ++) {
+    if (fc->taskEnd[k] >= 0) {
+      k = fc->taskEnd[k];
+      continue;
+    }
+    s = findSlot(fc, f, fc->code + k, &g);
+    if (s < 0) continue;
+    slot = fc->frames[g].slots + s;
+    if (fc->code[k].p > 0) {
+      slot->pinned = 1;
+      continue;
+    }
+    last = (fc->code[k].op == OP_LA) ? addressConsumer(fc, frame, k) : k;
+    if (k < slot->start) slot->start = k;
+    if (last > slot->end) slot->end = last;
+  }
+}
+
+void closeRanges(FrameCompactor* fc, Frame* frame) {
+  FrameSlot* slot;
+  int i, j, changed;
+
+  findLoops(fc, frame);
+  for (i = 0; i < frame->slotCount; i ++) {
+    slot = frame->slots + i;
+    if (slot->pinned) {
+      slot->start = frame->body;
+      slot->end = frame->end;
+      continue;
+    }
+    if (slot->start > slot->end) continue;
+    do {
+      changed = 0;
+      for (j = 0; j < fc->loopCount; j ++)
+	if ((slot->start <= fc->loops[2 * j + 1]) && (fc->loops[2 * j] <= slot->end)) {
+	  if (fc->loops[2 * j] < slot->start) {
+	    slot->start = fc->loops[2 * j];
+	    changed = 1;
+	  }
+	  if (fc->loops[2 * j + 1] > slot->end) {
+	    slot->end = fc->loops[2 * j + 1];
+	    changed = 1;
+	  }
+	}
+    } while (changed);
+  }
+}
+
+int compareSlotStarts(const void* a, const void* b) {
+  FrameSlot* x = *((FrameSlot**) a);
+  FrameSlot* y = *((FrameSlot**) b);
+
+  if (x->start != y->start) return (x->start < y->start) ? -1 : 1;
+  return x->offset - y->offset;
+}
+
+// First fit of the used slots in the order their ranges start; returns the
+// size of the frame they need
+int placeSlots(FrameCompactor* fc, Frame* frame) {
+  FrameSlot** order = fc->order;
+  FrameSlot** active = fc->placed;
+  FrameSlot* slot;
+  int count = 0, activeCount = 0;
+  int i, j, offset, moved, size = frame->fixedSize;
+
+  for (i = 0; i < frame->slotCount; i ++)
+    if (frame->slots[i].start <= frame->slots[i].end)
+      order[count ++] = frame->slots + i;
+  qsort(order, count, sizeof(FrameSlot*), compareSlotStarts);
+
+  for (i = 0; i < count; i ++) {
+    slot = order[i];
+
+    // the ranges still active are the ones that meet this one
+    for (j = 0; j < activeCount; )
+      if (active[j]->end < slot->start) active[j] = active[-- activeCount];
+      else j ++;
+
+    offset = frame->fixedSize;
+    do {
+      moved = 0;
+      for (j = 0; j < activeCount; j ++)
+	if ((offset < active[j]->newOffset + active[j]->size) && (active[j]->newOffset < offset + slot->size)) {
+	  offset = active[j]->newOffset + active[j]->size;
+	  moved = 1;
+	}
+    } while (moved);
+
+    slot->newOffset = offset;
+    if (offset + slot->size > size) size = offset + slot->size;
+    active[activeCount ++] = slot;
+  }
+  return size;
+}
+
+int compareFrameScopes(const void* a, const void* b) {
+  Scope* x = (*((Frame**) a))->scope;
+  Scope* y = (*((Frame**) b))->scope;
+
+  return (x < y) ? -1 : (x > y);
+}
+
+// Links every frame to the frame of the enclosing subprogram; 0 if one of
+// them can not be found
+int linkFrames(FrameCompactor* fc) {
+  Frame** byScope = (Frame**) malloc((fc->frameCount + 1) * sizeof(Frame*));
+  Frame key;
+  Frame* keyPointer = &key;
+  Frame** found;
+  int f;
+
+  if (byScope == NULL) return 0;
+  for (f = 0; f < fc->frameCount; f ++)
+    byScope[f] = fc->frames + f;
+  qsort(byScope, fc->frameCount, sizeof(Frame*), compareFrameScopes);
+  for (f = 0; f < fc->frameCount; f ++) {
+    key.scope = fc->frames[f].scope->outer;
+    if (key.scope == NULL) continue;
+    found = (Frame**) bsearch(&keyPointer, byScope, fc->frameCount, sizeof(Frame*), compareFrameScopes);
+    if (found == NULL) break;
+    fc->frames[f].outer = (int) (*found - fc->frames);
+  }
+  free(byScope);
+  return f == fc->frameCount;
+}
+
+int addSlot(Frame* frame, Object* var, int offset, int size) {
+  FrameSlot* slot;
+  int i;
+
+  if ((offset < frame->fixedSize) || (size <= 0) || (offset + size > frame->size)) return 0;
+  slot = frame->slots + frame->slotCount;
+  slot->var = var;
+  slot->offset = slot->newOffset = offset;
+  slot->size = size;
+  slot->start = INT_MAX;
+  slot->end = -1;
+  slot->pinned = 0;
+  for (i = 0; i < size; i ++)
+    frame->owner[offset + i] = frame->slotCount;
+  frame->slotCount ++;
+  return 1;
+}
+
+// Frame of the subprogram at symbols[i]; 0 if its code is not laid out as
+// compileBlock emits it
+int initFrame(FrameCompactor* fc, Frame* frame, int i) {
+  Object* obj = compiler->symbolObjects[i];
+  Instruction* code = fc->code;
+  ObjectNode* node;
+  int k, count;
+
+  memset(frame, 0, sizeof(Frame));
+  switch (obj->kind) {
+  case OBJ_PROGRAM: frame->scope = obj->progAttrs->scope; break;
+  case OBJ_FUNCTION: frame->scope = obj->funcAttrs->scope; break;
+  case OBJ_PROCEDURE: frame->scope = obj->procAttrs->scope; break;
+  default: return 0;
+  }
+  frame->entry = compiler->symbols[i].address;
+  if ((frame->entry < 0) || (frame->entry >= fc->codeSize) || (code[frame->entry].op != OP_J)) return 0;
+  frame->body = code[frame->entry].q;
+  if ((frame->body < 0) || (frame->body >= fc->codeSize) || (code[frame->body].op != OP_INT)) return 0;
+  frame->end = findBodyEnd(code, fc->codeSize, fc->isTask, frame->body);
+  if (frame->end == fc->codeSize) return 0;
+  frame->size = code[frame->body].q;
+  frame->outer = -1;
+  fc->returnsValue[frame->entry] = (obj->kind == OBJ_FUNCTION);
+
+  frame->fixedSize = RESERVED_WORDS;
+  count = 0;
+  for (node = frame->scope->objList; node != NULL; node = node->next)
+    if ((node->object->kind == OBJ_PARAMETER) && (node->object->paramAttrs->localOffset >= frame->fixedSize))
+      frame->fixedSize = node->object->paramAttrs->localOffset + 1;
+    else if (node->object->kind == OBJ_VARIABLE)
+      count ++;
+  if (frame->size > frame->scope->frameSize)
+    count += frame->size - frame->scope->frameSize;
+
+  frame->slots = (FrameSlot*) malloc((count + 1) * sizeof(FrameSlot));
+  frame->owner = (int*) malloc((frame->size + 1) * sizeof(int));
+  if ((frame->slots == NULL) || (frame->owner == NULL)) return 0;
+  for (k = 0; k < frame->size; k ++)
+    frame->owner[k] = -1;
+
+  for (node = frame->scope->objList; node != NULL; node = node->next)
+    if (node->object->kind == OBJ_VARIABLE)
+      addSlot(frame, node->object, node->object->varAttrs->localOffset, sizeOfType(node->object->varAttrs->type));
+  // temporaries of value numbering
+  for (k = frame->scope->frameSize; k < frame->size; k ++)
+    addSlot(frame, NULL, k, 1);
+  return 1;
+}
+
+void rewriteFrames(FrameCompactor* fc) {
+  Frame* frame;
+  FrameSlot* slot;
+  int f, k, s, g;
+
+  for (f = 0; f < fc->frameCount; f ++) {
+    frame = fc->frames + f;
+    for (k = frame->body + 1; k <= frame->end; k ++) {
+      if (fc->taskEnd[k] >= 0) {
+	k = fc->taskEnd[k];
+	continue;
+      }
+      s = findSlot(fc, f, fc->code + k, &g);
+      if (s < 0) continue;
+      slot = fc->frames[g].slots + s;
+      fc->code[k].q += slot->newOffset - slot->offset;
+    }
+  }
+
+  for (f = 0; f < fc->frameCount; f ++) {
+    frame = fc->frames + f;
+    fc->code[frame->body].q = frame->newSize;
+    for (s = 0; s < frame->slotCount; s ++)
+      if (frame->slots[s].var != NULL)
+	frame->slots[s].var->varAttrs->localOffset = frame->slots[s].newOffset;
+  }
+}
+
+void freeFrameCompactor(FrameCompactor* fc) {
+  int f;
+
+  for (f = 0; f < fc->frameCount; f ++) {
+    free(fc->frames[f].slots);
+    free(fc->frames[f].owner);
+  }
+  free(fc->frames);
+  free(fc->depth);
+  free(fc->returnsValue);
+  free(fc->isTask);
+  free(fc->taskEnd);
+  free(fc->loops);
+  free(fc->order);
+  free(fc->placed);
+}
+
+void compactFrames(void) {
+  FrameCompactor fc;
+  Frame* frame;
+  int n = compiler->codeBlock->codeSize;
+  int i, f, size, maxSlots = 0;
+
+  if ((n == 0) || (compiler->symbolCount == 0)) return;
+  memset(&fc, 0, sizeof(FrameCompactor));
+  fc.code = compiler->codeBlock->code;
+  fc.codeSize = n;
+  fc.frames = (Frame*) calloc(compiler->symbolCount, sizeof(Frame));
+  fc.depth = (int*) malloc(n * sizeof(int));
+  fc.returnsValue = (char*) calloc(n, 1);
+  fc.isTask = (char*) calloc(n, 1);
+  fc.taskEnd = (int*) malloc(n * sizeof(int));
+  fc.loops = (int*) malloc(2 * n * sizeof(int));
+  if ((fc.frames == NULL) || (fc.depth == NULL) || (fc.returnsValue == NULL) ||
+      (fc.isTask == NULL) || (fc.taskEnd == NULL) || (fc.loops == NULL)) {
+    freeFrameCompactor(&fc);
+    return;
+  }
+  markTasks(fc.code, n, fc.isTask);
+  for (i = 0; i < n; i ++)
+    fc.taskEnd[i] = -1;
+
+  for (i = 0; i < compiler->symbolCount; i ++) {
+    frame = fc.frames + fc.frameCount;
+    if (!initFrame(&fc, frame, i)) {
+      // an unexpected layout: leave all frames alone
+      fc.frameCount ++;
+      freeFrameCompactor(&fc);
+      return;
+    }
+    if (frame->slotCount > maxSlots) maxSlots = frame->slotCount;
+    if (fc.isTask[frame->entry]) fc.taskEnd[frame->entry] = frame->end;
+    fc.frameCount ++;
+  }
+  fc.order = (FrameSlot**) malloc((maxSlots + 1) * sizeof(FrameSlot*));
+  fc.placed = (FrameSlot**) malloc((maxSlots + 1) * sizeof(FrameSlot*));
+  if ((fc.order == NULL) || (fc.placed == NULL) || !linkFrames(&fc)) {
+    freeFrameCompactor(&fc);
+    return;
+  }
+
+  for (f = 0; f < fc.frameCount; f ++)
+    collectRanges(&fc, f);
+  for (f = 0; f < fc.frameCount; f ++) {
+    frame = fc.frames + f;
+    closeRanges(&fc, frame);
+    size = placeSlots(&fc, frame);
+    if (size < frame->size) {
+      if (compiler->stats != NULL) compiler->stats->frameWordsSaved += frame->size - size;
+      frame->newSize = size;
+    } else {
+      frame->newSize = frame->size;
+      for (i = 0; i < frame->slotCount; i ++)
+	frame->slots[i].newOffset = frame->slots[i].offset;
+    }
+  }
+
+  rewriteFrames(&fc);
+  freeFrameCompactor(&fc);
+}
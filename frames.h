@@ -0,0 +1,63 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __FRAMES_H__
+#define __FRAMES_H__
+
+#include "instructions.h"
+#include "symtab.h"
+
+// A variable or a temporary of the optimizer and the instructions of its
+// subprogram's body where its value is live
+struct FrameSlot_ {
+  Object* var;            // NULL for a temporary
+  int offset, size;       // words it uses in the frame as compiled
+  int newOffset;
+  int start, end;         // live range, start > end when it is never used
+  int pinned;             // used by a nested subprogram: live in the whole body
+};
+
+typedef struct FrameSlot_ FrameSlot;
+
+struct Frame_ {
+  Scope* scope;
+  int entry;              // J over the nested subprograms
+  int body, end;          // INT that allocates the frame, EP/EF/HL that ends the body
+  int outer;              // frame of the enclosing subprogram, -1 for the program
+  int fixedSize;          // return value, links and parameters stay in place
+  int size;               // words allocated by the INT
+  int newSize;            // once compacted
+  FrameSlot* slots;
+  int slotCount;
+  int* owner;             // slot of every word of the frame, -1 for fixed words
+};
+
+typedef struct Frame_ Frame;
+
+struct FrameCompactor_ {
+  Instruction* code;
+  int codeSize;
+  Frame* frames;
+  int frameCount;
+  int* depth;             // stack depth before every instruction, -1 when unreached
+  char* returnsValue;     // entry of a function: a CALL to it pushes the result
+  char* isTask;           // entry of a PARALLEL FOR task
+  int* taskEnd;           // at the entry of a task: the end of its body, -1 elsewhere
+  int* loops;             // target and jump of every backward jump of a body
+  int loopCount;
+  FrameSlot** order;      // slots sorted by the start of their live range
+  FrameSlot** placed;     // slots already placed whose ranges meet the current one
+};
+
+typedef struct FrameCompactor_ FrameCompactor;
+
+// Words an instruction pops from and pushes on the stack; fc is only read
+// for a CALL
+int stackPops(Instruction* inst);
+int stackPushes(FrameCompactor* fc, Instruction* inst);
+void compactFrames(void);
+
+#endif
@@ -5,6 +5,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "instructions.h"
 
 #define MAX_BLOCK 50
@@ -14,7 +15,9 @@ CodeBlock* createCodeBlock(int maxSize) {
 
   codeBlock->code = (Instruction*) malloc(maxSize * sizeof(Instruction));
   codeBlock->codeSize = 0;
-  codeBlock->maxSize = maxSize;
+  codeBlock->maxSize = (codeBlock->code != NULL) ? maxSize : 0;
+  codeBlock->discard = 0;
+  codeBlock->overflow = 0;
   return codeBlock;
 }
 
@@ -23,11 +26,45 @@ void freeCodeBlock(CodeBlock* codeBlock) {
   free(codeBlock);
 }
 
+// Make room for at least minSize instructions, doubling the capacity
+int growCodeBlock(CodeBlock* codeBlock, int minSize) {
+  Instruction* code;
+  int maxSize = codeBlock->maxSize;
+
+  if (minSize <= maxSize) return 1;
+  if (maxSize <= 0) maxSize = 1;
+  while (maxSize < minSize)
+    maxSize *= 2;
+
+  code = (Instruction*) realloc(codeBlock->code, maxSize * sizeof(Instruction));
+  if (code == NULL) return 0;
+  codeBlock->code = code;
+  codeBlock->maxSize = maxSize;
+  return 1;
+}
+
+// Empties the block and ignores any further instruction; the compiler uses
+// it once the program is known to be wrong
+void discardCode(CodeBlock* codeBlock) {
+  codeBlock->codeSize = 0;
+  codeBlock->discard = 1;
+}
+
+// Returns 0 when there is no memory for the instruction; the block is then
+// marked as overflowed and drops the instructions that follow
 int emitCode(CodeBlock* codeBlock, enum OpCode op, WORD p, WORD q) {
-  Instruction* bottom = codeBlock->code + codeBlock->codeSize;
+  Instruction* bottom;
+
+  if (codeBlock->discard) return !codeBlock->overflow;
 
-  if (codeBlock->codeSize >= codeBlock->maxSize) return 0;
+  if (codeBlock->codeSize >= codeBlock->maxSize)
+    if (!growCodeBlock(codeBlock, codeBlock->codeSize + 1)) {
+      codeBlock->overflow = 1;
+      codeBlock->discard = 1;
+      return 0;
+    }
 
+  bottom = codeBlock->code + codeBlock->codeSize;
   bottom->op = op;
   bottom->p = p;
   bottom->q = q;
@@ -65,10 +102,38 @@ int emitGT(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_GT, DC_VALUE, D
 int emitLT(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_LT, DC_VALUE, DC_VALUE); }
 int emitGE(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_GE, DC_VALUE, DC_VALUE); }
 int emitLE(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_LE, DC_VALUE, DC_VALUE); }
+int emitCPY(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_CPY, DC_VALUE, q); }
+int emitINB(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_INB, DC_VALUE, q); }
+int emitLDB(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_LDB, DC_VALUE, DC_VALUE); }
+int emitSTB(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_STB, DC_VALUE, DC_VALUE); }
+int emitCPS(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_CPS, DC_VALUE, DC_VALUE); }
+int emitCMPS(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_CMPS, DC_VALUE, DC_VALUE); }
+int emitWRS(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_WRS, DC_VALUE, DC_VALUE); }
+int emitWRK(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_WRK, DC_VALUE, q); }
+int emitCPK(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_CPK, DC_VALUE, q); }
+int emitSV(CodeBlock* codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_SV, p, q); }
+int emitPFOR(CodeBlock* codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_PFOR, p, q); }
+int emitVFIL(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_VFIL, DC_VALUE, DC_VALUE); }
+int emitVCPY(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_VCPY, DC_VALUE, DC_VALUE); }
+int emitVADD(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_VADD, DC_VALUE, DC_VALUE); }
+int emitVSUM(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_VSUM, DC_VALUE, DC_VALUE); }
 
 int emitBP(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_BP, DC_VALUE, DC_VALUE); }
 
 
+char* opCodeNames[NUM_OF_OPCODES] = {
+  "LA", "LV", "LC", "LI", "INT", "DCT", "J", "FJ", "HL", "ST",
+  "CALL", "EP", "EF", "RC", "RI", "WRC", "WRI", "WLN", "AD", "SB",
+  "ML", "DV", "NEG", "CV", "EQ", "NE", "GT", "LT", "GE", "LE",
+  "MOD", "AND", "OR", "NOT", "CPY", "INB", "LDB", "STB", "CPS", "CMPS",
+  "WRS", "WRK", "CPK", "SV", "PFOR", "VFIL", "VCPY", "VADD", "VSUM", "BP"
+};
+
+char* opCodeName(enum OpCode op) {
+  if ((op < 0) || (op >= NUM_OF_OPCODES)) return "?";
+  return opCodeNames[op];
+}
+
 void printInstruction(Instruction* inst) {
   switch (inst->op) {
   case OP_LA: printf("LA %d,%d", inst->p, inst->q); break;
@@ -101,6 +166,21 @@ void printInstruction(Instruction* inst) {
   case OP_LT: printf("LT"); break;
   case OP_GE: printf("GE"); break;
   case OP_LE: printf("LE"); break;
+  case OP_CPY: printf("CPY %d", inst->q); break;
+  case OP_INB: printf("INB %d", inst->q); break;
+  case OP_LDB: printf("LDB"); break;
+  case OP_STB: printf("STB"); break;
+  case OP_CPS: printf("CPS"); break;
+  case OP_CMPS: printf("CMPS"); break;
+  case OP_WRS: printf("WRS"); break;
+  case OP_WRK: printf("WRK %d", inst->q); break;
+  case OP_CPK: printf("CPK %d", inst->q); break;
+  case OP_SV: printf("SV %d,%d", inst->p, inst->q); break;
+  case OP_PFOR: printf("PFOR %d,%d", inst->p, inst->q); break;
+  case OP_VFIL: printf("VFIL"); break;
+  case OP_VCPY: printf("VCPY"); break;
+  case OP_VADD: printf("VADD"); break;
+  case OP_VSUM: printf("VSUM"); break;
 
   case OP_BP: printf("BP"); break;
   default: break;
@@ -119,18 +199,167 @@ void printCodeBlock(CodeBlock* codeBlock) {
 }
 
 
-void loadCode(CodeBlock* codeBlock, FILE* f) {
-  Instruction* code = codeBlock->code;
+/******************* Compact encoding ******************************/
+
+// Which operands an opcode carries in the compact encoding
+int operandsOf(enum OpCode op) {
+  switch (op) {
+  case OP_LA:
+  case OP_LV:
+  case OP_CALL:
+  case OP_SV:
+  case OP_PFOR:
+    return OPERAND_P | OPERAND_Q;
+  case OP_LC:
+  case OP_INT:
+  case OP_DCT:
+  case OP_J:
+  case OP_FJ:
+  case OP_CPY:
+  case OP_INB:
+  case OP_WRK:
+  case OP_CPK:
+    return OPERAND_Q;
+  default:
+    return 0;
+  }
+}
+
+int encodeVarint(unsigned char* buf, unsigned int value) {
+  int n = 0;
+  while (value >= 0x80) {
+    buf[n++] = (unsigned char) (value | 0x80);
+    value >>= 7;
+  }
+  buf[n++] = (unsigned char) value;
+  return n;
+}
+
+// Returns the number of bytes consumed, or 0 if the varint is truncated
+int decodeVarint(unsigned char* buf, int len, unsigned int* value) {
+  unsigned int v = 0;
+  int shift = 0;
+  int n = 0;
+
+  while (n < len && shift < 35) {
+    v |= ((unsigned int) (buf[n] & 0x7F)) << shift;
+    if ((buf[n++] & 0x80) == 0) {
+      *value = v;
+      return n;
+    }
+    shift += 7;
+  }
+  return 0;
+}
+
+#define ZIGZAG(v) ((((unsigned int) (v)) << 1) ^ (unsigned int) ((v) >> 31))
+#define UNZIGZAG(u) ((WORD) (((u) >> 1) ^ (~((u) & 1) + 1)))
+
+int encodeInstruction(unsigned char* buf, Instruction* inst) {
+  int operands = operandsOf(inst->op);
+  int n = 0;
+
+  buf[n++] = (unsigned char) inst->op;
+  if (operands & OPERAND_P) n += encodeVarint(buf + n, (unsigned int) inst->p);
+  if (operands & OPERAND_Q) n += encodeVarint(buf + n, ZIGZAG(inst->q));
+  return n;
+}
+
+int decodeCompactCode(CodeBlock* codeBlock, unsigned char* buf, int len) {
+  Instruction* inst;
+  unsigned int value;
+  int operands;
+  int pos = 0;
   int n;
 
   codeBlock->codeSize = 0;
-  while (!feof(f)) {
-    n = fread(code, sizeof(Instruction), MAX_BLOCK, f);
-    code += n;
-    codeBlock->codeSize += n;
+  while (pos < len) {
+    if (buf[pos] > OP_BP) return 0;
+    if (!growCodeBlock(codeBlock, codeBlock->codeSize + 1)) return 0;
+
+    inst = codeBlock->code + codeBlock->codeSize;
+    inst->op = (enum OpCode) buf[pos++];
+    inst->p = DC_VALUE;
+    inst->q = DC_VALUE;
+    operands = operandsOf(inst->op);
+
+    if (operands & OPERAND_P) {
+      n = decodeVarint(buf + pos, len - pos, &value);
+      if (n == 0) return 0;
+      inst->p = (WORD) value;
+      pos += n;
+    }
+    if (operands & OPERAND_Q) {
+      n = decodeVarint(buf + pos, len - pos, &value);
+      if (n == 0) return 0;
+      inst->q = UNZIGZAG(value);
+      pos += n;
+    }
+    codeBlock->codeSize ++;
+  }
+  return 1;
+}
+
+// Encodes the whole block into buf, which must hold
+// COMPACT_MAGIC_LEN + codeSize * MAX_ENCODED_SIZE bytes; returns the length used
+int encodeCompactCode(CodeBlock* codeBlock, unsigned char* buf) {
+  int i, len;
+
+  memcpy(buf, COMPACT_MAGIC, COMPACT_MAGIC_LEN);
+  len = COMPACT_MAGIC_LEN;
+  for (i = 0; i < codeBlock->codeSize; i ++)
+    len += encodeInstruction(buf + len, codeBlock->code + i);
+  return len;
+}
+
+void saveCompactCode(CodeBlock* codeBlock, FILE* f) {
+  unsigned char buf[MAX_ENCODED_SIZE];
+  int i, n;
+
+  fwrite(COMPACT_MAGIC, 1, COMPACT_MAGIC_LEN, f);
+  for (i = 0; i < codeBlock->codeSize; i ++) {
+    n = encodeInstruction(buf, codeBlock->code + i);
+    fwrite(buf, 1, n, f);
   }
 }
 
+/******************* Loading and saving ******************************/
+
+// Reads either the raw encoding or the compact one; compact code is
+// expanded into plain Instructions here so the VM sees a single format.
+int loadCode(CodeBlock* codeBlock, FILE* f) {
+  unsigned char* buf = NULL;
+  unsigned char* tmp;
+  int len = 0, cap = 0, n;
+  int result = 1;
+
+  do {
+    if (len == cap) {
+      cap = (cap == 0) ? MAX_BLOCK * sizeof(Instruction) : cap * 2;
+      tmp = (unsigned char*) realloc(buf, cap);
+      if (tmp == NULL) {
+	free(buf);
+	return 0;
+      }
+      buf = tmp;
+    }
+    n = fread(buf + len, 1, cap - len, f);
+    len += n;
+  } while (n > 0);
+
+  if (len >= COMPACT_MAGIC_LEN && memcmp(buf, COMPACT_MAGIC, COMPACT_MAGIC_LEN) == 0)
+    result = decodeCompactCode(codeBlock, buf + COMPACT_MAGIC_LEN, len - COMPACT_MAGIC_LEN);
+  else if (len % sizeof(Instruction) != 0)
+    result = 0;
+  else if (growCodeBlock(codeBlock, len / sizeof(Instruction))) {
+    memcpy(codeBlock->code, buf, len);
+    codeBlock->codeSize = len / sizeof(Instruction);
+  } else result = 0;
+
+  free(buf);
+  return result;
+}
+
 
 void saveCode(CodeBlock* codeBlock, FILE* f) {
   fwrite(codeBlock->code, sizeof(Instruction), codeBlock->codeSize, f);
@@ -16,6 +16,27 @@
 
 typedef int WORD;
 
+// Serialized code formats
+#define CODE_FORMAT_RAW 0      // array of Instruction structs
+#define CODE_FORMAT_COMPACT 1  // 1-byte opcode + varint operands
+#define CODE_FORMAT_EXEC 2     // sectioned container, see executable.h
+
+#define COMPACT_MAGIC "KPLZ"
+#define COMPACT_MAGIC_LEN 4
+#define MAX_ENCODED_SIZE 11    // opcode + two 5-byte varints
+
+// STRING and BYTES buffers: a length word, a capacity word, then the bytes
+// packed four to a word
+#define PACKED_HEADER_SIZE 2
+#define BYTES_PER_WORD 4
+#define PACKED_WORDS(capacity) (PACKED_HEADER_SIZE + ((capacity) + BYTES_PER_WORD - 1) / BYTES_PER_WORD)
+
+#define OPERAND_P 1
+#define OPERAND_Q 2
+
+// New opcodes go before OP_BP. The number of opcodes is part of the compile
+// cache key (computeCacheKey); reordering opcodes without adding one needs a
+// new KPLC_VERSION instead.
 enum OpCode {
   OP_LA,   // Load Address
   OP_LV,   // Load Value
@@ -55,9 +76,40 @@ enum OpCode {
   OP_NOT,  // Logic NOT
   // ---------------------------------
 
+  OP_CPY,  // Copy q words: destination address at t-1, source address at t
+
+  // STRING/BYTES buffers, addressed by their first (length) word
+  OP_INB,  // Init Buffer of capacity q at address t: empty
+  OP_LDB,  // Load Byte: buffer at t-1, index at t
+  OP_STB,  // Store Byte: buffer at t-2, index at t-1, value at t
+  OP_CPS,  // Copy bytes of buffer t into buffer t-1, up to its capacity
+  OP_CMPS, // Compare buffers t-1 and t: -1, 0 or 1
+  OP_WRS,  // Write the bytes of buffer t
+  OP_WRK,  // Write the string constant at offset q of the DATA section
+  OP_CPK,  // Copy the string constant at offset q into buffer t
+
+  OP_SV,   // Save Value: store t into word q of the frame p levels up, keeping it
+
+  OP_PFOR, // Parallel For: call function q on parts of the range [t-1, t] (t-2, t-1 when
+           // p != 0) on the worker threads; p != 0 combines the results into the word at t
+
+  // Loops over the words of an array, the counter at t-3 running from its
+  // value up to t-2; the array is at t-1 and its words indexed by the counter
+  OP_VFIL, // Vector Fill: store t into the words
+  OP_VCPY, // Vector Copy: copy the words of the array at t into those at t-1
+  OP_VADD, // Vector Add: add t to the words
+  OP_VSUM, // Vector Sum: add the sum of the words to the word at t
+
   OP_BP    // Break point
 };
 
+// Reductions of a PARALLEL FOR (p of OP_PFOR)
+#define REDUCE_NONE 0
+#define REDUCE_ADD 1
+#define REDUCE_MUL 2
+
+#define NUM_OF_OPCODES (OP_BP + 1)
+
 struct Instruction_ {
   enum OpCode op;
   WORD p;
@@ -70,14 +122,18 @@ typedef int CodeAddress;
 struct CodeBlock_ {
   Instruction* code;
   int codeSize;
-  int maxSize;
+  int maxSize;            // current capacity; the buffer grows on demand
+  int discard;            // set by discardCode: emitted instructions are dropped
+  int overflow;           // the buffer could not grow: the code is incomplete
 };
 
 typedef struct CodeBlock_ CodeBlock;
 
 CodeBlock* createCodeBlock(int maxSize);
 void freeCodeBlock(CodeBlock* codeBlock);
+int growCodeBlock(CodeBlock* codeBlock, int minSize);
 
+void discardCode(CodeBlock* codeBlock);
 int emitCode(CodeBlock* codeBlock, enum OpCode op, WORD p, WORD q);
 
 int emitLA(CodeBlock* codeBlock, WORD p, WORD q);
@@ -110,13 +166,31 @@ int emitGT(CodeBlock* codeBlock);
 int emitLT(CodeBlock* codeBlock);
 int emitGE(CodeBlock* codeBlock);
 int emitLE(CodeBlock* codeBlock);
+int emitCPY(CodeBlock* codeBlock, WORD q);
+int emitINB(CodeBlock* codeBlock, WORD q);
+int emitLDB(CodeBlock* codeBlock);
+int emitSTB(CodeBlock* codeBlock);
+int emitCPS(CodeBlock* codeBlock);
+int emitCMPS(CodeBlock* codeBlock);
+int emitWRS(CodeBlock* codeBlock);
+int emitWRK(CodeBlock* codeBlock, WORD q);
+int emitCPK(CodeBlock* codeBlock, WORD q);
+int emitSV(CodeBlock* codeBlock, WORD p, WORD q);
+int emitPFOR(CodeBlock* codeBlock, WORD p, WORD q);
+int emitVFIL(CodeBlock* codeBlock);
+int emitVCPY(CodeBlock* codeBlock);
+int emitVADD(CodeBlock* codeBlock);
+int emitVSUM(CodeBlock* codeBlock);
 
 int emitBP(CodeBlock* codeBlock);
 
+char* opCodeName(enum OpCode op);
 void printInstruction(Instruction* instruction);
 void printCodeBlock(CodeBlock* codeBlock);
 
-void loadCode(CodeBlock* codeBlock, FILE* f);
+int loadCode(CodeBlock* codeBlock, FILE* f);
 void saveCode(CodeBlock* codeBlock, FILE* f);
+void saveCompactCode(CodeBlock* codeBlock, FILE* f);
+int encodeCompactCode(CodeBlock* codeBlock, unsigned char* buf);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,57 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __KPLC_H__
+#define __KPLC_H__
+
+// Embeddable KPL compiler (libkplc). Programs are compiled from memory to
+// memory: the library opens no files, prints nothing and never exits.
+// A KplcCompiler may be reused for many programs but must only be used by
+// one thread at a time; separate compilers can run in parallel.
+
+#define KPLC_OK 0
+#define KPLC_COMPILE_ERROR 1
+#define KPLC_BAD_ARGUMENT 2
+#define KPLC_OUT_OF_MEMORY 3
+
+// Output formats of kplcSerialize, same as kplc -raw, -compact and the default
+#define KPLC_FORMAT_RAW 0
+#define KPLC_FORMAT_COMPACT 1
+#define KPLC_FORMAT_EXEC 2
+
+#define KPLC_MAX_MESSAGE_LEN 128
+
+struct KplcDiagnostic_ {
+  int lineNo, colNo;
+  char message[KPLC_MAX_MESSAGE_LEN];
+};
+
+typedef struct KplcDiagnostic_ KplcDiagnostic;
+
+typedef struct Compiler_ KplcCompiler;
+typedef struct KplcResult_ KplcResult;
+
+KplcCompiler* kplcCreateCompiler(void);
+void kplcFreeCompiler(KplcCompiler* c);
+
+// Stops a compilation after n diagnostics (0: as many as a result can hold)
+void kplcSetMaxErrors(KplcCompiler* c, int n);
+
+// Compiles size bytes of source. *result is always set (NULL only when out
+// of memory) and must be released with kplcFreeResult.
+int kplcCompile(KplcCompiler* c, char* source, int size, KplcResult** result);
+
+int kplcDiagnosticCount(KplcResult* result);
+KplcDiagnostic* kplcDiagnostic(KplcResult* result, int i);
+int kplcCodeSize(KplcResult* result);
+
+// Encodes the compiled program; *buffer is malloc'ed and owned by the caller.
+// A program with string literals can only be written as KPLC_FORMAT_EXEC.
+int kplcSerialize(KplcResult* result, int format, unsigned char** buffer, int* size);
+
+void kplcFreeResult(KplcResult* result);
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmhost.h"
+
+#define MAX_JOB_LINE 4096
+
+// A line of the input: the instance it runs, and its files
+struct Job_ {
+  char name[MAX_JOB_LINE];
+  FILE* input;
+  FILE* output;
+};
+
+typedef struct Job_ Job;
+
+int threadCount = 0;
+int requestedStackSize = DEFAULT_STACK_SIZE;
+long long budget = 0;
+long long jobOutputLimit = 0;
+int printRunStats = 0;
+
+void printUsage(void) {
+  printf("Usage: kplhost [-threads=N] [-s=stack_size] [-budget=fuel] [-max-output=bytes] [-stats]\n");
+  printf("   Runs the jobs read from standard input, one per line:\n");
+  printf("     name executable input output\n");
+  printf("   where input may be - for none. Every executable is loaded once. A line\n");
+  printf("   \"name status\" is printed when a job is over.\n");
+  printf("   -threads=N: run the jobs on N threads (default: one per processor)\n");
+  printf("   -s=stack_size: set the stack size of every job\n");
+  printf("   -budget=fuel: stop a job once it has used that much fuel, about as many instructions\n");
+  printf("   -max-output=bytes: stop a job before it writes more than that\n");
+  printf("   -stats: also print the instructions executed and the fuel used\n");
+}
+
+int analyseParam(char* param) {
+  if (strncmp(param, "-threads=", 9) == 0) {
+    threadCount = atoi(param + 9);
+    return (threadCount > 0);
+  }
+  if (strncmp(param, "-s=", 3) == 0) {
+    requestedStackSize = atoi(param + 3);
+    return (requestedStackSize > 0);
+  }
+  if (strncmp(param, "-budget=", 8) == 0) {
+    budget = atoll(param + 8);
+    return (budget > 0);
+  }
+  if (strncmp(param, "-max-output=", 12) == 0) {
+    jobOutputLimit = atoll(param + 12);
+    return (jobOutputLimit > 0);
+  }
+  if (strcmp(param, "-stats") == 0) {
+    printRunStats = 1;
+    return 1;
+  }
+  return 0;
+}
+
+/******************************************************************/
+
+void jobFinished(HostInstance* instance) {
+  Job* job = (Job*) instance->data;
+
+  if (printRunStats)
+    printf("%s %s instructions %lld fuel %lld\n", job->name, statusName(instance->status),
+	   instance->vm.mainThread.instructionCount, instance->fuelUsed);
+  else printf("%s %s\n", job->name, statusName(instance->status));
+  fflush(stdout);
+
+  if (job->input != NULL) fclose(job->input);
+  fclose(job->output);
+  free(job);
+  freeInstance(instance);
+}
+
+// Starts the job of a line; reports it at once when it can not start
+void startJob(VMHost* host, char* line) {
+  char executable[MAX_JOB_LINE], input[MAX_JOB_LINE], output[MAX_JOB_LINE];
+  HostedProgram* program;
+  HostInstance* instance;
+  Job* job = (Job*) malloc(sizeof(Job));
+  int result;
+
+  if (job == NULL) return;
+  if (sscanf(line, "%s %s %s %s", job->name, executable, input, output) != 4) {
+    if (sscanf(line, "%s", job->name) == 1)
+      printf("%s bad_job\n", job->name);
+    free(job);
+    return;
+  }
+
+  program = loadHostedProgram(host, executable, &result);
+  if (program == NULL) {
+    printf("%s %s\n", job->name, (result == EXEC_IO_ERROR) ? "cannot_read" :
+	   (result == EXEC_OUT_OF_MEMORY) ? statusName(PS_OUT_OF_MEMORY) : "bad_format");
+    free(job);
+    return;
+  }
+
+  job->input = (strcmp(input, "-") == 0) ? NULL : fopen(input, "rb");
+  job->output = fopen(output, "wb");
+  if ((job->output == NULL) || ((job->input == NULL) && (strcmp(input, "-") != 0))) {
+    printf("%s cannot_open\n", job->name);
+    instance = NULL;
+  } else {
+    instance = createInstance(host, program, budget);
+    if (instance == NULL) printf("%s %s\n", job->name, statusName(PS_OUT_OF_MEMORY));
+  }
+  if (instance == NULL) {
+    if (job->input != NULL) fclose(job->input);
+    if (job->output != NULL) fclose(job->output);
+    free(job);
+    return;
+  }
+
+  initIO(&(instance->vm.io), job->input, job->output);
+  if (jobOutputLimit > 0) instance->vm.io.outputLimit = jobOutputLimit;
+  instance->vm.counting = printRunStats;
+  instance->data = job;
+  submitInstance(host, instance);
+}
+
+int main(int argc, char *argv[]) {
+  char line[MAX_JOB_LINE];
+  VMHost* host;
+  int i;
+
+  for (i = 1; i < argc; i ++)
+    if (!analyseParam(argv[i])) {
+      printUsage();
+      return -1;
+    }
+
+  host = createHost(threadCount, requestedStackSize, jobFinished);
+  if (host == NULL) {
+    printf("kplhost: out of memory!\n");
+    return -1;
+  }
+
+  while (fgets(line, MAX_JOB_LINE, stdin) != NULL) {
+    if (strspn(line, " \t\r\n") == strlen(line)) continue;
+    startJob(host, line);
+  }
+
+  freeHost(host);
+  return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm.h"
+#include "executable.h"
+#include "profile.h"
+
+int dumpCode = 0;
+int profileFormat = 0;
+int printRunStats = 0;
+int requestedStackSize = DEFAULT_STACK_SIZE;
+
+void printUsage(void) {
+  printf("Usage: kplrun input [-s=stack_size] [-fuel=N] [-max-output=bytes] [-dump] [-profile[=collapsed]] [-stats] [-threads=N]\n");
+  printf("   input: input kpl program\n");
+  printf("   -s=stack_size: set the stack size, which limits the memory of the program\n");
+  printf("   -fuel=N: stop the program once it has used N fuel, about N instructions\n");
+  printf("   -max-output=bytes: stop the program before it writes more than that\n");
+  printf("   -dump: code dump\n");
+  printf("   -profile: print executed instructions by opcode and subprogram, and the call graph, to stderr\n");
+  printf("   -profile=collapsed: print collapsed stacks for flamegraph tools instead\n");
+  printf("   -stats: print instructions executed, peak stack, calls and run time to stderr\n");
+  printf("   -threads=N: run PARALLEL FOR on N threads (default: one per processor)\n");
+}
+
+int analyseParam(char* param) {
+  if (strncmp(param, "-s=", 3) == 0) {
+    requestedStackSize = atoi(param + 3);
+    return (requestedStackSize > 0);
+  }
+  if (strncmp(param, "-fuel=", 6) == 0) {
+    fuelBudget = atoll(param + 6);
+    return (fuelBudget > 0);
+  }
+  if (strncmp(param, "-max-output=", 12) == 0) {
+    outputLimit = atoll(param + 12);
+    return (outputLimit > 0);
+  }
+  if (strncmp(param, "-threads=", 9) == 0) {
+    workerCount = atoi(param + 9);
+    return (workerCount > 0);
+  }
+  if (strcmp(param, "-dump") == 0) {
+    dumpCode = 1;
+    return 1;
+  }
+  if (strcmp(param, "-stats") == 0) {
+    printRunStats = 1;
+    return 1;
+  }
+  if ((strcmp(param, "-profile") == 0) || (strcmp(param, "--profile") == 0)) {
+    profileFormat = PROFILE_TEXT;
+    return 1;
+  }
+  if ((strcmp(param, "-profile=collapsed") == 0) || (strcmp(param, "--profile=collapsed") == 0)) {
+    profileFormat = PROFILE_COLLAPSED;
+    return 1;
+  }
+  return 0;
+}
+
+/******************************************************************/
+
+// Seconds from an arbitrary origin
+double readWallClock(void) {
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+  return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+// What a program stopped by a limit had used, on stderr
+void printLimitReport(int status) {
+  fprintf(stderr, "status %s\nfuel %lld\n", statusName(status), fuelUsed);
+  if (counting) fprintf(stderr, "instructions %lld\n", instructionCount);
+  fprintf(stderr, "peak_stack %d\noutput_bytes %lld\n", peakStack, outputBytes);
+}
+
+int main(int argc, char *argv[]) {
+  int i;
+  int status;
+  double startTime;
+
+  if (argc <= 1) {
+    printf("kplrun: no input file.\n");
+    printUsage();
+    return -1;
+  }
+
+  for (i = 2; i < argc; i ++)
+    if (!analyseParam(argv[i])) {
+      printUsage();
+      return -1;
+    }
+
+  initVM(requestedStackSize);
+
+  switch (loadExecutableFile(argv[1])) {
+  case EXEC_OK:
+    break;
+  case EXEC_IO_ERROR:
+    printf("kplrun: Can\'t read input file!\n");
+    cleanVM();
+    return -1;
+  case EXEC_OUT_OF_MEMORY:
+    printf("kplrun: Out of memory!\n");
+    cleanVM();
+    return -1;
+  default:
+    printf("kplrun: Wrong executable format!\n");
+    cleanVM();
+    return -1;
+  }
+
+  if (dumpCode) {
+    printVMCode();
+    cleanVM();
+    return 0;
+  }
+
+  if (profileFormat != 0) startProfile();
+  counting = printRunStats;
+  startTime = readWallClock();
+  status = run();
+  if (printRunStats)
+    fprintf(stderr, "instructions %lld\npeak_stack %d\ncalls %lld\nfuel %lld\noutput_bytes %lld\nwall_ms %.3f\n",
+	    instructionCount, peakStack, callCount, fuelUsed, outputBytes, (readWallClock() - startTime) * 1e3);
+  if (profileFormat != 0) {
+    printProfile(stderr, profileFormat);
+    stopProfile();
+  }
+  switch (status) {
+  case PS_DIVIDE_BY_ZERO:
+    printf("Runtime error: Divide by zero!\n");
+    break;
+  case PS_STACK_OVERFLOW:
+    printf("Runtime error: Stack overflow!\n");
+    if ((fuelBudget > 0) || (outputLimit > 0)) printLimitReport(status);
+    break;
+  case PS_IO_ERROR:
+    printf("Runtime error: IO error!\n");
+    break;
+  case PS_INVALID_CODE:
+    printf("Runtime error: Invalid code!\n");
+    break;
+  case PS_INDEX_ERROR:
+    printf("Runtime error: Index out of range!\n");
+    break;
+  case PS_PARALLEL_IO:
+    printf("Runtime error: Input or output inside a PARALLEL FOR!\n");
+    break;
+  case PS_OUT_OF_BUDGET:
+    printf("Runtime error: Out of fuel!\n");
+    printLimitReport(status);
+    break;
+  case PS_OUT_OF_MEMORY:
+    printf("Runtime error: Out of memory!\n");
+    break;
+  case PS_OUTPUT_LIMIT:
+    printf("Runtime error: Output limit exceeded!\n");
+    printLimitReport(status);
+    break;
+  default:
+    break;
+  }
+
+  cleanVM();
+  return (status == PS_NORMAL_EXIT) ? 0 : status;
+}
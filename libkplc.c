@@ -0,0 +1,154 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "kplc.h"
+#include "reader.h"
+#include "parser.h"
+#include "codegen.h"
+#include "executable.h"
+#include "compiler.h"
+
+struct KplcResult_ {
+  int status;
+  CodeBlock* codeBlock;     // NULL when the compilation failed
+  CodeAddress entryPoint;
+  SymbolEntry* symbols;     // procedure names for the SYMBOLS section
+  int symbolCount;
+  WORD* constants;          // string literals for the DATA section
+  int constantSize;         // in words
+  int diagnosticCount;
+  KplcDiagnostic diagnostics[MAX_DIAGNOSTICS];
+};
+
+KplcCompiler* kplcCreateCompiler(void) {
+  return createCompiler();
+}
+
+void kplcFreeCompiler(KplcCompiler* c) {
+  if (c != NULL) freeCompiler(c);
+}
+
+void kplcSetMaxErrors(KplcCompiler* c, int n) {
+  if (c != NULL) c->maxErrors = n;
+}
+
+int kplcCompile(KplcCompiler* c, char* source, int size, KplcResult** result) {
+  Compiler* saved = compiler;
+  KplcResult* r;
+  int i;
+
+  *result = NULL;
+  if ((c == NULL) || (source == NULL) || (size < 0)) return KPLC_BAD_ARGUMENT;
+  r = (KplcResult*) malloc(sizeof(KplcResult));
+  if (r == NULL) return KPLC_OUT_OF_MEMORY;
+  memset(r, 0, sizeof(KplcResult));
+
+  // The library may be called from a thread that is already compiling
+  setCompiler(c);
+  initCodeBuffer();
+  if (compileSource(source, size) == IO_SUCCESS) {
+    r->status = KPLC_OK;
+    r->codeBlock = c->codeBlock;
+    r->entryPoint = c->entryPoint;
+    c->codeBlock = NULL;
+    r->symbols = (SymbolEntry*) malloc(c->symbolCount * sizeof(SymbolEntry) + 1);
+    if (r->symbols != NULL) {
+      memcpy(r->symbols, c->symbols, c->symbolCount * sizeof(SymbolEntry));
+      r->symbolCount = c->symbolCount;
+    }
+    if (c->constantSize > 0) {
+      r->constants = (WORD*) malloc(c->constantSize * sizeof(WORD));
+      if (r->constants != NULL) {
+	memcpy(r->constants, c->constants, c->constantSize * sizeof(WORD));
+	r->constantSize = c->constantSize;
+      }
+    }
+  } else {
+    r->status = KPLC_COMPILE_ERROR;
+    cleanCodeBuffer();
+  }
+
+  r->diagnosticCount = c->diagnosticCount;
+  for (i = 0; i < c->diagnosticCount; i ++) {
+    r->diagnostics[i].lineNo = c->diagnostics[i].lineNo;
+    r->diagnostics[i].colNo = c->diagnostics[i].colNo;
+    strcpy(r->diagnostics[i].message, c->diagnostics[i].message);
+  }
+  setCompiler(saved);
+
+  *result = r;
+  return r->status;
+}
+
+int kplcDiagnosticCount(KplcResult* result) {
+  return (result == NULL) ? 0 : result->diagnosticCount;
+}
+
+KplcDiagnostic* kplcDiagnostic(KplcResult* result, int i) {
+  if ((result == NULL) || (i < 0) || (i >= result->diagnosticCount)) return NULL;
+  return result->diagnostics + i;
+}
+
+int kplcCodeSize(KplcResult* result) {
+  if ((result == NULL) || (result->codeBlock == NULL)) return 0;
+  return result->codeBlock->codeSize;
+}
+
+int kplcSerialize(KplcResult* result, int format, unsigned char** buffer, int* size) {
+  CodeBlock* codeBlock;
+  Section sections[2];
+  int sectionCount = 1;
+  size_t len;
+
+  *buffer = NULL;
+  *size = 0;
+  if ((result == NULL) || (result->codeBlock == NULL)) return KPLC_BAD_ARGUMENT;
+  codeBlock = result->codeBlock;
+  // String literals only fit in the container format
+  if ((result->constantSize > 0) && (format != KPLC_FORMAT_EXEC)) return KPLC_BAD_ARGUMENT;
+
+  switch (format) {
+  case KPLC_FORMAT_RAW:
+    len = codeBlock->codeSize * sizeof(Instruction);
+    *buffer = (unsigned char*) malloc(len + 1);
+    if (*buffer == NULL) return KPLC_OUT_OF_MEMORY;
+    memcpy(*buffer, codeBlock->code, len);
+    break;
+  case KPLC_FORMAT_COMPACT:
+    *buffer = (unsigned char*) malloc(COMPACT_MAGIC_LEN + codeBlock->codeSize * MAX_ENCODED_SIZE);
+    if (*buffer == NULL) return KPLC_OUT_OF_MEMORY;
+    len = encodeCompactCode(codeBlock, *buffer);
+    break;
+  case KPLC_FORMAT_EXEC:
+    sections[0].type = SECTION_SYMBOLS;
+    sections[0].data = result->symbols;
+    sections[0].size = result->symbolCount * sizeof(SymbolEntry);
+    if (result->constantSize > 0) {
+      sections[1].type = SECTION_DATA;
+      sections[1].data = result->constants;
+      sections[1].size = result->constantSize * sizeof(WORD);
+      sectionCount ++;
+    }
+    *buffer = buildExecutable(codeBlock, result->entryPoint, sections, sectionCount, &len);
+    if (*buffer == NULL) return KPLC_OUT_OF_MEMORY;
+    break;
+  default:
+    return KPLC_BAD_ARGUMENT;
+  }
+  *size = (int) len;
+  return KPLC_OK;
+}
+
+void kplcFreeResult(KplcResult* result) {
+  if (result == NULL) return;
+  if (result->codeBlock != NULL)
+    freeCodeBlock(result->codeBlock);
+  free(result->symbols);
+  free(result->constants);
+  free(result);
+}
@@ -10,16 +10,40 @@
 
 #include "reader.h"
 #include "parser.h"
+#include "scanner.h"
 #include "codegen.h"
+#include "cache.h"
+#include "error.h"
+#include "compiler.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#define KPLC_VERSION "1.5"
+#define MAX_JOBS 64
 
 
 int dumpCode = 0;
+int maxErrors = 0;
+int optimize = 1;
+int statsFormat = 0;
+int codeFormat = CODE_FORMAT_EXEC;
+char* cacheDir = NULL;
 
 void printUsage(void) {
-  printf("Usage: kplc input output [-dump]\n");
+  printf("Usage: kplc input output [-dump] [-compact] [-raw] [-cache=dir] [-errors=N] [-stats[=json]] [-O0]\n");
+  printf("       kplc -j N input... [-compact] [-raw] [-cache=dir] [-stats[=json]] [-O0]\n");
   printf("   input: input kpl program\n");
   printf("   output: executable\n");
+  printf("   -j N: compile every input with N threads; foo.kpl is written to foo\n");
   printf("   -dump: code dump\n");
+  printf("   -compact: write the compact (variable-length) encoding\n");
+  printf("   -raw: write bare instructions without the container header\n");
+  printf("   -cache=dir: reuse executables cached in dir (default: $%s)\n", CACHE_ENV);
+  printf("   -errors=N: stop after N errors (default and maximum: %d)\n", MAX_DIAGNOSTICS);
+  printf("   -stats: print phase timings and counters (-stats=json: as JSON)\n");
+  printf("   -O0: do not optimize the code\n");
 }
 
 int analyseParam(char* param) {
@@ -27,14 +51,203 @@ int analyseParam(char* param) {
     dumpCode = 1;
     return 1;
   } 
+  if (strcmp(param, "-compact") == 0) {
+    codeFormat = CODE_FORMAT_COMPACT;
+    return 1;
+  }
+  if (strcmp(param, "-raw") == 0) {
+    codeFormat = CODE_FORMAT_RAW;
+    return 1;
+  }
+  if (strncmp(param, "-cache=", 7) == 0) {
+    cacheDir = param + 7;
+    return 1;
+  }
+  if (strcmp(param, "-stats") == 0) {
+    statsFormat = STATS_TEXT;
+    return 1;
+  }
+  if (strcmp(param, "-stats=json") == 0) {
+    statsFormat = STATS_JSON;
+    return 1;
+  }
+  if (strcmp(param, "-O0") == 0) {
+    optimize = 0;
+    return 1;
+  }
+  if (strncmp(param, "-errors=", 8) == 0) {
+    maxErrors = atoi(param + 8);
+    return 1;
+  }
   return 0;
 }
 
 
 /******************************************************************/
 
+// Batch mode state, shared by the worker threads
+char** batchFiles;
+int batchCount = 0;
+int nextBatchFile = 0;
+int batchFailures = 0;
+#ifndef _WIN32
+pthread_mutex_t batchLock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_BATCH() pthread_mutex_lock(&batchLock)
+#define UNLOCK_BATCH() pthread_mutex_unlock(&batchLock)
+#else
+#define LOCK_BATCH()
+#define UNLOCK_BATCH()
+#endif
+
+// Compiles input into output with the calling thread's compiler.
+// Returns 1 on success; diagnostics are prefixed with the file name in
+// batch mode.
+int compileFile(char* input, char* output, int batch) {
+  int useCache = 0;
+  int result;
+  char cacheKey[CACHE_KEY_LEN + 1];
+  Stats* stats = compiler->stats;
+  double wall, cpu, totalWall, totalCpu;
+
+  // Statistics describe a real compilation, so they bypass the cache, as
+  // a code dump does
+  if ((cacheDir != NULL) && (*cacheDir != '\0') && !dumpCode && (stats == NULL))
+    useCache = computeCacheKey(input, optimize ? KPLC_VERSION : KPLC_VERSION "-O0", codeFormat, cacheKey);
+
+  if (useCache && lookupCache(cacheDir, cacheKey, output))
+    return 1;
+
+  if (stats != NULL) {
+    memset(stats, 0, sizeof(Stats));
+    startPhase(&totalWall, &totalCpu);
+    wall = totalWall;
+    cpu = totalCpu;
+  }
+
+  initCodeBuffer();
+
+  compiler->maxErrors = maxErrors;
+  compiler->optimize = optimize;
+  result = compile(input);
+  if (stats != NULL) {
+    collectCodeStats(stats, compiler->codeBlock, INIT_CODE_SIZE);
+    // Scanning is interleaved with parsing: the phases share the time
+    // since the start, so that the phases add up to the total
+    endScanAndParse(stats, &wall, &cpu);
+  }
+
+  if (result != IO_SUCCESS) {
+    LOCK_BATCH();
+    if (result == IO_ERROR) {
+      if (batch) printf("%s:", input);
+      printf("Can\'t read input file!\n");
+    } else printDiagnostics(batch ? input : NULL);
+    UNLOCK_BATCH();
+    cleanCodeBuffer();
+    return 0;
+  }
+
+  // The output may still be a hard link into the cache from an earlier hit
+  if (useCache) remove(output);
+
+  if ((codeFormat != CODE_FORMAT_EXEC) && (compiler->constantSize > 0)) {
+    LOCK_BATCH();
+    if (batch) printf("%s:", input);
+    printf("String literals need the executable format (no -compact or -raw)!\n");
+    UNLOCK_BATCH();
+    cleanCodeBuffer();
+    return 0;
+  }
+
+  if (serialize(output, codeFormat) == IO_ERROR) {
+    LOCK_BATCH();
+    if (batch) printf("%s:", input);
+    printf("Can\'t write output file!\n");
+    UNLOCK_BATCH();
+    cleanCodeBuffer();
+    return 0;
+  }
+  if (stats != NULL) {
+    endPhase(stats, PHASE_SERIALIZE, wall, cpu);
+    endPhase(stats, PHASE_TOTAL, totalWall, totalCpu);
+  }
+
+  if (useCache) storeCache(cacheDir, cacheKey, output);
+
+  if (dumpCode && !batch) printCodeBuffer();
+
+  cleanCodeBuffer();
+
+  if (stats != NULL) {
+    stats->peakMemory = readPeakMemory();
+    LOCK_BATCH();
+    printStats(stats, input, statsFormat);
+    UNLOCK_BATCH();
+  }
+  return 1;
+}
+
+// foo.kpl is compiled to foo, anything else to <name>.out
+void makeOutputName(char* input, char* output) {
+  int len = strlen(input);
+
+  strncpy(output, input, MAX_PATH_LEN - 5);
+  output[MAX_PATH_LEN - 5] = '\0';
+  if ((len > 4) && (len < MAX_PATH_LEN - 5) && (strcmp(input + len - 4, ".kpl") == 0))
+    output[len - 4] = '\0';
+  else strcat(output, ".out");
+}
+
+void* batchWorker(void* arg) {
+  Compiler* c = createCompiler();
+  char output[MAX_PATH_LEN];
+  int i;
+
+  if (statsFormat != 0) c->stats = createStats();
+  setCompiler(c);
+  while (1) {
+    LOCK_BATCH();
+    i = nextBatchFile ++;
+    UNLOCK_BATCH();
+    if (i >= batchCount) break;
+
+    makeOutputName(batchFiles[i], output);
+    if (!compileFile(batchFiles[i], output, 1)) {
+      LOCK_BATCH();
+      batchFailures ++;
+      UNLOCK_BATCH();
+    }
+  }
+  setCompiler(NULL);
+  freeCompiler(c);
+  return NULL;
+}
+
+int runBatch(int jobs) {
+#ifndef _WIN32
+  pthread_t workers[MAX_JOBS];
+  int i, started = 0;
+
+  if (jobs > MAX_JOBS) jobs = MAX_JOBS;
+  if (jobs > batchCount) jobs = batchCount;
+  for (i = 0; i < jobs; i ++)
+    if (pthread_create(&workers[started], NULL, batchWorker, NULL) == 0)
+      started ++;
+  if (started == 0)
+    batchWorker(NULL);
+  for (i = 0; i < started; i ++)
+    pthread_join(workers[i], NULL);
+#else
+  batchWorker(NULL);
+#endif
+  return (batchFailures == 0) ? 0 : 1;
+}
+
 int main(int argc, char *argv[]) {
+  Compiler* c;
   int i; 
+  int jobs;
+  int ok, status;
 
   if (argc <= 1) {
     printf("kplc: no input file.\n");
@@ -42,6 +255,28 @@ int main(int argc, char *argv[]) {
     return -1;
   }
 
+  cacheDir = getenv(CACHE_ENV);
+
+  if (strcmp(argv[1], "-j") == 0) {
+    if ((argc <= 2) || ((jobs = atoi(argv[2])) <= 0)) {
+      printUsage();
+      return -1;
+    }
+    batchFiles = (char**) malloc(argc * sizeof(char*));
+    for (i = 3; i < argc; i ++)
+      if (!analyseParam(argv[i]))
+	batchFiles[batchCount ++] = argv[i];
+    if (batchCount == 0) {
+      printf("kplc: no input file.\n");
+      printUsage();
+      free(batchFiles);
+      return -1;
+    }
+    ok = runBatch(jobs);
+    free(batchFiles);
+    return ok;
+  }
+
   if (argc <= 2) {
     printf("kplc: no output file.\n");
     printUsage();
@@ -51,21 +286,15 @@ int main(int argc, char *argv[]) {
   for ( i = 3; i < argc; i ++) 
     analyseParam(argv[i]);
 
-  initCodeBuffer();
+  c = createCompiler();
+  if (statsFormat != 0) c->stats = createStats();
+  setCompiler(c);
+  ok = compileFile(argv[1], argv[2], 0);
 
-  if (compile(argv[1]) == IO_ERROR) {
-    printf("Can\'t read input file!\n");
-    return -1;
-  }
-
-  if (serialize(argv[2]) == IO_ERROR) {
-    printf("Can\'t write output file!\n");
-    return -1;
-  }
-
-  if (dumpCode) printCodeBuffer();
-    
-  cleanCodeBuffer();
-
-  return 0;
+  // Compile errors exit with 1, I/O errors with -1
+  if (ok) status = 0;
+  else status = (c->diagnosticCount > 0) ? 1 : -1;
+  setCompiler(NULL);
+  freeCompiler(c);
+  return status;
 }
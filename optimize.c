@@ -0,0 +1,1050 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "frames.h"
+#include "codegen.h"
+#include "compiler.h"
+
+// Value numbering on the generated code, run once a program compiled
+// without errors.
+//
+// The body of every subprogram is split into basic blocks, and the stack
+// code of each is executed symbolically, giving each value a number: two
+// computations with the same number give the same result. The blocks are
+// numbered along their dominator tree, every block starting from the
+// values known at the end of its immediate dominator, since that block has
+// run, last, before it. A block that only its dominator jumps or falls into
+// also goes on with its stack. One where paths merge (a join after an IF,
+// the head of a loop) starts with an unknown stack and forgets the loads
+// that the blocks on the paths from its dominator may store to. When a
+// value is computed again, the later
+// computations are replaced by LV of a word added to the frame, and the
+// first one saves its result there with SV. Loads are forgotten when a
+// store, a call or a block copy may change the memory they read; indexing
+// out of an array's bounds is taken to be undefined, so a store into an
+// array does not kill loads from other variables.
+
+#define KILL_ALL 0
+#define KILL_VARIABLE 1      // store to a variable: LA p,q
+#define KILL_ELEMENT 2       // store into an array based on an LA
+#define KILL_STORED 3        // the stores of a KillSet
+
+int growArray(void** array, int* capacity, int minSize, int elementSize) {
+  void* grown;
+  int size = (*capacity == 0) ? 64 : *capacity;
+
+  while (size < minSize) size *= 2;
+  if (size == *capacity) return 1;
+  grown = realloc(*array, (size_t) size * elementSize);
+  if (grown == NULL) return 0;
+  *array = grown;
+  *capacity = size;
+  return 1;
+}
+
+/******************* Value numbers ******************************/
+
+// A new value, computed first by producer (-1 for a value that is not known)
+int newValue(Optimizer* opt, int producer, int key) {
+  int capacity = opt->valueCapacity;
+
+  if (opt->valueCount == opt->valueCapacity) {
+    if (!growArray((void**) &opt->firstProducer, &capacity, opt->valueCount + 1, sizeof(int)) ||
+	!growArray((void**) &opt->valueKey, &opt->valueCapacity, opt->valueCount + 1, sizeof(int)))
+      return -1;
+  }
+  opt->firstProducer[opt->valueCount] = producer;
+  opt->valueKey[opt->valueCount] = key;
+  return opt->valueCount ++;
+}
+
+int unknownValue(Optimizer* opt) {
+  return newValue(opt, -1, -1);
+}
+
+unsigned int hashKey(enum OpCode op, WORD p, WORD q, int left, int right) {
+  unsigned int h = (unsigned int) op;
+
+  h = h * 31 + (unsigned int) p;
+  h = h * 31 + (unsigned int) q;
+  h = h * 31 + (unsigned int) left;
+  h = h * 31 + (unsigned int) right;
+  return h ^ (h >> 15);
+}
+
+int findKey(Optimizer* opt, enum OpCode op, WORD p, WORD q, int left, int right) {
+  int k = opt->buckets[hashKey(op, p, q, left, right) & opt->bucketMask];
+  ValueKey* key;
+
+  while (k >= 0) {
+    key = opt->keys + k;
+    if (key->live && (key->op == op) && (key->p == p) && (key->q == q) &&
+	(key->left == left) && (key->right == right))
+      return k;
+    k = key->next;
+  }
+  return -1;
+}
+
+// The LA an address is based on (a variable or an array), -1 if unknown
+int rootOf(Optimizer* opt, int value) {
+  int k = (value >= 0) ? opt->valueKey[value] : -1;
+  int root;
+
+  if (k < 0) return -1;
+  switch (opt->keys[k].op) {
+  case OP_LA:
+    return value;
+  case OP_AD:
+    root = rootOf(opt, opt->keys[k].left);
+    return (root >= 0) ? root : rootOf(opt, opt->keys[k].right);
+  case OP_SB:
+    return rootOf(opt, opt->keys[k].left);
+  default:
+    return -1;
+  }
+}
+
+int addKey(Optimizer* opt, enum OpCode op, WORD p, WORD q, int left, int right, int value, int load) {
+  unsigned int bucket = hashKey(op, p, q, left, right) & opt->bucketMask;
+  int capacity = opt->keyCapacity;
+  ValueKey* key;
+
+  if (opt->keyCount == opt->keyCapacity) {
+    if (!growArray((void**) &opt->liveLoads, &capacity, opt->keyCount + 1, sizeof(int)) ||
+	!growArray((void**) &opt->keys, &opt->keyCapacity, opt->keyCount + 1, sizeof(ValueKey)))
+      return -1;
+  }
+  key = opt->keys + opt->keyCount;
+  key->op = op;
+  key->p = p;
+  key->q = q;
+  key->left = left;
+  key->right = right;
+  key->value = value;
+  key->load = load;
+  key->root = (op == OP_LI) ? rootOf(opt, left) : -1;
+  key->live = 1;
+  key->next = opt->buckets[bucket];
+  opt->buckets[bucket] = opt->keyCount;
+  if (load) opt->liveLoads[opt->liveLoadCount ++] = opt->keyCount;
+  return opt->keyCount ++;
+}
+
+// Value number of an expression computed by instruction producer
+int numberValue(Optimizer* opt, enum OpCode op, WORD p, WORD q, int left, int right, int load, int producer) {
+  int k = findKey(opt, op, p, q, left, right);
+  int value;
+
+  if (k >= 0) {
+    value = opt->keys[k].value;
+    // undone when the walk leaves the block; without room in the log the
+    // value is not reused
+    if ((opt->firstProducer[value] < 0) &&
+	growArray((void**) &opt->producerLog, &opt->producerLogCapacity, opt->producerLogCount + 1, sizeof(int))) {
+      opt->firstProducer[value] = producer;
+      opt->producerLog[opt->producerLogCount ++] = value;
+    }
+    return value;
+  }
+  value = newValue(opt, producer, -1);
+  if (value < 0) return -1;
+  k = addKey(opt, op, p, q, left, right, value, load);
+  if (k < 0) return -1;
+  opt->valueKey[value] = k;
+  return value;
+}
+
+int inKillSet(KillSet* set, WORD p, WORD q) {
+  int i;
+
+  if (set->all) return 1;
+  for (i = 0; i < set->count; i ++)
+    if ((set->p[i] == p) && (set->q[i] == q)) return 1;
+  return 0;
+}
+
+void addKill(KillSet* set, int all, WORD p, WORD q) {
+  if (set->all || (!all && inKillSet(set, p, q))) return;
+  if (all || (set->count == MAX_KILLED_ROOTS)) {
+    set->all = 1;
+    return;
+  }
+  set->p[set->count] = p;
+  set->q[set->count] = q;
+  set->count ++;
+}
+
+void mergeKills(KillSet* set, KillSet* other) {
+  int i;
+
+  if (other->all) set->all = 1;
+  for (i = 0; (i < other->count) && !set->all; i ++)
+    addKill(set, 0, other->p[i], other->q[i]);
+}
+
+// Forgets the loads a store may have changed. For KILL_VARIABLE, root is
+// the LA of the variable; for KILL_ELEMENT, the LA of the array; for
+// KILL_STORED, set holds the stores. A load of an enclosing block is only
+// marked dead and logged, to live again when the walk leaves the block.
+void forgetLoads(Optimizer* opt, int mode, int root, KillSet* set) {
+  ValueKey* rootKey = (root >= 0) ? opt->keys + opt->valueKey[root] : NULL;
+  ValueKey* key;
+  int i, kept = opt->scopeLoads;
+  int kill;
+
+  for (i = 0; i < opt->liveLoadCount; i ++) {
+    key = opt->keys + opt->liveLoads[i];
+    if (!key->live) continue;
+    switch (mode) {
+    case KILL_VARIABLE:
+      kill = ((key->op == OP_LV) && (key->p == rootKey->p) && (key->q == rootKey->q)) ||
+	((key->op == OP_LI) && ((key->root < 0) || (key->root == root)));
+      break;
+    case KILL_ELEMENT:
+      kill = (key->op == OP_LI) && ((key->root < 0) || (key->root == root));
+      break;
+    case KILL_STORED:
+      if (key->op == OP_LV)
+	kill = inKillSet(set, key->p, key->q);
+      else
+	kill = (key->root < 0) ||
+	  inKillSet(set, opt->keys[opt->valueKey[key->root]].p, opt->keys[opt->valueKey[key->root]].q);
+      break;
+    default:
+      kill = 1;
+      break;
+    }
+    if (i < opt->scopeLoads) {
+      if (!kill) continue;
+      key->live = 0;
+      // without room in the log the load stays dead
+      if (growArray((void**) &opt->killLog, &opt->killLogCapacity, opt->killLogCount + 1, sizeof(int)))
+	opt->killLog[opt->killLogCount ++] = opt->liveLoads[i];
+    } else if (kill)
+      key->live = 0;
+    else
+      opt->liveLoads[kept ++] = opt->liveLoads[i];
+  }
+  opt->liveLoadCount = kept;
+}
+
+void killLoads(Optimizer* opt, int mode, int root) {
+  forgetLoads(opt, mode, root, NULL);
+}
+
+// ST of value at address: afterwards a load from there gives value
+void numberStore(Optimizer* opt, int address, int value) {
+  int root = rootOf(opt, address);
+  ValueKey* key;
+
+  if (root == address) {
+    key = opt->keys + opt->valueKey[address];
+    killLoads(opt, KILL_VARIABLE, root);
+    addKey(opt, OP_LV, key->p, key->q, -1, -1, value, 1);
+  } else {
+    killLoads(opt, (root >= 0) ? KILL_ELEMENT : KILL_ALL, root);
+    addKey(opt, OP_LI, DC_VALUE, DC_VALUE, address, -1, value, 1);
+  }
+}
+
+/******************* Simulated stack ******************************/
+
+int push(Optimizer* opt, int value, int start, int end) {
+  StackValue* entry;
+
+  if (!growArray((void**) &opt->stack, &opt->stackCapacity, opt->depth + 1, sizeof(StackValue)))
+    return 0;
+  entry = opt->stack + opt->depth ++;
+  entry->value = value;
+  entry->start = start;
+  entry->end = end;
+  return 1;
+}
+
+// An empty stack holds values pushed before the block, which are unknown
+StackValue pop(Optimizer* opt) {
+  StackValue entry;
+
+  if (opt->depth > 0)
+    return opt->stack[-- opt->depth];
+  entry.value = unknownValue(opt);
+  entry.start = -1;
+  entry.end = -1;
+  return entry;
+}
+
+// Pushes the result of instruction i; start is the first instruction of
+// its computation, -1 when it can not be replaced
+void produce(Optimizer* opt, int i, int value, int start) {
+  Occurrence* occ;
+  int f = (value >= 0) ? opt->firstProducer[value] : -1;
+
+  push(opt, value, start, i);
+
+  // a later computation of a known value, longer than the load replacing
+  // it; the first one is in this block or in a block that dominates it
+  if ((f >= 0) && (start >= 0) && (start < i) && ((f < start) || (f > i)) &&
+      (opt->segment[start] == opt->segment[i])) {
+    if (!growArray((void**) &opt->occurrences, &opt->occurrenceCapacity, opt->occurrenceCount + 1, sizeof(Occurrence)))
+      return;
+    occ = opt->occurrences + opt->occurrenceCount ++;
+    occ->producer = f;
+    occ->start = start;
+    occ->end = i;
+  }
+}
+
+int isCommutative(enum OpCode op) {
+  return (op == OP_AD) || (op == OP_ML) || (op == OP_EQ) || (op == OP_NE) ||
+    (op == OP_AND) || (op == OP_OR);
+}
+
+// Executes instruction i symbolically; returns 0 when the block ends with it
+int numberInstruction(Optimizer* opt, int i) {
+  Instruction* inst = opt->code + i;
+  StackValue a, b;
+  int left, right;
+  int n;
+
+  switch (inst->op) {
+  case OP_LA:
+  case OP_LC:
+    produce(opt, i, numberValue(opt, inst->op, inst->p, inst->q, -1, -1, 0, i), i);
+    return 1;
+  case OP_LV:
+    produce(opt, i, numberValue(opt, OP_LV, inst->p, inst->q, -1, -1, 1, i), i);
+    return 1;
+  case OP_LI:
+  case OP_NEG:
+  case OP_NOT:
+    a = pop(opt);
+    produce(opt, i, numberValue(opt, inst->op, DC_VALUE, DC_VALUE, a.value, -1, inst->op == OP_LI, i),
+	    ((a.start >= 0) && (a.end == i - 1)) ? a.start : -1);
+    return 1;
+  case OP_AD:
+  case OP_SB:
+  case OP_ML:
+  case OP_DV:
+  case OP_MOD:
+  case OP_EQ:
+  case OP_NE:
+  case OP_GT:
+  case OP_LT:
+  case OP_GE:
+  case OP_LE:
+  case OP_AND:
+  case OP_OR:
+    b = pop(opt);
+    a = pop(opt);
+    left = a.value;
+    right = b.value;
+    if (isCommutative(inst->op) && (left > right)) {
+      left = b.value;
+      right = a.value;
+    }
+    produce(opt, i, numberValue(opt, inst->op, DC_VALUE, DC_VALUE, left, right, 0, i),
+	    ((a.start >= 0) && (b.start >= 0) && (b.end == i - 1) && (a.end == b.start - 1)) ? a.start : -1);
+    return 1;
+  case OP_CV:
+    a = pop(opt);
+    push(opt, a.value, a.start, a.end);
+    push(opt, a.value, i, i);
+    return 1;
+  case OP_INT:
+    if (inst->q > MAX_TRACKED_PUSH) {
+      opt->depth = 0;
+      return 1;
+    }
+    for (n = 0; n < inst->q; n ++)
+      push(opt, unknownValue(opt), -1, -1);
+    return 1;
+  case OP_DCT:
+    for (n = 0; (n < inst->q) && (opt->depth > 0); n ++)
+      pop(opt);
+    return 1;
+  case OP_ST:
+    b = pop(opt);
+    a = pop(opt);
+    numberStore(opt, a.value, b.value);
+    return 1;
+  case OP_CALL:
+  case OP_PFOR:
+    // the callee may change any variable; its frame replaces the top of
+    // the stack, and a function leaves its result there
+    killLoads(opt, KILL_ALL, -1);
+    opt->depth = 0;
+    return 1;
+  case OP_FJ:
+  case OP_WRC:
+  case OP_WRI:
+  case OP_WRS:
+    pop(opt);
+    return 1;
+  case OP_WLN:
+  case OP_WRK:
+  case OP_BP:
+    return 1;
+  case OP_RC:
+  case OP_RI:
+    push(opt, unknownValue(opt), -1, -1);
+    return 1;
+  case OP_LDB:
+  case OP_CMPS:
+    pop(opt);
+    pop(opt);
+    push(opt, unknownValue(opt), -1, -1);
+    return 1;
+  case OP_INB:
+  case OP_CPK:
+    pop(opt);
+    killLoads(opt, KILL_ALL, -1);
+    return 1;
+  case OP_CPY:
+  case OP_CPS:
+    pop(opt);
+    pop(opt);
+    killLoads(opt, KILL_ALL, -1);
+    return 1;
+  case OP_STB:
+    pop(opt);
+    pop(opt);
+    pop(opt);
+    killLoads(opt, KILL_ALL, -1);
+    return 1;
+  case OP_VFIL:
+  case OP_VCPY:
+  case OP_VADD:
+  case OP_VSUM:
+    for (n = 0; n < 4; n ++)
+      pop(opt);
+    killLoads(opt, KILL_ALL, -1);
+    return 1;
+  default:
+    // J, EP, EF, HL and anything unexpected
+    return 0;
+  }
+}
+
+/******************* Replacements ******************************/
+
+int compareProducers(const void* x, const void* y) {
+  const Occurrence* a = (const Occurrence*) x;
+  const Occurrence* b = (const Occurrence*) y;
+
+  if (a->producer != b->producer) return a->producer - b->producer;
+  return a->start - b->start;
+}
+
+int compareOccurrences(const void* x, const void* y) {
+  const Occurrence* a = (const Occurrence*) x;
+  const Occurrence* b = (const Occurrence*) y;
+
+  if (a->valueLength != b->valueLength) return b->valueLength - a->valueLength;
+  return compareProducers(x, y);
+}
+
+// Decides which later computations of the body are replaced, outer
+// expressions first. frameBase is the first free word of the frame.
+// Returns the number of words used.
+int chooseReplacements(Optimizer* opt, int frameBase) {
+  Occurrence* occ = opt->occurrences;
+  int first, last, i, k, f;
+  int gain, size, length, temps = 0;
+
+  if (opt->occurrenceCount == 0) return 0;
+
+  // the longest computation of each value orders the groups
+  qsort(occ, opt->occurrenceCount, sizeof(Occurrence), compareProducers);
+  for (first = 0; first < opt->occurrenceCount; first = last) {
+    length = 0;
+    for (last = first; (last < opt->occurrenceCount) && (occ[last].producer == occ[first].producer); last ++)
+      if (occ[last].end - occ[last].start + 1 > length)
+	length = occ[last].end - occ[last].start + 1;
+    for (i = first; i < last; i ++)
+      occ[i].valueLength = length;
+  }
+  qsort(occ, opt->occurrenceCount, sizeof(Occurrence), compareOccurrences);
+
+  for (first = 0; first < opt->occurrenceCount; first = last) {
+    for (last = first + 1; (last < opt->occurrenceCount) && (occ[last].producer == occ[first].producer); last ++);
+    f = occ[first].producer;
+    if (opt->removed[f]) continue;
+
+    // the value is saved with one SV; each replaced computation becomes
+    // one LV. A computation in another block may not run, so it counts
+    // half (gain is in half instructions).
+    gain = -2;
+    for (i = first; i < last; i ++) {
+      size = 0;
+      for (k = occ[i].start; k <= occ[i].end; k ++) {
+	if (opt->saveOffset[k] >= 0) break;
+	if (!opt->removed[k] || (opt->loadOffset[k] >= 0)) size ++;
+      }
+      if ((k <= occ[i].end) || opt->removed[occ[i].start]) occ[i].start = -1;
+      else gain += (size - 1) * ((opt->segment[occ[i].start] == opt->segment[f]) ? 2 : 1);
+    }
+    if (gain <= 0) continue;
+
+    opt->saveOffset[f] = frameBase + temps;
+    for (i = first; i < last; i ++) {
+      if (occ[i].start < 0) continue;
+      for (k = occ[i].start; k <= occ[i].end; k ++) {
+	opt->removed[k] = 1;
+	opt->loadOffset[k] = -1;
+      }
+      opt->loadOffset[occ[i].start] = frameBase + temps;
+      COUNT(valuesReused);
+    }
+    temps ++;
+  }
+  return temps;
+}
+
+/******************* Basic blocks ******************************/
+
+int endsBlock(enum OpCode op) {
+  return (op == OP_J) || (op == OP_FJ) || (op == OP_EP) || (op == OP_EF) || (op == OP_HL);
+}
+
+void addSuccessor(Optimizer* opt, BasicBlock* block, int target, int body, int end) {
+  int b = ((target >= body) && (target < end)) ? opt->blockOf[target] : -1;
+
+  if (b < 0) return;
+  block->succ[block->succCount ++] = b;
+  opt->blocks[b].predCount ++;
+}
+
+// Splits the body [body, end) into basic blocks, the code of the tasks
+// inside it left out, and links them. Returns 0 when out of memory.
+int findBlocks(Optimizer* opt, int body, int end) {
+  BasicBlock* block;
+  Instruction* last;
+  int i, b, s, next, edges = 0;
+  int newBlock = 1;
+
+  opt->blockCount = 0;
+  for (i = body; i < end; ) {
+    if (opt->isTask[i]) {
+      // optimized as a body of its own
+      next = findBodyEnd(opt->code, opt->codeSize, opt->isTask, opt->code[i].q) + 1;
+      for (; (i < next) && (i < end); i ++)
+	opt->blockOf[i] = -1;
+      newBlock = 1;
+      continue;
+    }
+    if (newBlock || opt->isLabel[i]) {
+      if (!growArray((void**) &opt->blocks, &opt->blockCapacity, opt->blockCount + 1, sizeof(BasicBlock)))
+	return 0;
+      block = opt->blocks + opt->blockCount ++;
+      memset(block, 0, sizeof(BasicBlock));
+      block->start = i;
+    }
+    opt->blockOf[i] = opt->blockCount - 1;
+    opt->blocks[opt->blockCount - 1].end = i + 1;
+    newBlock = endsBlock(opt->code[i].op);
+    i ++;
+  }
+
+  for (b = 0; b < opt->blockCount; b ++) {
+    block = opt->blocks + b;
+    last = opt->code + block->end - 1;
+    if ((last->op == OP_J) || (last->op == OP_FJ))
+      addSuccessor(opt, block, last->q, body, end);
+    if ((last->op != OP_J) && (last->op != OP_EP) && (last->op != OP_EF) && (last->op != OP_HL))
+      addSuccessor(opt, block, block->end, body, end);
+    edges += block->succCount;
+  }
+
+  if (!growArray((void**) &opt->preds, &opt->predCapacity, edges + 1, sizeof(int)) ||
+      !growArray((void**) &opt->firstPred, &opt->firstPredCapacity, opt->blockCount + 1, sizeof(int)) ||
+      !growArray((void**) &opt->order, &opt->orderCapacity, 2 * opt->blockCount + 1, sizeof(int)))
+    return 0;
+  opt->firstPred[0] = 0;
+  for (b = 0; b < opt->blockCount; b ++) {
+    opt->firstPred[b + 1] = opt->firstPred[b] + opt->blocks[b].predCount;
+    opt->blocks[b].visit = 0;
+  }
+  for (b = 0; b < opt->blockCount; b ++)
+    for (s = 0; s < opt->blocks[b].succCount; s ++)
+      opt->preds[opt->firstPred[opt->blocks[b].succ[s]] + opt->blocks[opt->blocks[b].succ[s]].visit ++] = b;
+  return 1;
+}
+
+int intersectDominators(Optimizer* opt, int a, int b) {
+  while (a != b) {
+    while (opt->blocks[a].order > opt->blocks[b].order) a = opt->blocks[a].idom;
+    while (opt->blocks[b].order > opt->blocks[a].order) b = opt->blocks[b].idom;
+  }
+  return a;
+}
+
+// Immediate dominators of the blocks reachable from the entry (Cooper,
+// Harvey and Kennedy's iteration over the reverse postorder), then the
+// dominator tree
+void findDominators(Optimizer* opt) {
+  BasicBlock* block;
+  int* stack = opt->order + opt->blockCount;
+  int b, k, s, p, idom, top, count = 0;
+  int changed = 1;
+
+  for (b = 0; b < opt->blockCount; b ++) {
+    block = opt->blocks + b;
+    block->visit = 0;
+    block->order = -1;
+    block->idom = -1;
+    block->firstChild = block->nextSibling = -1;
+    block->mark = -1;
+  }
+
+  // postorder by an explicit depth first search, then reversed
+  top = 0;
+  stack[top ++] = 0;
+  opt->blocks[0].order = 0;
+  while (top > 0) {
+    block = opt->blocks + stack[top - 1];
+    if (block->visit < block->succCount) {
+      s = block->succ[block->visit ++];
+      if (opt->blocks[s].order < 0) {
+	opt->blocks[s].order = 0;
+	stack[top ++] = s;
+      }
+    } else
+      opt->order[count ++] = stack[-- top];
+  }
+  for (k = 0; k < count / 2; k ++) {
+    b = opt->order[k];
+    opt->order[k] = opt->order[count - 1 - k];
+    opt->order[count - 1 - k] = b;
+  }
+  for (k = 0; k < count; k ++)
+    opt->blocks[opt->order[k]].order = k;
+
+  opt->blocks[0].idom = 0;
+  while (changed) {
+    changed = 0;
+    for (k = 1; k < count; k ++) {
+      b = opt->order[k];
+      idom = -1;
+      for (p = opt->firstPred[b]; p < opt->firstPred[b + 1]; p ++) {
+	if (opt->blocks[opt->preds[p]].idom < 0) continue;
+	idom = (idom < 0) ? opt->preds[p] : intersectDominators(opt, opt->preds[p], idom);
+      }
+      if (idom != opt->blocks[b].idom) {
+	opt->blocks[b].idom = idom;
+	changed = 1;
+      }
+    }
+  }
+  opt->blocks[0].idom = -1;
+
+  for (k = count - 1; k > 0; k --) {
+    block = opt->blocks + opt->order[k];
+    block->nextSibling = opt->blocks[block->idom].firstChild;
+    opt->blocks[block->idom].firstChild = opt->order[k];
+  }
+}
+
+/******************* Dominator tree walk ******************************/
+
+// The stores of the blocks on the paths from the immediate dominator of
+// the merge block b to b: the blocks that reach b without passing through
+// its dominator
+void findMergeKills(Optimizer* opt, int b, KillSet* set) {
+  int* stack = opt->order + opt->blockCount;
+  int idom = opt->blocks[b].idom;
+  int top = 0, x, p, y;
+
+  memset(set, 0, sizeof(KillSet));
+  stack[top ++] = b;
+  while ((top > 0) && !set->all) {
+    x = stack[-- top];
+    for (p = opt->firstPred[x]; p < opt->firstPred[x + 1]; p ++) {
+      y = opt->preds[p];
+      if ((y == idom) || (opt->blocks[y].order < 0) || (opt->blocks[y].mark == b)) continue;
+      opt->blocks[y].mark = b;
+      mergeKills(set, &opt->blocks[y].kills);
+      stack[top ++] = y;
+    }
+  }
+}
+
+void saveScope(Optimizer* opt, ValueScope* scope) {
+  scope->valueCount = opt->valueCount;
+  scope->keyCount = opt->keyCount;
+  scope->liveLoadCount = opt->liveLoadCount;
+  scope->killLogCount = opt->killLogCount;
+  scope->producerLogCount = opt->producerLogCount;
+}
+
+// Forgets what the blocks numbered since saveScope added to the table
+void restoreScope(Optimizer* opt, ValueScope* scope) {
+  ValueKey* key;
+
+  while (opt->keyCount > scope->keyCount) {
+    key = opt->keys + -- opt->keyCount;
+    opt->buckets[hashKey(key->op, key->p, key->q, key->left, key->right) & opt->bucketMask] = key->next;
+  }
+  while (opt->killLogCount > scope->killLogCount)
+    opt->keys[opt->killLog[-- opt->killLogCount]].live = 1;
+  while (opt->producerLogCount > scope->producerLogCount)
+    opt->firstProducer[opt->producerLog[-- opt->producerLogCount]] = -1;
+  opt->liveLoadCount = scope->liveLoadCount;
+  opt->valueCount = scope->valueCount;
+}
+
+void numberBlock(Optimizer* opt, int b) {
+  BasicBlock* block = opt->blocks + b;
+  int i;
+
+  opt->scopeLoads = opt->liveLoadCount;
+  for (i = block->start; i < block->end; i ++) {
+    opt->segment[i] = b;
+    if (!numberInstruction(opt, i) && (i < block->end - 1)) {
+      // an instruction the numbering does not follow
+      killLoads(opt, KILL_ALL, -1);
+      opt->depth = 0;
+    }
+  }
+}
+
+StackValue popRoot(Optimizer* opt) {
+  StackValue entry;
+
+  if (opt->depth > 0)
+    return opt->stack[-- opt->depth];
+  entry.value = entry.start = entry.end = -1;
+  return entry;
+}
+
+// The stores of block b: the variables and arrays their addresses are
+// based on, found as rootOf does but following only the LAs on the stack
+// (value: the LA, -1 if unknown), so that the block is not numbered twice
+void scanKills(Optimizer* opt, int b) {
+  BasicBlock* block = opt->blocks + b;
+  Instruction* inst;
+  StackValue x, y;
+  int i, n;
+
+  opt->depth = 0;
+  for (i = block->start; (i < block->end) && !block->kills.all; i ++) {
+    inst = opt->code + i;
+    switch (inst->op) {
+    case OP_LA:
+      push(opt, i, i, i);
+      break;
+    case OP_CV:
+      x = popRoot(opt);
+      push(opt, x.value, i, i);
+      push(opt, x.value, i, i);
+      break;
+    case OP_AD:
+    case OP_SB:
+      y = popRoot(opt);
+      x = popRoot(opt);
+      if ((inst->op == OP_AD) && (x.value >= 0) && (y.value >= 0))
+	x.value = -1;
+      else if ((inst->op == OP_AD) && (x.value < 0))
+	x.value = y.value;
+      push(opt, x.value, i, i);
+      break;
+    case OP_ST:
+      popRoot(opt);
+      x = popRoot(opt);
+      addKill(&block->kills, x.value < 0, (x.value >= 0) ? opt->code[x.value].p : 0,
+	      (x.value >= 0) ? opt->code[x.value].q : 0);
+      break;
+    case OP_CALL:
+    case OP_PFOR:
+    case OP_INB:
+    case OP_CPK:
+    case OP_CPY:
+    case OP_CPS:
+    case OP_STB:
+    case OP_VFIL:
+    case OP_VCPY:
+    case OP_VADD:
+    case OP_VSUM:
+    case OP_SV:
+      block->kills.all = 1;
+      break;
+    case OP_INT:
+      if (inst->q > MAX_TRACKED_PUSH) {
+	opt->depth = 0;
+	break;
+      }
+      // fall through
+    default:
+      // no CALL here: stackPushes needs no compactor
+      for (n = stackPops(inst); n > 0; n --)
+	popRoot(opt);
+      for (n = stackPushes(NULL, inst); n > 0; n --)
+	push(opt, -1, i, i);
+      break;
+    }
+  }
+}
+
+// Numbers block b, a child of parent (-1 for a root), and pushes its scope
+int openScope(Optimizer* opt, int b, int parent) {
+  BasicBlock* block = opt->blocks + b;
+  ValueScope* scope;
+  ValueScope* up;
+  KillSet kills;
+
+  if (!growArray((void**) &opt->scopes, &opt->scopeCapacity, opt->scopeCount + 1, sizeof(ValueScope)))
+    return 0;
+  scope = opt->scopes + opt->scopeCount ++;
+  saveScope(opt, scope);
+  scope->block = b;
+  scope->child = block->firstChild;
+
+  opt->depth = 0;
+  if ((parent >= 0) && (block->predCount == 1)) {
+    // only reached from its dominator: the stack goes on
+    up = scope - 1;
+    if (!growArray((void**) &opt->stack, &opt->stackCapacity, up->depth, sizeof(StackValue)))
+      return 0;
+    memcpy(opt->stack, opt->savedStack + up->stackBase, up->depth * sizeof(StackValue));
+    opt->depth = up->depth;
+  } else if (parent >= 0) {
+    findMergeKills(opt, b, &kills);
+    opt->scopeLoads = opt->liveLoadCount;
+    forgetLoads(opt, KILL_STORED, -1, &kills);
+  }
+  numberBlock(opt, b);
+
+  if (!growArray((void**) &opt->savedStack, &opt->savedCapacity, opt->savedCount + opt->depth, sizeof(StackValue)))
+    return 0;
+  memcpy(opt->savedStack + opt->savedCount, opt->stack, opt->depth * sizeof(StackValue));
+  scope->stackBase = opt->savedCount;
+  scope->depth = opt->depth;
+  opt->savedCount += opt->depth;
+  return 1;
+}
+
+// Numbers the blocks of the dominator tree rooted at root, each in the
+// scope of the blocks that dominate it
+int numberTree(Optimizer* opt, int root) {
+  ValueScope* scope;
+  int b;
+
+  if (!openScope(opt, root, -1)) return 0;
+  while (opt->scopeCount > 0) {
+    scope = opt->scopes + opt->scopeCount - 1;
+    b = scope->child;
+    if (b < 0) {
+      restoreScope(opt, scope);
+      opt->savedCount = scope->stackBase;
+      opt->scopeCount --;
+    } else {
+      scope->child = opt->blocks[b].nextSibling;
+      if (!openScope(opt, b, scope->block)) return 0;
+    }
+  }
+  return 1;
+}
+
+// The body of a subprogram runs from the INT that makes its frame to its
+// EP, EF or HL. The frame grows by the words its replacements need.
+// Entries of the PARALLEL FOR tasks: the targets of PFOR
+void markTasks(Instruction* code, int codeSize, char* isTask) {
+  int i;
+
+  for (i = 0; i < codeSize; i ++)
+    if ((code[i].op == OP_PFOR) && (code[i].q >= 0) && (code[i].q < codeSize))
+      isTask[code[i].q] = 1;
+}
+
+// The EP/EF/HL that ends the body starting at body, the code of the tasks
+// inside it left out; codeSize if there is none
+int findBodyEnd(Instruction* code, int codeSize, char* isTask, int body) {
+  int i;
+
+  for (i = body; i < codeSize; i ++) {
+    if (isTask[i] && (code[i].op == OP_J) && (code[i].q > i)) {
+      i = findBodyEnd(code, codeSize, isTask, code[i].q);
+      if (i == codeSize) break;
+    } else if ((code[i].op == OP_EP) || (code[i].op == OP_EF) || (code[i].op == OP_HL))
+      return i;
+  }
+  return codeSize;
+}
+
+void optimizeBody(Optimizer* opt, int body) {
+  int bucketCount = 16;
+  int end, b;
+
+  end = findBodyEnd(opt->code, opt->codeSize, opt->isTask, body);
+  if (end == opt->codeSize) return;
+  end ++;
+  if (!findBlocks(opt, body, end)) return;
+  findDominators(opt);
+
+  while (bucketCount < 2 * (end - body)) bucketCount *= 2;
+  if (bucketCount > opt->bucketCount) {
+    free(opt->buckets);
+    opt->buckets = (int*) malloc(bucketCount * sizeof(int));
+    if (opt->buckets == NULL) {
+      opt->bucketCount = 0;
+      return;
+    }
+    opt->bucketCount = bucketCount;
+  }
+  opt->bucketMask = bucketCount - 1;
+  memset(opt->buckets, -1, bucketCount * sizeof(int));
+  opt->valueCount = 0;
+  opt->keyCount = 0;
+  opt->liveLoadCount = 0;
+  opt->killLogCount = 0;
+  opt->producerLogCount = 0;
+  opt->scopeCount = 0;
+  opt->savedCount = 0;
+  opt->occurrenceCount = 0;
+
+  for (b = 0; b < opt->blockCount; b ++)
+    scanKills(opt, b);
+
+  // the unreachable blocks are roots of their own
+  if (!numberTree(opt, 0)) return;
+  for (b = 1; b < opt->blockCount; b ++)
+    if ((opt->blocks[b].order < 0) && !numberTree(opt, b)) return;
+  opt->code[body].q += chooseReplacements(opt, opt->code[body].q);
+}
+
+/******************* Rewriting ******************************/
+
+// Builds the new code and moves jump targets, calls, subprogram symbols
+// and the entry point to the new addresses
+void rewriteCode(Optimizer* opt) {
+  CodeBlock* codeBlock = compiler->codeBlock;
+  Instruction* code;
+  int* newAddress;
+  int i, size = 0;
+
+  for (i = 0; i < opt->codeSize; i ++)
+    size += opt->removed[i] ? (opt->loadOffset[i] >= 0) : 1 + (opt->saveOffset[i] >= 0);
+  newAddress = (int*) malloc((opt->codeSize + 1) * sizeof(int));
+  code = (Instruction*) malloc((size + 1) * sizeof(Instruction));
+  size = 0;
+  if ((newAddress == NULL) || (code == NULL)) {
+    free(newAddress);
+    free(code);
+    return;
+  }
+
+  for (i = 0; i < opt->codeSize; i ++) {
+    newAddress[i] = size;
+    if (opt->removed[i]) {
+      if (opt->loadOffset[i] >= 0) {
+	code[size].op = OP_LV;
+	code[size].p = 0;
+	code[size].q = opt->loadOffset[i];
+	size ++;
+      }
+      continue;
+    }
+    code[size ++] = opt->code[i];
+    if (opt->saveOffset[i] >= 0) {
+      code[size].op = OP_SV;
+      code[size].p = 0;
+      code[size].q = opt->saveOffset[i];
+      size ++;
+    }
+  }
+  newAddress[opt->codeSize] = size;
+
+  for (i = 0; i < size; i ++)
+    if (((code[i].op == OP_J) || (code[i].op == OP_FJ) || (code[i].op == OP_CALL) || (code[i].op == OP_PFOR)) &&
+	(code[i].q >= 0) && (code[i].q <= opt->codeSize))
+      code[i].q = newAddress[code[i].q];
+  for (i = 0; i < compiler->symbolCount; i ++)
+    if (compiler->symbols[i].address <= (unsigned int) opt->codeSize)
+      compiler->symbols[i].address = newAddress[compiler->symbols[i].address];
+  if ((compiler->entryPoint >= 0) && (compiler->entryPoint <= opt->codeSize))
+    compiler->entryPoint = newAddress[compiler->entryPoint];
+
+  if (growCodeBlock(codeBlock, size)) {
+    memcpy(codeBlock->code, code, size * sizeof(Instruction));
+    codeBlock->codeSize = size;
+  }
+  free(newAddress);
+  free(code);
+}
+
+void freeOptimizer(Optimizer* opt) {
+  free(opt->isLabel);
+  free(opt->isTask);
+  free(opt->saveOffset);
+  free(opt->loadOffset);
+  free(opt->segment);
+  free(opt->removed);
+  free(opt->firstProducer);
+  free(opt->valueKey);
+  free(opt->keys);
+  free(opt->buckets);
+  free(opt->liveLoads);
+  free(opt->stack);
+  free(opt->occurrences);
+  free(opt->blockOf);
+  free(opt->blocks);
+  free(opt->preds);
+  free(opt->firstPred);
+  free(opt->order);
+  free(opt->killLog);
+  free(opt->producerLog);
+  free(opt->scopes);
+  free(opt->savedStack);
+}
+
+void optimizeCode(void) {
+  Optimizer opt;
+  Instruction* code = compiler->codeBlock->code;
+  int n = compiler->codeBlock->codeSize;
+  int i, entry, body;
+
+  if (n == 0) return;
+  memset(&opt, 0, sizeof(Optimizer));
+  opt.code = code;
+  opt.codeSize = n;
+  opt.isLabel = (char*) calloc(n + 1, 1);
+  opt.isTask = (char*) calloc(n + 1, 1);
+  opt.removed = (char*) calloc(n, 1);
+  opt.saveOffset = (int*) malloc(n * sizeof(int));
+  opt.loadOffset = (int*) malloc(n * sizeof(int));
+  opt.segment = (int*) malloc(n * sizeof(int));
+  opt.blockOf = (int*) malloc(n * sizeof(int));
+  if ((opt.isLabel == NULL) || (opt.isTask == NULL) || (opt.removed == NULL) ||
+      (opt.saveOffset == NULL) || (opt.loadOffset == NULL) || (opt.segment == NULL) ||
+      (opt.blockOf == NULL)) {
+    freeOptimizer(&opt);
+    return;
+  }
+  for (i = 0; i < n; i ++)
+    opt.saveOffset[i] = opt.loadOffset[i] = -1;
+
+  for (i = 0; i < n; i ++)
+    if (((code[i].op == OP_J) || (code[i].op == OP_FJ) || (code[i].op == OP_CALL) || (code[i].op == OP_PFOR)) &&
+	(code[i].q >= 0) && (code[i].q <= n))
+      opt.isLabel[code[i].q] = 1;
+  markTasks(code, n, opt.isTask);
+
+  // every subprogram starts with a J over its nested subprograms to its body
+  for (i = 0; i < compiler->symbolCount; i ++) {
+    entry = compiler->symbols[i].address;
+    if ((entry < 0) || (entry >= n) || (code[entry].op != OP_J)) continue;
+    body = code[entry].q;
+    if ((body >= 0) && (body < n) && (code[body].op == OP_INT))
+      optimizeBody(&opt, body);
+  }
+
+  rewriteCode(&opt);
+  freeOptimizer(&opt);
+  compactFrames();
+}
@@ -0,0 +1,145 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __OPTIMIZE_H__
+#define __OPTIMIZE_H__
+
+#include "instructions.h"
+
+// Operands pushed by an instruction that can be followed on the simulated
+// stack; a larger INT forgets the stack instead
+#define MAX_TRACKED_PUSH 8
+
+// Key of a value number: an opcode with its p/q operands or with the value
+// numbers of its operands (left, right)
+struct ValueKey_ {
+  enum OpCode op;
+  WORD p, q;
+  int left, right;
+  int value;          // value number of the expression
+  int load;           // the value was read from memory: stores may kill it
+  int root;           // for an indirect load: value of the LA its address is based on, -1 if unknown
+  int live;
+  int next;           // hash chain
+};
+
+typedef struct ValueKey_ ValueKey;
+
+// Entry of the simulated stack: a value and the instructions [start, end]
+// that computed it, start being -1 when they can not be removed
+struct StackValue_ {
+  int value;
+  int start, end;
+};
+
+typedef struct StackValue_ StackValue;
+
+// A later computation of a value that is already known
+struct Occurrence_ {
+  int producer;       // the computation it repeats, which dominates it
+  int start, end;
+  int valueLength;    // longest occurrence of the value: outer expressions go first
+};
+
+typedef struct Occurrence_ Occurrence;
+
+// Variables and arrays that the stores of some blocks write (the p/q of
+// their LA). Past MAX_KILLED_ROOTS of them, or with a call, a block copy or
+// a store through an address of unknown base, all is set.
+#define MAX_KILLED_ROOTS 16
+
+struct KillSet_ {
+  int all;
+  int count;
+  WORD p[MAX_KILLED_ROOTS], q[MAX_KILLED_ROOTS];
+};
+
+typedef struct KillSet_ KillSet;
+
+// A basic block of the body being numbered
+struct BasicBlock_ {
+  int start, end;               // instructions [start, end)
+  int succ[2], succCount;
+  int predCount;                // several: paths merge at its start
+  int visit;                    // successors already visited by the depth first search
+  int order;                    // position in reverse postorder, -1 if unreachable
+  int idom;                     // immediate dominator, -1 for the entry and the unreachable blocks
+  int firstChild, nextSibling;  // dominator tree
+  int mark;                     // last merge block whose paths were searched through it
+  KillSet kills;                // stores of the block itself
+};
+
+typedef struct BasicBlock_ BasicBlock;
+
+// A block of the dominator tree walk, with what the table held before it
+struct ValueScope_ {
+  int block;
+  int child;                    // next child to visit, -1 when done
+  int valueCount, keyCount, liveLoadCount, killLogCount, producerLogCount;
+  int stackBase, depth;         // its stack at its end, kept in savedStack for its children
+};
+
+typedef struct ValueScope_ ValueScope;
+
+struct Optimizer_ {
+  Instruction* code;
+  int codeSize;
+  char* isLabel;          // jump or call target: a block starts there
+  char* isTask;           // entry of a PARALLEL FOR task, whose code is inside another body
+
+  // per instruction of the code
+  int* saveOffset;        // frame word the value is saved into (SV) after it, -1 if none
+  int* loadOffset;        // on the first removed instruction: frame word loaded (LV) instead
+  int* segment;           // basic block of the instruction
+  char* removed;
+
+  // basic blocks and dominator tree of the current body
+  int* blockOf;           // block of each instruction of the body, -1 in the code of its tasks
+  BasicBlock* blocks;
+  int blockCount, blockCapacity;
+  int* preds;             // predecessors of block b from preds[firstPred[b]]
+  int* firstPred;
+  int predCapacity, firstPredCapacity;
+  int* order;             // blocks in reverse postorder, then a stack for the searches
+  int orderCapacity;
+
+  // value numbers along the path of the dominator tree being walked
+  int* firstProducer;     // instruction that computed the value first, -1 for unknown values
+  int* valueKey;          // key that defines the value, -1 for unknown values
+  int valueCount, valueCapacity;
+
+  ValueKey* keys;
+  int keyCount, keyCapacity;
+  int* buckets;
+  int bucketCount;        // allocated; the current block uses bucketMask + 1 of them
+  int bucketMask;
+  int* liveLoads;         // keys of loads that a store may kill; dead ones are left below scopeLoads
+  int liveLoadCount;
+  int scopeLoads;         // liveLoads of the enclosing blocks
+  int* killLog;           // keys of the enclosing blocks killed, live again when the walk leaves
+  int killLogCount, killLogCapacity;
+  int* producerLog;       // values of the enclosing blocks given a firstProducer
+  int producerLogCount, producerLogCapacity;
+
+  ValueScope* scopes;
+  int scopeCount, scopeCapacity;
+  StackValue* savedStack;
+  int savedCount, savedCapacity;
+
+  StackValue* stack;
+  int depth, stackCapacity;
+
+  Occurrence* occurrences;
+  int occurrenceCount, occurrenceCapacity;
+};
+
+typedef struct Optimizer_ Optimizer;
+
+void markTasks(Instruction* code, int codeSize, char* isTask);
+int findBodyEnd(Instruction* code, int codeSize, char* isTask, int body);
+void optimizeCode(void);
+
+#endif
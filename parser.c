@@ -4,6 +4,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "reader.h"
 #include "scanner.h"
@@ -12,32 +13,73 @@
 #include "error.h"
 #include "debug.h"
 #include "codegen.h"
+#include "compiler.h"
+#include "optimize.h"
 
-// --- KHAI BÁO BIẾN TOÀN CỤC ---
-// currentToken: Giữ token hiện tại đang được xử lý.
-Token *currentToken; 
-// lookAhead: Giữ token "nhìn trước" (tiếp theo). Trình dịch sẽ kiểm tra token này để quyết định luồng xử lý.
-Token *lookAhead;
-
-// Các biến ngoại lai (extern) được định nghĩa ở các file khác (symtab.c)
-extern Type* intType;    // Kiểu số nguyên chuẩn
-extern Type* charType;   // Kiểu ký tự chuẩn
-extern SymTab* symtab;   // Bảng ký hiệu toàn cục
+// --- TRẠNG THÁI CỦA TRÌNH DỊCH ---
+// Mọi trạng thái nằm trong Compiler của luồng hiện tại (compiler.h):
+// compiler->currentToken: token hiện tại đang được xử lý.
+// compiler->lookAhead: token "nhìn trước" (tiếp theo), dùng để quyết định luồng xử lý.
+// compiler->symtab, compiler->intType, compiler->charType: bảng ký hiệu và các kiểu chuẩn.
 
 // --- HÀM SCAN ---
 // Chức năng: Đọc token tiếp theo từ nguồn vào biến lookAhead
 void scan(void) {
   // Lưu địa chỉ của token cũ để giải phóng bộ nhớ sau này
-  Token* tmp = currentToken;
+  Token* tmp = compiler->currentToken;
   
   // Cập nhật token hiện tại bằng token nhìn trước
-  currentToken = lookAhead;
-  
-  // Gọi Scanner để lấy token hợp lệ tiếp theo (bỏ qua khoảng trắng, comment...)
-  lookAhead = getValidToken();
+  compiler->currentToken = compiler->lookAhead;
+  compiler->lookAhead = NULL; // getValidToken có thể báo lỗi, khi đó compile() giải phóng các token
   
   // Giải phóng vùng nhớ của token cũ đã xử lý xong để tránh rò rỉ bộ nhớ
   free(tmp);
+
+  // Gọi Scanner để lấy token hợp lệ tiếp theo (bỏ qua khoảng trắng, comment...)
+  compiler->lookAhead = getValidToken();
+}
+
+// --- PHỤC HỒI LỖI (panic mode) ---
+// Các tập token đồng bộ, kết thúc bởi TK_NONE. Lỗi bên trong biểu thức được
+// phát hiện nhờ các tập FOLLOW trong compileExpression3/compileTerm2/
+// compileArguments; sau đó trình dịch bỏ qua token đến ranh giới câu lệnh
+// hoặc khai báo gần nhất.
+TokenType statementFollow[] = { SB_SEMICOLON, KW_END, SB_PERIOD, TK_NONE };
+TokenType declFollow[] = { SB_SEMICOLON, KW_CONST, KW_TYPE, KW_VAR, KW_FUNCTION, KW_PROCEDURE, KW_BEGIN, TK_NONE };
+TokenType subDeclFollow[] = { KW_FUNCTION, KW_PROCEDURE, KW_BEGIN, TK_NONE };
+
+int inTokenSet(TokenType tokenType, TokenType* set) {
+  while (*set != TK_NONE)
+    if (*(set ++) == tokenType) return 1;
+  return 0;
+}
+
+// Bỏ qua các token cho đến một token thuộc tập follow (hoặc hết file)
+void synchronize(TokenType* follow) {
+  while ((compiler->lookAhead->tokenType != TK_EOF) && !inTokenSet(compiler->lookAhead->tokenType, follow))
+    scan();
+}
+
+// Gọi compileFn; nếu gặp lỗi thì lỗi đã được ghi lại (error.c), ta khôi phục
+// phạm vi hiện tại, đồng bộ lại trên tập follow rồi tiếp tục phân tích.
+// Một khai báo lỗi kết thúc bằng ; sẽ được bỏ luôn dấu ; đó.
+void compileWithRecovery(void (*compileFn)(void), TokenType* follow) {
+  jmp_buf here;
+  jmp_buf* outer = compiler->recoverJump;
+  Scope* scope = compiler->symtab->currentScope;
+  Scope* parallelScope = compiler->parallelScope;
+
+  compiler->recoverJump = &here;
+  if (setjmp(here) == 0)
+    compileFn();
+  else {
+    compiler->symtab->currentScope = scope;
+    compiler->parallelScope = parallelScope;
+    synchronize(follow);
+    if ((follow == declFollow) && (compiler->lookAhead->tokenType == SB_SEMICOLON))
+      scan();
+  }
+  compiler->recoverJump = outer;
 }
 
 // --- HÀM EAT ---
@@ -45,12 +87,12 @@ void scan(void) {
 // Tham số: tokenType - Loại token mong đợi (ví dụ: KW_PROGRAM, SB_SEMICOLON...)
 void eat(TokenType tokenType) {
   // Kiểm tra nếu loại token nhìn trước khớp với loại mong đợi
-  if (lookAhead->tokenType == tokenType) {
+  if (compiler->lookAhead->tokenType == tokenType) {
     // Nếu đúng, gọi scan() để tiến tới token kế tiếp
     scan();
   } else {
     // Nếu sai, báo lỗi "Thiếu token" tại dòng và cột tương ứng
-    missingToken(tokenType, lookAhead->lineNo, lookAhead->colNo);
+    missingToken(tokenType, compiler->lookAhead->lineNo, compiler->lookAhead->colNo);
   }
 }
 
@@ -64,9 +106,11 @@ void compileProgram(void) {
   eat(TK_IDENT);   // 2. Kiểm tra tên định danh chương trình
 
   // Tạo đối tượng chương trình và đưa vào bảng ký hiệu
-  program = createProgramObject(currentToken->string);
+  program = createProgramObject(compiler->currentToken->string);
   // Lưu địa chỉ bắt đầu mã lệnh của chương trình (thường là 0)
   program->progAttrs->codeAddress = getCurrentCodeAddress();
+  setEntryPoint(program->progAttrs->codeAddress);
+  genSymbol(program, program->progAttrs->codeAddress);
   
   // Vào một phạm vi (scope) mới cho chương trình
   enterBlock(program->progAttrs->scope);
@@ -85,95 +129,107 @@ void compileProgram(void) {
 // Chức năng: Biên dịch phần khai báo hằng số
 // Ngữ pháp: CONST <Tên> = <Giá trị>; ...
 void compileConstDecls(void) {
-  Object* constObj;
-  ConstantValue* constValue;
-
   // Nếu token tiếp theo là từ khóa CONST thì mới xử lý
-  if (lookAhead->tokenType == KW_CONST) {
+  if (compiler->lookAhead->tokenType == KW_CONST) {
     eat(KW_CONST);
     // Vòng lặp xử lý nhiều khai báo hằng liên tiếp (ví dụ: a=1; b=2;)
     do {
-      eat(TK_IDENT); // Tên hằng
-      
-      // Kiểm tra xem tên này đã được dùng chưa trong scope hiện tại
-      checkFreshIdent(currentToken->string);
-      
-      // Tạo đối tượng hằng mới
-      constObj = createConstantObject(currentToken->string);
-      // Khai báo nó vào bảng ký hiệu
-      declareObject(constObj);
-      
-      eat(SB_EQ); // Dấu bằng =
-      
-      // Phân tích giá trị của hằng (số hoặc ký tự)
-      constValue = compileConstant();
-      constObj->constAttrs->value = constValue;
-      
-      eat(SB_SEMICOLON); // Dấu chấm phẩy ;
-    } while (lookAhead->tokenType == TK_IDENT); // Lặp lại nếu còn gặp tên định danh
+      compileWithRecovery(compileConstDecl, declFollow);
+    } while (compiler->lookAhead->tokenType == TK_IDENT); // Lặp lại nếu còn gặp tên định danh
   }
 }
 
+void compileConstDecl(void) {
+  Object* constObj;
+  ConstantValue* constValue;
+
+  eat(TK_IDENT); // Tên hằng
+
+  // Kiểm tra xem tên này đã được dùng chưa trong scope hiện tại
+  checkFreshIdent(compiler->currentToken->string);
+
+  // Tạo đối tượng hằng mới
+  constObj = createConstantObject(compiler->currentToken->string);
+
+  eat(SB_EQ); // Dấu bằng =
+
+  // Phân tích giá trị của hằng (số hoặc ký tự)
+  constValue = compileConstant();
+  constObj->constAttrs->value = constValue;
+  // Chỉ khai báo khi đã có giá trị, để một khai báo lỗi không để lại hằng rỗng
+  declareObject(constObj);
+
+  eat(SB_SEMICOLON); // Dấu chấm phẩy ;
+}
+
 // --- HÀM COMPILE TYPE DECLS ---
 // Chức năng: Biên dịch phần khai báo kiểu dữ liệu
 // Ngữ pháp: TYPE <Tên> = <Kiểu>; ...
 void compileTypeDecls(void) {
-  Object* typeObj;
-  Type* actualType;
-
-  if (lookAhead->tokenType == KW_TYPE) {
+  if (compiler->lookAhead->tokenType == KW_TYPE) {
     eat(KW_TYPE);
     do {
-      eat(TK_IDENT); // Tên kiểu mới
-      
-      checkFreshIdent(currentToken->string);
-      typeObj = createTypeObject(currentToken->string);
-      declareObject(typeObj);
-      
-      eat(SB_EQ); // Dấu bằng =
-      
-      // Phân tích kiểu dữ liệu thực sự (ví dụ: ARRAY OF INTEGER)
-      actualType = compileType();
-      typeObj->typeAttrs->actualType = actualType;
-      
-      eat(SB_SEMICOLON); // Dấu chấm phẩy ;
-    } while (lookAhead->tokenType == TK_IDENT);
+      compileWithRecovery(compileTypeDecl, declFollow);
+    } while (compiler->lookAhead->tokenType == TK_IDENT);
   } 
 }
 
+void compileTypeDecl(void) {
+  Object* typeObj;
+  Type* actualType;
+
+  eat(TK_IDENT); // Tên kiểu mới
+
+  checkFreshIdent(compiler->currentToken->string);
+  typeObj = createTypeObject(compiler->currentToken->string);
+
+  eat(SB_EQ); // Dấu bằng =
+
+  // Phân tích kiểu dữ liệu thực sự (ví dụ: ARRAY OF INTEGER)
+  actualType = compileType();
+  typeObj->typeAttrs->actualType = actualType;
+  declareObject(typeObj);
+
+  eat(SB_SEMICOLON); // Dấu chấm phẩy ;
+}
+
 // --- HÀM COMPILE VAR DECLS ---
 // Chức năng: Biên dịch phần khai báo biến
 // Ngữ pháp: VAR <Tên> : <Kiểu>; ...
 void compileVarDecls(void) {
-  Object* varObj;
-  Type* varType;
-
-  if (lookAhead->tokenType == KW_VAR) {
+  if (compiler->lookAhead->tokenType == KW_VAR) {
     eat(KW_VAR);
     do {
-      eat(TK_IDENT); // Tên biến
-      
-      checkFreshIdent(currentToken->string);
-      varObj = createVariableObject(currentToken->string);
-      
-      eat(SB_COLON); // Dấu hai chấm :
-      
-      // Xác định kiểu của biến
-      varType = compileType();
-      varObj->varAttrs->type = varType;
-      
-      // Đưa biến vào bảng ký hiệu (cấp phát offset trên stack)
-      declareObject(varObj);      
-      
-      eat(SB_SEMICOLON); // Dấu chấm phẩy ;
-    } while (lookAhead->tokenType == TK_IDENT);
+      compileWithRecovery(compileVarDecl, declFollow);
+    } while (compiler->lookAhead->tokenType == TK_IDENT);
   } 
 }
 
+void compileVarDecl(void) {
+  Object* varObj;
+  Type* varType;
+
+  eat(TK_IDENT); // Tên biến
+
+  checkFreshIdent(compiler->currentToken->string);
+  varObj = createVariableObject(compiler->currentToken->string);
+
+  eat(SB_COLON); // Dấu hai chấm :
+
+  // Xác định kiểu của biến
+  varType = compileType();
+  varObj->varAttrs->type = varType;
+
+  // Đưa biến vào bảng ký hiệu (cấp phát offset trên stack)
+  declareObject(varObj);
+
+  eat(SB_SEMICOLON); // Dấu chấm phẩy ;
+}
+
 // --- HÀM COMPILE BLOCK ---
 // Chức năng: Biên dịch một khối (Block) gồm khai báo và thân lệnh
 void compileBlock(void) {
-  Instruction* jmp;
+  CodeAddress jmp;
   
   // Sinh lệnh nhảy (Jump) giả định.
   // Lý do: Khi chương trình chạy, nó cần nhảy qua vùng chứa mã khai báo hàm/thủ tục con
@@ -192,7 +248,8 @@ void compileBlock(void) {
   
   // Sinh lệnh INT (Increment Stack Pointer) để dành chỗ cho các biến cục bộ trên stack.
   // frameSize là tổng kích thước các biến đã khai báo.
-  genINT(symtab->currentScope->frameSize);
+  genINT(compiler->symtab->currentScope->frameSize);
+  genPackedInits(compiler->symtab->currentScope); // Khởi tạo các biến STRING/BYTES
 
   // Bắt đầu phần thân
   eat(KW_BEGIN);
@@ -204,10 +261,10 @@ void compileBlock(void) {
 // Chức năng: Biên dịch các hàm và thủ tục con
 void compileSubDecls(void) {
   // Lặp lại nếu gặp từ khóa FUNCTION hoặc PROCEDURE
-  while ((lookAhead->tokenType == KW_FUNCTION) || (lookAhead->tokenType == KW_PROCEDURE)) {
-    if (lookAhead->tokenType == KW_FUNCTION)
-      compileFuncDecl();
-    else compileProcDecl();
+  while ((compiler->lookAhead->tokenType == KW_FUNCTION) || (compiler->lookAhead->tokenType == KW_PROCEDURE)) {
+    if (compiler->lookAhead->tokenType == KW_FUNCTION)
+      compileWithRecovery(compileFuncDecl, subDeclFollow);
+    else compileWithRecovery(compileProcDecl, subDeclFollow);
   }
 }
 
@@ -220,11 +277,12 @@ void compileFuncDecl(void) {
   eat(KW_FUNCTION);
   eat(TK_IDENT); // Tên hàm
 
-  checkFreshIdent(currentToken->string);
-  funcObj = createFunctionObject(currentToken->string);
+  checkFreshIdent(compiler->currentToken->string);
+  funcObj = createFunctionObject(compiler->currentToken->string);
   // Lưu địa chỉ bắt đầu mã của hàm
   funcObj->funcAttrs->codeAddress = getCurrentCodeAddress();
   declareObject(funcObj);
+  genSymbol(funcObj, funcObj->funcAttrs->codeAddress); // Ghi tên hàm cho bảng SYMBOLS
 
   enterBlock(funcObj->funcAttrs->scope); // Vào scope mới của hàm
   
@@ -252,10 +310,11 @@ void compileProcDecl(void) {
   eat(KW_PROCEDURE);
   eat(TK_IDENT);
 
-  checkFreshIdent(currentToken->string);
-  procObj = createProcedureObject(currentToken->string);
+  checkFreshIdent(compiler->currentToken->string);
+  procObj = createProcedureObject(compiler->currentToken->string);
   procObj->procAttrs->codeAddress = getCurrentCodeAddress();
   declareObject(procObj);
+  genSymbol(procObj, procObj->procAttrs->codeAddress);
 
   enterBlock(procObj->procAttrs->scope);
 
@@ -276,22 +335,22 @@ ConstantValue* compileUnsignedConstant(void) {
   ConstantValue* constValue;
   Object* obj;
 
-  switch (lookAhead->tokenType) {
+  switch (compiler->lookAhead->tokenType) {
   case TK_NUMBER: // Là số nguyên
     eat(TK_NUMBER);
-    constValue = makeIntConstant(currentToken->value);
+    constValue = makeIntConstant(compiler->currentToken->value);
     break;
   case TK_IDENT: // Là tên một hằng khác
     eat(TK_IDENT);
-    obj = checkDeclaredConstant(currentToken->string); // Kiểm tra xem đã khai báo chưa
+    obj = checkDeclaredConstant(compiler->currentToken->string); // Kiểm tra xem đã khai báo chưa
     constValue = duplicateConstantValue(obj->constAttrs->value); // Copy giá trị
     break;
   case TK_CHAR: // Là ký tự
     eat(TK_CHAR);
-    constValue = makeCharConstant(currentToken->string[0]);
+    constValue = makeCharConstant(compiler->currentToken->string[0]);
     break;
   default:
-    error(ERR_INVALID_CONSTANT, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_CONSTANT, compiler->lookAhead->lineNo, compiler->lookAhead->colNo);
     break;
   }
   return constValue;
@@ -302,7 +361,7 @@ ConstantValue* compileUnsignedConstant(void) {
 ConstantValue* compileConstant(void) {
   ConstantValue* constValue;
 
-  switch (lookAhead->tokenType) {
+  switch (compiler->lookAhead->tokenType) {
   case SB_PLUS:
     eat(SB_PLUS);
     constValue = compileConstant2();
@@ -314,7 +373,7 @@ ConstantValue* compileConstant(void) {
     break;
   case TK_CHAR:
     eat(TK_CHAR);
-    constValue = makeCharConstant(currentToken->string[0]);
+    constValue = makeCharConstant(compiler->currentToken->string[0]);
     break;
   default:
     constValue = compileConstant2();
@@ -327,21 +386,21 @@ ConstantValue* compileConstant2(void) {
   ConstantValue* constValue;
   Object* obj;
 
-  switch (lookAhead->tokenType) {
+  switch (compiler->lookAhead->tokenType) {
   case TK_NUMBER:
     eat(TK_NUMBER);
-    constValue = makeIntConstant(currentToken->value);
+    constValue = makeIntConstant(compiler->currentToken->value);
     break;
   case TK_IDENT:
     eat(TK_IDENT);
-    obj = checkDeclaredConstant(currentToken->string);
+    obj = checkDeclaredConstant(compiler->currentToken->string);
     if (obj->constAttrs->value->type == TP_INT)
       constValue = duplicateConstantValue(obj->constAttrs->value);
     else
-      error(ERR_UNDECLARED_INT_CONSTANT,currentToken->lineNo, currentToken->colNo);
+      error(ERR_UNDECLARED_INT_CONSTANT,compiler->currentToken->lineNo, compiler->currentToken->colNo);
     break;
   default:
-    error(ERR_INVALID_CONSTANT, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_CONSTANT, compiler->lookAhead->lineNo, compiler->lookAhead->colNo);
     break;
   }
   return constValue;
@@ -355,7 +414,7 @@ Type* compileType(void) {
   int arraySize;
   Object* obj;
 
-  switch (lookAhead->tokenType) {
+  switch (compiler->lookAhead->tokenType) {
   case KW_INTEGER: 
     eat(KW_INTEGER);
     type =  makeIntType();
@@ -369,29 +428,58 @@ Type* compileType(void) {
     eat(SB_LSEL);
     eat(TK_NUMBER);
 
-    arraySize = currentToken->value; // Lấy kích thước mảng
+    arraySize = compiler->currentToken->value; // Lấy kích thước mảng
 
     eat(SB_RSEL);
     eat(KW_OF);
     elementType = compileType(); // Kiểu phần tử mảng
+    if (elementType->typeClass == TP_PACKED) // Phần tử mảng không được là STRING/BYTES
+      error(ERR_INVALID_TYPE, compiler->currentToken->lineNo, compiler->currentToken->colNo);
     type = makeArrayType(arraySize, elementType);
     break;
+  case KW_STRING:
+  case KW_BYTES:
+    type = compilePackedType(0);
+    break;
   case TK_IDENT: // Kiểu định nghĩa trước (TYPE A = ...)
     eat(TK_IDENT);
-    obj = checkDeclaredType(currentToken->string);
-    type = duplicateType(obj->typeAttrs->actualType);
+    obj = checkDeclaredType(compiler->currentToken->string);
+    type = obj->typeAttrs->actualType;
     break;
   default:
-    error(ERR_INVALID_TYPE, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_TYPE, compiler->lookAhead->lineNo, compiler->lookAhead->colNo);
     break;
   }
   return type;
 }
 
+// --- HÀM COMPILE PACKED TYPE ---
+// Chức năng: STRING(. n .) hoặc BYTES(. n .): bộ đệm n byte (4 byte mỗi WORD) có độ dài.
+// Tham số VAR/CONST (allowOpen) có thể bỏ kích thước để nhận bộ đệm bất kỳ.
+Type* compilePackedType(int allowOpen) {
+  Type* elementType;
+  int capacity = OPEN_ARRAY_SIZE;
+
+  if (compiler->lookAhead->tokenType == KW_STRING) {
+    eat(KW_STRING);
+    elementType = makeCharType();
+  } else {
+    eat(KW_BYTES);
+    elementType = makeIntType();
+  }
+  if (!allowOpen || (compiler->lookAhead->tokenType == SB_LSEL)) {
+    eat(SB_LSEL);
+    eat(TK_NUMBER);
+    capacity = compiler->currentToken->value;
+    eat(SB_RSEL);
+  }
+  return makePackedType(capacity, elementType);
+}
+
 Type* compileBasicType(void) {
   Type* type;
 
-  switch (lookAhead->tokenType) {
+  switch (compiler->lookAhead->tokenType) {
   case KW_INTEGER: 
     eat(KW_INTEGER); 
     type = makeIntType();
@@ -401,19 +489,41 @@ Type* compileBasicType(void) {
     type = makeCharType();
     break;
   default:
-    error(ERR_INVALID_BASICTYPE, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_BASICTYPE, compiler->lookAhead->lineNo, compiler->lookAhead->colNo);
     break;
   }
   return type;
 }
 
+// --- HÀM COMPILE PARAM TYPE ---
+// Chức năng: Kiểu của tham số VAR/CONST. Giống compileType, thêm mảng mở
+// ARRAY OF <Kiểu> nhận mảng có kích thước bất kỳ (mảng được truyền bằng địa chỉ).
+Type* compileParamType(void) {
+  int arraySize = OPEN_ARRAY_SIZE;
+
+  if ((compiler->lookAhead->tokenType == KW_STRING) || (compiler->lookAhead->tokenType == KW_BYTES))
+    return compilePackedType(1);
+  if (compiler->lookAhead->tokenType != KW_ARRAY)
+    return compileType();
+
+  eat(KW_ARRAY);
+  if (compiler->lookAhead->tokenType == SB_LSEL) { // Có kích thước -> được kiểm tra khi gọi
+    eat(SB_LSEL);
+    eat(TK_NUMBER);
+    arraySize = compiler->currentToken->value;
+    eat(SB_RSEL);
+  }
+  eat(KW_OF);
+  return makeArrayType(arraySize, compileType());
+}
+
 // --- HÀM COMPILE PARAMS ---
 // Chức năng: Biên dịch danh sách tham số hàm/thủ tục
 void compileParams(void) {
-  if (lookAhead->tokenType == SB_LPAR) { // Dấu mở ngoặc (
+  if (compiler->lookAhead->tokenType == SB_LPAR) { // Dấu mở ngoặc (
     eat(SB_LPAR);
     compileParam(); // Tham số đầu tiên
-    while (lookAhead->tokenType == SB_SEMICOLON) { // Các tham số tiếp theo cách nhau bởi ;
+    while (compiler->lookAhead->tokenType == SB_SEMICOLON) { // Các tham số tiếp theo cách nhau bởi ;
       eat(SB_SEMICOLON);
       compileParam();
     }
@@ -426,16 +536,24 @@ void compileParam(void) {
   Type* type;
   enum ParamKind paramKind = PARAM_VALUE; // Mặc định là tham trị
 
-  if (lookAhead->tokenType == KW_VAR) { // Nếu có VAR -> Tham biến
+  if (compiler->lookAhead->tokenType == KW_VAR) { // Nếu có VAR -> Tham biến
     paramKind = PARAM_REFERENCE;
     eat(KW_VAR);
+  } else if (compiler->lookAhead->tokenType == KW_CONST) { // CONST -> mảng chỉ đọc
+    paramKind = PARAM_CONST;
+    eat(KW_CONST);
   }
 
   eat(TK_IDENT); // Tên tham số
-  checkFreshIdent(currentToken->string);
-  param = createParameterObject(currentToken->string, paramKind);
+  checkFreshIdent(compiler->currentToken->string);
+  param = createParameterObject(compiler->currentToken->string, paramKind);
   eat(SB_COLON);
-  type = compileBasicType(); // Kiểu tham số
+  if (paramKind == PARAM_VALUE)
+    type = compileBasicType(); // Tham trị: chỉ kiểu cơ bản
+  else type = compileParamType(); // Tham chiếu: có thể là mảng
+  // Chỉ mảng, STRING, BYTES mới là tham số CONST; lỗi không làm hỏng việc phân tích nên không cần phục hồi
+  if ((paramKind == PARAM_CONST) && (type->typeClass != TP_ARRAY) && (type->typeClass != TP_PACKED))
+    reportError(ERR_TYPE_INCONSISTENCY, compiler->currentToken->lineNo, compiler->currentToken->colNo);
   param->paramAttrs->type = type;
   declareObject(param); // Đưa tham số vào bảng ký hiệu
 }
@@ -443,17 +561,17 @@ void compileParam(void) {
 // --- HÀM COMPILE STATEMENTS ---
 // Chức năng: Biên dịch chuỗi các câu lệnh
 void compileStatements(void) {
-  compileStatement();
-  while (lookAhead->tokenType == SB_SEMICOLON) { // Cách nhau bởi ;
+  compileWithRecovery(compileStatement, statementFollow);
+  while (compiler->lookAhead->tokenType == SB_SEMICOLON) { // Cách nhau bởi ;
     eat(SB_SEMICOLON);
-    compileStatement();
+    compileWithRecovery(compileStatement, statementFollow);
   }
 }
 
 // --- HÀM COMPILE STATEMENT ---
 // Chức năng: Phân loại và gọi hàm xử lý cho từng loại câu lệnh
 void compileStatement(void) {
-  switch (lookAhead->tokenType) {
+  switch (compiler->lookAhead->tokenType) {
   case TK_IDENT: // Bắt đầu bằng tên -> Lệnh gán
     compileAssignSt();
     break;
@@ -472,13 +590,16 @@ void compileStatement(void) {
   case KW_FOR: // Vòng lặp FOR
     compileForSt();
     break;
+  case KW_PARALLEL: // PARALLEL FOR
+    compileParallelForSt();
+    break;
     // Các token này báo hiệu kết thúc câu lệnh hoặc khối lệnh rỗng
   case SB_SEMICOLON:
   case KW_END:
   case KW_ELSE:
     break;
   default:
-    error(ERR_INVALID_STATEMENT, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_STATEMENT, compiler->lookAhead->lineNo, compiler->lookAhead->colNo);
     break;
   }
 }
@@ -488,29 +609,43 @@ void compileStatement(void) {
 Type* compileLValue(void) {
   Object* var;
   Type* varType;
+  int packed = 0;
 
   eat(TK_IDENT); // Tên biến
   
-  var = checkDeclaredLValueIdent(currentToken->string); // Kiểm tra đã khai báo chưa
+  var = checkDeclaredLValueIdent(compiler->currentToken->string); // Kiểm tra đã khai báo chưa
 
   switch (var->kind) {
   case OBJ_VARIABLE:
     genVariableAddress(var); // Sinh lệnh đẩy ĐỊA CHỈ của biến lên stack (LA)
 
     if (var->varAttrs->type->typeClass == TP_ARRAY) {
-      // Nếu là mảng, tính toán địa chỉ phần tử
-      varType = compileIndexes(var->varAttrs->type);
+      // Nếu là mảng, tính toán địa chỉ phần tử (hoặc cả mảng/một hàng khi gán mảng)
+      varType = compileSubscripts(var->varAttrs->type);
+    }
+    else if (var->varAttrs->type->typeClass == TP_PACKED) {
+      varType = compilePackedIndex(var->varAttrs->type);
+      packed = (varType != var->varAttrs->type);
     }
     else
       varType = var->varAttrs->type;
     break;
   case OBJ_PARAMETER:
     // Nếu là tham số hàm
+    if (var->paramAttrs->kind == PARAM_CONST)
+      error(ERR_READONLY_PARAMETER, compiler->currentToken->lineNo, compiler->currentToken->colNo);
     if (var->paramAttrs->kind == PARAM_VALUE)
       genParameterAddress(var); // Tham trị
     else genParameterValue(var); // Tham biến (bản thân giá trị của nó là địa chỉ)
 
-    varType = var->paramAttrs->type;
+    if (var->paramAttrs->type->typeClass == TP_ARRAY)
+      varType = compileSubscripts(var->paramAttrs->type); // Mảng truyền bằng địa chỉ
+    else if (var->paramAttrs->type->typeClass == TP_PACKED) {
+      varType = compilePackedIndex(var->paramAttrs->type);
+      packed = (varType != var->paramAttrs->type);
+    }
+    else
+      varType = var->paramAttrs->type;
     break;
   case OBJ_FUNCTION:
     // Nếu gán giá trị cho tên hàm (trong Pascal nghĩa là return)
@@ -518,26 +653,90 @@ Type* compileLValue(void) {
     varType = var->funcAttrs->returnType;
     break;
   default: 
-    error(ERR_INVALID_LVALUE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_LVALUE,compiler->currentToken->lineNo, compiler->currentToken->colNo);
   }
 
+  checkParallelLValue(var, varType);
+
+  // Gán sau cùng: chỉ số có thể chứa lời gọi hàm, tức là một compileLValue khác
+  compiler->packedLValue = packed;
   return varType;
 }
 
+// Hằng chuỗi (hoặc một ký tự) trong vùng hằng; trả về vị trí của nó
+int compileStringConstant(void) {
+  int offset;
+
+  if (compiler->lookAhead->tokenType == TK_STRING) {
+    eat(TK_STRING);
+    return compiler->currentToken->value;
+  }
+  eat(TK_CHAR);
+  offset = beginStringConstant();
+  appendStringConstant(offset, (char) compiler->currentToken->value);
+  return offset;
+}
+
+// Sau địa chỉ của một STRING/BYTES: S(. i .) chọn một byte (đẩy thêm chỉ số),
+// không có chỉ số là cả bộ đệm
+Type* compilePackedIndex(Type* type) {
+  Type* indexType;
+
+  if (compiler->lookAhead->tokenType != SB_LSEL)
+    return type;
+  eat(SB_LSEL);
+  indexType = compileExpression();
+  checkIntType(indexType);
+  eat(SB_RSEL);
+  return type->elementType;
+}
+
 // --- HÀM COMPILE ASSIGN STATEMENT ---
 // Chức năng: Biên dịch lệnh gán (Variable := Expression)
 void compileAssignSt(void) {
   Type* varType;
   Type* expType;
 
+  int packed;
+
   varType = compileLValue(); // Xử lý vế trái (đẩy địa chỉ lên stack)
+  packed = compiler->packedLValue;
   
   eat(SB_ASSIGN); // Dấu :=
+
+  if (varType->typeClass == TP_ARRAY) {
+    // Gán cả mảng: vế phải là một mảng cùng kiểu (đẩy địa chỉ), sao chép bằng một lệnh CPY
+    expType = compileArrayArgument(1);
+    checkTypeEquality(varType, expType);
+    if (varType->arraySize == OPEN_ARRAY_SIZE) // Không biết kích thước mảng mở
+      error(ERR_TYPE_INCONSISTENCY, compiler->currentToken->lineNo, compiler->currentToken->colNo);
+    genCPY(sizeOfType(varType));
+    return;
+  }
+
+  if ((varType->typeClass == TP_PACKED) && (varType->elementType == compiler->charType) &&
+      ((compiler->lookAhead->tokenType == TK_STRING) || (compiler->lookAhead->tokenType == TK_CHAR))) {
+    // Gán hằng chuỗi cho STRING: chép từ vùng DATA bằng một lệnh CPK
+    genCPK(compileStringConstant());
+    return;
+  }
+
+  if (varType->typeClass == TP_PACKED) {
+    // Gán cả STRING/BYTES: chép các byte, tối đa bằng sức chứa của vế trái
+    expType = compileExpression();
+    checkPackedType(varType, expType);
+    genCPS();
+    return;
+  }
+
   expType = compileExpression(); // Xử lý vế phải (tính giá trị, đẩy kết quả lên stack)
   
   checkTypeEquality(varType, expType); // Kiểm tra 2 vế có cùng kiểu không
 
-  genST(); // Sinh lệnh ST (Store): Lấy giá trị ở đỉnh stack lưu vào địa chỉ ngay dưới nó
+  if (packed)
+    genSTB(); // Ghi một byte: bộ đệm, chỉ số, giá trị
+  else
+    genST(); // Sinh lệnh ST (Store): Lấy giá trị ở đỉnh stack lưu vào địa chỉ ngay dưới nó
 }
 
 // --- HÀM COMPILE CALL STATEMENT ---
@@ -548,7 +747,7 @@ void compileCallSt(void) {
   eat(KW_CALL);
   eat(TK_IDENT); // Tên thủ tục
 
-  proc = checkDeclaredProcedure(currentToken->string);
+  proc = checkDeclaredProcedure(compiler->currentToken->string);
   
   // Xử lý các trường hợp: hàm dựng sẵn hoặc hàm người dùng
   if (proc == NULL) {
@@ -559,11 +758,16 @@ void compileCallSt(void) {
     } 
   }
   else{
-    if (isPredefinedProcedure(proc)) {
+    if (proc == compiler->writesProcedure) {
+      checkParallelIO();
+      compileWritesArgument();
+    } else if (isPredefinedProcedure(proc)) {
+      checkParallelIO();
       compileArguments(proc->procAttrs->paramList);
       genPredefinedProcedureCall(proc);
     } else {
       // Thủ tục người dùng định nghĩa
+      checkParallelCall(proc);
       genINT(RESERVED_WORDS); // Tăng stack frame cho các thông tin quản lý (RA, DL, SL)
       compileArguments(proc->procAttrs->paramList); // Đẩy các tham số lên stack
       genDCT( RESERVED_WORDS + proc->procAttrs->paramCount); // Reset stack pointer (trừ hao đi)
@@ -572,6 +776,32 @@ void compileCallSt(void) {
   }
 }
 
+// WRITES(...) nhận một STRING hoặc một hằng chuỗi; hằng chuỗi được ghi
+// bằng đúng một lệnh WRK (đọc từ vùng DATA chỉ đọc)
+void compileWritesArgument(void) {
+  Object* param = compiler->writesProcedure->procAttrs->paramList->object;
+  Type* type;
+
+  eat(SB_LPAR);
+  switch (compiler->lookAhead->tokenType) {
+  case TK_STRING:
+    eat(TK_STRING);
+    genWRK(compiler->currentToken->value);
+    break;
+  case TK_CHAR:
+    eat(TK_CHAR);
+    genLC(compiler->currentToken->value);
+    genWRC();
+    break;
+  default:
+    type = compileArrayArgument(1);
+    checkArrayArgument(param->paramAttrs->type, type);
+    genWRS();
+    break;
+  }
+  eat(SB_RPAR);
+}
+
 void compileGroupSt(void) {
   eat(KW_BEGIN);
   compileStatements();
@@ -581,8 +811,8 @@ void compileGroupSt(void) {
 // --- HÀM COMPILE IF STATEMENT ---
 // Chức năng: Biên dịch câu lệnh điều kiện IF ... THEN ... ELSE
 void compileIfSt(void) {
-  Instruction* fjInstruction; // Lệnh nhảy sai (False Jump)
-  Instruction* jInstruction;  // Lệnh nhảy không điều kiện (Jump)
+  CodeAddress fjInstruction; // Lệnh nhảy sai (False Jump)
+  CodeAddress jInstruction;  // Lệnh nhảy không điều kiện (Jump)
 
   eat(KW_IF);
   compileCondition(); // Tính giá trị điều kiện (True/False)
@@ -593,7 +823,7 @@ void compileIfSt(void) {
   
   compileStatement(); // Lệnh thực hiện khi đúng
 
-  if (lookAhead->tokenType == KW_ELSE) { // Nếu có nhánh ELSE
+  if (compiler->lookAhead->tokenType == KW_ELSE) { // Nếu có nhánh ELSE
     // Sinh lệnh Jump: Nhảy qua nhánh ELSE sau khi làm xong nhánh THEN
     jInstruction = genJ(DC_VALUE);
     
@@ -615,7 +845,7 @@ void compileIfSt(void) {
 // Chức năng: Biên dịch vòng lặp WHILE
 void compileWhileSt(void) {
   CodeAddress beginWhile;
-  Instruction* fjInstruction;
+  CodeAddress fjInstruction;
 
   beginWhile = getCurrentCodeAddress(); // Lưu địa chỉ đầu vòng lặp
   eat(KW_WHILE);
@@ -636,8 +866,10 @@ void compileWhileSt(void) {
 // --- HÀM COMPILE FOR STATEMENT ---
 // Chức năng: Biên dịch vòng lặp FOR
 void compileForSt(void) {
+  CodeAddress forStart = getCurrentCodeAddress();
   CodeAddress beginLoop;
-  Instruction* fjInstruction;
+  CodeAddress limitEnd;
+  CodeAddress fjInstruction;
   Type* varType;
   Type *type;
 
@@ -645,6 +877,8 @@ void compileForSt(void) {
 
   // Xử lý khởi tạo: i := 1
   varType = compileLValue(); // Địa chỉ biến đếm
+  if (compiler->packedLValue) // Một byte không có địa chỉ riêng
+    error(ERR_INVALID_LVALUE, compiler->currentToken->lineNo, compiler->currentToken->colNo);
   eat(SB_ASSIGN);
 
   genCV(); // Copy địa chỉ biến đếm (để dùng lại)
@@ -660,6 +894,7 @@ void compileForSt(void) {
 
   type = compileExpression(); // Giá trị đích
   checkTypeEquality(varType, type);
+  limitEnd = getCurrentCodeAddress();
   genLE(); // So sánh Biến đếm <= Giá trị đích
   
   fjInstruction = genFJ(DC_VALUE); // Nếu sai -> Thoát
@@ -667,6 +902,11 @@ void compileForSt(void) {
   eat(KW_DO);
   compileStatement(); // Thân vòng lặp
 
+  // Thân là một mẫu quen thuộc (gán, chép, cộng dồn mảng): cả vòng lặp
+  // thành một lệnh véc-tơ
+  if (genLoopIdiom(forStart, beginLoop, limitEnd, fjInstruction + 1))
+    return;
+
   // Tăng biến đếm: i = i + 1
   genCV();  
   genCV();
@@ -683,39 +923,210 @@ void compileForSt(void) {
   genDCT(1); // Dọn dẹp stack
 }
 
+// --- HÀM COMPILE PARALLEL FOR ---
+// PARALLEL FOR <biến> := <biểu thức> TO <biểu thức> [REDUCE <biến> (+ | *)] DO <lệnh>
+// Thân vòng lặp được dịch thành một hàm ẩn lồng trong khối hiện tại, chạy
+// một đoạn [@LO, @HI] của miền lặp; lệnh PFOR chia miền lặp cho các luồng
+// của máy ảo. Biến đếm và biến REDUCE là biến cục bộ của hàm ẩn (mỗi luồng
+// một bản, che biến cùng tên bên ngoài); biến REDUCE bắt đầu từ 0 với + và
+// từ 1 với *, kết quả của các đoạn được gộp vào biến bên ngoài khi vòng lặp
+// kết thúc. Biến đếm bên ngoài không đổi.
+void compileParallelForSt(void) {
+  Object* obj;
+  Object* task;
+  Object* lo;
+  Object* hi;
+  Object* counter;
+  Object* sum = NULL;
+  Type* varType = NULL;
+  Type* type;
+  char counterName[MAX_IDENT_LEN + 1];
+  char sumName[MAX_IDENT_LEN + 1];
+  int reduction = REDUCE_NONE;
+  CodeAddress jmp;
+  CodeAddress entry;
+  CodeAddress beginLoop;
+  CodeAddress fjInstruction;
+  Scope* outerParallel = compiler->parallelScope;
+
+  eat(KW_PARALLEL);
+  eat(KW_FOR);
+
+  // Biến đếm: chỉ cần tên và kiểu, không sinh mã
+  eat(TK_IDENT);
+  obj = checkDeclaredLValueIdent(compiler->currentToken->string);
+  if (obj->kind == OBJ_VARIABLE) varType = obj->varAttrs->type;
+  else if (obj->kind == OBJ_PARAMETER) varType = obj->paramAttrs->type;
+  checkBasicType(varType);
+  strcpy(counterName, obj->name);
+
+  // Miền lặp, tính trong khối hiện tại
+  eat(SB_ASSIGN);
+  type = compileExpression();
+  checkTypeEquality(varType, type);
+  eat(KW_TO);
+  type = compileExpression();
+  checkTypeEquality(varType, type);
+
+  if (compiler->lookAhead->tokenType == KW_REDUCE) {
+    eat(KW_REDUCE);
+    if (compiler->lookAhead->tokenType == TK_IDENT)
+      strcpy(sumName, compiler->lookAhead->string);
+    type = compileLValue(); // Địa chỉ biến nhận kết quả, ở đỉnh stack
+    obj = checkDeclaredLValueIdent(sumName);
+    if ((obj->kind == OBJ_FUNCTION) || (type->typeClass != TP_INT) ||
+	((obj->kind == OBJ_VARIABLE) && (obj->varAttrs->type != type)) ||
+	((obj->kind == OBJ_PARAMETER) && (obj->paramAttrs->type != type)))
+      error(ERR_INVALID_VARIABLE, compiler->currentToken->lineNo, compiler->currentToken->colNo);
+    if (strcmp(sumName, counterName) == 0)
+      error(ERR_DUPLICATE_IDENT, compiler->currentToken->lineNo, compiler->currentToken->colNo);
+    if (compiler->lookAhead->tokenType == SB_PLUS) {
+      eat(SB_PLUS);
+      reduction = REDUCE_ADD;
+    } else if (compiler->lookAhead->tokenType == SB_TIMES) {
+      eat(SB_TIMES);
+      reduction = REDUCE_MUL;
+    } else error(ERR_INVALID_SYMBOL, compiler->lookAhead->lineNo, compiler->lookAhead->colNo);
+  }
+  eat(KW_DO);
+
+  jmp = genJ(DC_VALUE); // Nhảy qua mã của hàm ẩn
+
+  // Hàm ẩn: tên bắt đầu bằng @ nên chương trình không gọi được
+  task = createFunctionObject("@PARALLEL");
+  task->funcAttrs->returnType = compiler->intType;
+  task->funcAttrs->codeAddress = getCurrentCodeAddress();
+  declareObject(task);
+  genSymbol(task, task->funcAttrs->codeAddress);
+  enterBlock(task->funcAttrs->scope);
+
+  lo = createParameterObject("@LO", PARAM_VALUE);
+  lo->paramAttrs->type = varType;
+  declareObject(lo);
+  hi = createParameterObject("@HI", PARAM_VALUE);
+  hi->paramAttrs->type = varType;
+  declareObject(hi);
+  counter = createVariableObject(counterName);
+  counter->varAttrs->type = varType;
+  declareObject(counter);
+  if (reduction != REDUCE_NONE) {
+    sum = createVariableObject(sumName);
+    sum->varAttrs->type = compiler->intType;
+    declareObject(sum);
+  }
+
+  // Lối vào nhảy tới thân như compileBlock
+  entry = genJ(DC_VALUE);
+  updateJ(entry, getCurrentCodeAddress());
+  genINT(compiler->symtab->currentScope->frameSize);
+
+  genVariableAddress(counter); // Biến đếm := @LO
+  genParameterValue(lo);
+  genST();
+  if (sum != NULL) {
+    genVariableAddress(sum);
+    genLC((reduction == REDUCE_ADD) ? 0 : 1);
+    genST();
+  }
+
+  beginLoop = getCurrentCodeAddress();
+  genVariableValue(counter);
+  genParameterValue(hi);
+  genLE();
+  fjInstruction = genFJ(DC_VALUE);
+
+  compiler->parallelScope = compiler->symtab->currentScope;
+  compileStatement(); // Thân vòng lặp
+  compiler->parallelScope = outerParallel;
+
+  genVariableAddress(counter); // Biến đếm := biến đếm + 1
+  genVariableValue(counter);
+  genLC(1);
+  genAD();
+  genST();
+  genJ(beginLoop);
+  updateFJ(fjInstruction, getCurrentCodeAddress());
+
+  if (sum != NULL) { // Trả về kết quả của đoạn
+    genReturnValueAddress(task);
+    genVariableValue(sum);
+    genST();
+  }
+  genEF();
+  exitBlock();
+
+  updateJ(jmp, getCurrentCodeAddress());
+  genPFOR(reduction, task->funcAttrs->codeAddress);
+}
+
 void compileArgument(Object* param) {
   Type* type;
 
   if (param->paramAttrs->kind == PARAM_VALUE) {
     type = compileExpression();
     checkTypeEquality(type, param->paramAttrs->type);
+  } else if ((param->paramAttrs->type->typeClass == TP_ARRAY) || (param->paramAttrs->type->typeClass == TP_PACKED)) {
+    type = compileArrayArgument(param->paramAttrs->kind == PARAM_CONST);
+    checkArrayArgument(param->paramAttrs->type, type);
   } else {
     type = compileLValue();
+    if (compiler->packedLValue) // Một byte không truyền được bằng tham chiếu
+      error(ERR_INVALID_ARGUMENTS, compiler->currentToken->lineNo, compiler->currentToken->colNo);
     checkTypeEquality(type, param->paramAttrs->type);
   }
 }
 
+// Đối số cho tham số mảng (hoặc STRING/BYTES) VAR/CONST: chỉ đẩy địa chỉ đầu mảng, không sao chép.
+// Có thể truyền một phần của mảng nhiều chiều, ví dụ A(. i .) là một hàng.
+Type* compileArrayArgument(int readOnly) {
+  Object* obj;
+  Type* type;
+
+  eat(TK_IDENT);
+  obj = checkDeclaredIdent(compiler->currentToken->string);
+
+  switch (obj->kind) {
+  case OBJ_VARIABLE:
+    genVariableAddress(obj);
+    type = obj->varAttrs->type;
+    break;
+  case OBJ_PARAMETER:
+    // Mảng CONST chỉ được truyền tiếp cho tham số CONST
+    if ((obj->paramAttrs->kind == PARAM_CONST) && !readOnly)
+      error(ERR_READONLY_PARAMETER, compiler->currentToken->lineNo, compiler->currentToken->colNo);
+    if (obj->paramAttrs->kind == PARAM_VALUE)
+      genParameterAddress(obj);
+    else genParameterValue(obj);
+    type = obj->paramAttrs->type;
+    break;
+  default:
+    error(ERR_INVALID_VARIABLE, compiler->currentToken->lineNo, compiler->currentToken->colNo);
+    break;
+  }
+  return compileSubscripts(type);
+}
+
 void compileArguments(ObjectNode* paramList) {
   ObjectNode* node = paramList;
 
-  switch (lookAhead->tokenType) {
+  switch (compiler->lookAhead->tokenType) {
   case SB_LPAR:
     eat(SB_LPAR);
     if (node == NULL)
-      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, compiler->currentToken->lineNo, compiler->currentToken->colNo);
     compileArgument(node->object);
     node = node->next;
 
-    while (lookAhead->tokenType == SB_COMMA) {
+    while (compiler->lookAhead->tokenType == SB_COMMA) {
       eat(SB_COMMA);
       if (node == NULL)
-	error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+	error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, compiler->currentToken->lineNo, compiler->currentToken->colNo);
       compileArgument(node->object);
       node = node->next;
     }
 
     if (node != NULL)
-      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, compiler->currentToken->lineNo, compiler->currentToken->colNo);
     
     eat(SB_RPAR);
     break;
@@ -726,6 +1137,7 @@ void compileArguments(ObjectNode* paramList) {
   case SB_MINUS:
   case KW_TO:
   case KW_DO:
+  case KW_REDUCE:
   case SB_RPAR:
   case SB_COMMA:
   case SB_EQ:
@@ -746,7 +1158,7 @@ void compileArguments(ObjectNode* paramList) {
   // ----------------------------------------------------------
     break;
   default:
-    error(ERR_INVALID_ARGUMENTS, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_ARGUMENTS, compiler->lookAhead->lineNo, compiler->lookAhead->colNo);
   }
 }
 
@@ -758,9 +1170,10 @@ void compileCondition(void) {
   TokenType op;
 
   type1 = compileExpression(); // Vế trái
-  checkBasicType(type1);
+  if ((type1 == NULL) || (type1->typeClass != TP_PACKED))
+    checkBasicType(type1);
 
-  op = lookAhead->tokenType; // Toán tử so sánh
+  op = compiler->lookAhead->tokenType; // Toán tử so sánh
   switch (op) {
   case SB_EQ: eat(SB_EQ); break;
   case SB_NEQ: eat(SB_NEQ); break;
@@ -769,11 +1182,17 @@ void compileCondition(void) {
   case SB_GE: eat(SB_GE); break;
   case SB_GT: eat(SB_GT); break;
   default:
-    error(ERR_INVALID_COMPARATOR, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_COMPARATOR, compiler->lookAhead->lineNo, compiler->lookAhead->colNo);
   }
 
   type2 = compileExpression(); // Vế phải
-  checkTypeEquality(type1,type2);
+  if (type1->typeClass == TP_PACKED) {
+    // So sánh hai STRING/BYTES theo thứ tự từ điển: CMPS cho -1, 0, 1, so với 0
+    checkPackedType(type1, type2);
+    genCMPS();
+    genLC(0);
+  } else
+    checkTypeEquality(type1,type2);
 
   // Sinh mã máy so sánh tương ứng
   switch (op) {
@@ -792,7 +1211,7 @@ void compileCondition(void) {
 Type* compileExpression(void) {
   Type* type;
   
-  switch (lookAhead->tokenType) {
+  switch (compiler->lookAhead->tokenType) {
   case SB_PLUS: // Dấu cộng một ngôi (+5)
     eat(SB_PLUS);
     type = compileExpression2();
@@ -823,7 +1242,7 @@ Type* compileExpression3(Type* argType1) {
   Type* argType2;
   Type* resultType;
 
-  switch (lookAhead->tokenType) {
+  switch (compiler->lookAhead->tokenType) {
   case SB_PLUS:
     eat(SB_PLUS);
     checkIntType(argType1);
@@ -861,6 +1280,7 @@ Type* compileExpression3(Type* argType1) {
     // Follow sets
   case KW_TO:
   case KW_DO:
+  case KW_REDUCE:
   case SB_RPAR:
   case SB_COMMA:
   case SB_EQ:
@@ -877,7 +1297,7 @@ Type* compileExpression3(Type* argType1) {
     resultType = argType1;
     break;
   default:
-    error(ERR_INVALID_EXPRESSION, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_EXPRESSION, compiler->lookAhead->lineNo, compiler->lookAhead->colNo);
   }
   return resultType;
 }
@@ -896,7 +1316,7 @@ Type* compileTerm2(Type* argType1) {
   Type* argType2;
   Type* resultType;
 
-  switch (lookAhead->tokenType) {
+  switch (compiler->lookAhead->tokenType) {
   case SB_TIMES:
     eat(SB_TIMES);
     checkIntType(argType1);
@@ -948,6 +1368,7 @@ Type* compileTerm2(Type* argType1) {
   case KW_OR: // [QUAN TRỌNG] Thêm OR vào đây vì nó có độ ưu tiên thấp hơn (nằm ở Expression)
   case KW_TO:
   case KW_DO:
+  case KW_REDUCE:
   case SB_RPAR:
   case SB_COMMA:
   case SB_EQ:
@@ -964,7 +1385,7 @@ Type* compileTerm2(Type* argType1) {
     resultType = argType1;
     break;
   default:
-    error(ERR_INVALID_TERM, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_TERM, compiler->lookAhead->lineNo, compiler->lookAhead->colNo);
   }
   return resultType;
 }
@@ -975,30 +1396,30 @@ Type* compileFactor(void) {
   Type* type;
   Object* obj;
 
-  switch (lookAhead->tokenType) {
+  switch (compiler->lookAhead->tokenType) {
   case TK_NUMBER: // Số nguyên
     eat(TK_NUMBER);
-    type = intType;
-    genLC(currentToken->value); // Load Constant
+    type = compiler->intType;
+    genLC(compiler->currentToken->value); // Load Constant
     break;
   case TK_CHAR: // Ký tự
     eat(TK_CHAR);
-    type = charType;
-    genLC(currentToken->value);
+    type = compiler->charType;
+    genLC(compiler->currentToken->value);
     break;
   case TK_IDENT: // Tên định danh
     eat(TK_IDENT);
-    obj = checkDeclaredIdent(currentToken->string); // Tra cứu trong bảng ký hiệu
+    obj = checkDeclaredIdent(compiler->currentToken->string); // Tra cứu trong bảng ký hiệu
 
     switch (obj->kind) {
     case OBJ_CONSTANT: // Là hằng
       switch (obj->constAttrs->value->type) {
       case TP_INT:
-	type = intType;
+	type = compiler->intType;
 	genLC(obj->constAttrs->value->intValue);
 	break;
       case TP_CHAR:
-	type = charType;
+	type = compiler->charType;
 	genLC(obj->constAttrs->value->charValue);
 	break;
       default:
@@ -1011,6 +1432,12 @@ Type* compileFactor(void) {
 	genVariableAddress(obj);
 	type = compileIndexes(obj->varAttrs->type); // Tính chỉ số
 	genLI(); // Load Indirect (lấy giá trị)
+      } else if (obj->varAttrs->type->typeClass == TP_PACKED) {
+        // STRING/BYTES: cả bộ đệm là địa chỉ của nó, S(. i .) là một byte
+	genVariableAddress(obj);
+	type = compilePackedIndex(obj->varAttrs->type);
+	if (type != obj->varAttrs->type)
+	  genLDB();
       } else {
 	type = obj->varAttrs->type;
 	genVariableValue(obj); // Load Value
@@ -1019,14 +1446,25 @@ Type* compileFactor(void) {
     case OBJ_PARAMETER: // Là tham số
       type = obj->paramAttrs->type;
       genParameterValue(obj);
-      if (obj->paramAttrs->kind == PARAM_REFERENCE)
+      if (type->typeClass == TP_ARRAY) {
+        // Mảng VAR/CONST: giá trị tham số là địa chỉ đầu mảng
+	type = compileIndexes(type);
+	genLI();
+      } else if (type->typeClass == TP_PACKED) {
+	type = compilePackedIndex(type);
+	if (type != obj->paramAttrs->type)
+	  genLDB();
+      } else if (obj->paramAttrs->kind == PARAM_REFERENCE)
 	genLI(); // Nếu là tham biến thì phải load indirect thêm 1 lần
       break;
     case OBJ_FUNCTION: // Là hàm
       if (isPredefinedFunction(obj)) {
+	if (obj != compiler->lengthFunction)
+	  checkParallelIO(); // READI, READC
 	compileArguments(obj->funcAttrs->paramList);
 	genPredefinedFunctionCall(obj);
       } else {
+	checkParallelCall(obj);
 	genINT(4);
 	compileArguments(obj->funcAttrs->paramList);
 	genDCT(4+obj->funcAttrs->paramCount);
@@ -1035,7 +1473,7 @@ Type* compileFactor(void) {
       type = obj->funcAttrs->returnType;
       break;
     default: 
-      error(ERR_INVALID_FACTOR,currentToken->lineNo, currentToken->colNo);
+      error(ERR_INVALID_FACTOR,compiler->currentToken->lineNo, compiler->currentToken->colNo);
       break;
     }
     break;
@@ -1055,19 +1493,26 @@ Type* compileFactor(void) {
   // -------------------------------------------------------------------------------------
 
   default:
-    error(ERR_INVALID_FACTOR, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_FACTOR, compiler->lookAhead->lineNo, compiler->lookAhead->colNo);
   }
   
   return type;
 }
 
 // --- HÀM COMPILE INDEXES ---
-// Chức năng: Tính toán chỉ số mảng
+// Chức năng: Tính toán chỉ số mảng cho đến một phần tử kiểu cơ bản
 Type* compileIndexes(Type* arrayType) {
+  arrayType = compileSubscripts(arrayType);
+  checkBasicType(arrayType);
+  return arrayType;
+}
+
+// Các chỉ số (có thể chưa đủ) sau địa chỉ đầu mảng; trả về kiểu của phần được chọn
+Type* compileSubscripts(Type* arrayType) {
   Type* type;
 
   // Lặp xử lý mảng đa chiều
-  while (lookAhead->tokenType == SB_LSEL) {
+  while (compiler->lookAhead->tokenType == SB_LSEL) {
     eat(SB_LSEL); // [
     type = compileExpression(); // Tính biểu thức index
     checkIntType(type);
@@ -1081,26 +1526,60 @@ Type* compileIndexes(Type* arrayType) {
     arrayType = arrayType->elementType;
     eat(SB_RSEL); // ]
   }
-  checkBasicType(arrayType);
   return arrayType;
 }
 
 // --- HÀM CHÍNH (COMPILE) ---
 // Chức năng: Khởi động quá trình biên dịch từ tên file
+// Trả về IO_ERROR, IO_SUCCESS hoặc COMPILE_ERROR (chi tiết lỗi nằm trong compiler)
 int compile(char *fileName) {
   if (openInputStream(fileName) == IO_ERROR)
     return IO_ERROR;
+  return compileInput();
+}
 
-  currentToken = NULL;
-  lookAhead = getValidToken(); // Lấy token đầu tiên
+// Biên dịch chương trình nằm sẵn trong bộ nhớ (không đọc file)
+int compileSource(char *source, int size) {
+  openInputBuffer(source, size);
+  return compileInput();
+}
 
-  initSymTab(); // Khởi tạo bảng ký hiệu
+// Biên dịch từ nguồn vào đã được mở (file hoặc bộ nhớ)
+int compileInput(void) {
+  int result = IO_SUCCESS;
 
-  compileProgram(); // Bắt đầu phân tích cú pháp
+  compiler->diagnosticCount = 0;
+  compiler->callCount = 0;
+  compiler->recoverJump = NULL;
+  compiler->currentToken = NULL;
+  compiler->lookAhead = NULL;
 
-  cleanSymTab(); // Dọn dẹp
-  free(currentToken);
-  free(lookAhead);
+  // Lỗi biên dịch (error/missingToken) sẽ nhảy (longjmp) về đây
+  if (setjmp(compiler->errorJump) == 0) {
+    compiler->lookAhead = getValidToken(); // Lấy token đầu tiên
+
+    initSymTab(); // Khởi tạo bảng ký hiệu
+
+    compileProgram(); // Bắt đầu phân tích cú pháp
+    checkParallelCalls(); // Lời gọi trong PARALLEL FOR: cần tác dụng của mọi chương trình con
+
+    // Hết bộ nhớ khi sinh mã: mã bị thiếu, không được coi là biên dịch thành công
+    if (compiler->outOfMemory || compiler->codeBlock->overflow)
+      reportError(ERR_OUT_OF_MEMORY, compiler->currentToken->lineNo, compiler->currentToken->colNo);
+  }
+  compiler->recoverJump = NULL;
+  if (compiler->diagnosticCount > 0) {
+    sortDiagnostics();
+    result = COMPILE_ERROR;
+  } else if (compiler->optimize)
+    optimizeCode(); // Đánh số giá trị: bỏ các phép tính lặp lại
+
+  if (compiler->symtab != NULL)
+    cleanSymTab(); // Dọn dẹp
+  free(compiler->currentToken);
+  free(compiler->lookAhead);
+  compiler->currentToken = NULL;
+  compiler->lookAhead = NULL;
   closeInputStream();
-  return IO_SUCCESS;
+  return result;
 }
\ No newline at end of file
@@ -11,6 +11,10 @@
 void scan(void);
 void eat(TokenType tokenType);
 
+int inTokenSet(TokenType tokenType, TokenType* set);
+void synchronize(TokenType* follow);
+void compileWithRecovery(void (*compileFn)(void), TokenType* follow);
+
 void compileProgram(void);
 void compileBlock(void);
 void compileBlock2(void);
@@ -31,19 +35,26 @@ ConstantValue* compileConstant(void);
 ConstantValue* compileConstant2(void);
 Type* compileType(void);
 Type* compileBasicType(void);
+Type* compileParamType(void);
+Type* compilePackedType(int allowOpen);
 void compileParams(void);
 void compileParam(void);
 void compileStatements(void);
 void compileStatement(void);
 Type* compileLValue(void);
+Type* compilePackedIndex(Type* type);
+int compileStringConstant(void);
 void compileAssignSt(void);
 void compileCallSt(void);
+void compileWritesArgument(void);
 void compileGroupSt(void);
 void compileIfSt(void);
 void compileElseSt(void);
 void compileWhileSt(void);
 void compileForSt(void);
+void compileParallelForSt(void);
 void compileArgument(Object* param);
+Type* compileArrayArgument(int readOnly);
 void compileArguments(ObjectNode* paramList);
 void compileCondition(void);
 Type* compileExpression(void);
@@ -53,7 +64,10 @@ Type* compileTerm(void);
 Type* compileTerm2(Type* argType2);
 Type* compileFactor(void);
 Type* compileIndexes(Type* arrayType);
+Type* compileSubscripts(Type* arrayType);
 
 int compile(char *fileName);
+int compileSource(char *source, int size);
+int compileInput(void);
 
 #endif
@@ -0,0 +1,218 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+
+long long profileOpCodes[NUM_OF_OPCODES];
+ProfileNode* profileCurrent = NULL;
+
+ProfileSymbol* profileSymbols = NULL;
+int profileSymbolCount = 0;
+int profileSymbolCapacity = 0;
+
+ProfileNode* profileRoot = NULL;
+ProfileNode* profileNodes = NULL;  // every node, allocated at once
+int profileNodeCount = 0;
+int profileTruncated = 0;          // calls deeper than the tree could hold
+
+int addProfileSymbol(CodeAddress address, char* name) {
+  ProfileSymbol* symbols;
+  ProfileSymbol* s;
+
+  if (profileSymbolCount == profileSymbolCapacity) {
+    profileSymbolCapacity = (profileSymbolCapacity == 0) ? 16 : profileSymbolCapacity * 2;
+    symbols = (ProfileSymbol*) realloc(profileSymbols, profileSymbolCapacity * sizeof(ProfileSymbol));
+    if (symbols == NULL) {
+      profileSymbolCapacity = profileSymbolCount;
+      return 0;
+    }
+    profileSymbols = symbols;
+  }
+  s = profileSymbols + profileSymbolCount;
+  memset(s, 0, sizeof(ProfileSymbol));
+  s->address = address;
+  if (name != NULL) {
+    strncpy(s->name, name, SYMBOL_NAME_LEN - 1);
+    s->name[SYMBOL_NAME_LEN - 1] = '\0';
+  } else snprintf(s->name, SYMBOL_NAME_LEN, "@%d", address);
+  return profileSymbolCount ++;
+}
+
+// Procedures are few, a linear search is enough; unknown addresses get a
+// symbol of their own
+int findProfileSymbol(CodeAddress address) {
+  int i;
+
+  for (i = 0; i < profileSymbolCount; i ++)
+    if (profileSymbols[i].address == address)
+      return i;
+  return addProfileSymbol(address, NULL);
+}
+
+ProfileNode* newProfileNode(int symbol, ProfileNode* parent) {
+  ProfileNode* node;
+
+  if (profileNodeCount >= MAX_PROFILE_NODES) return NULL;
+  node = profileNodes + profileNodeCount ++;
+  memset(node, 0, sizeof(ProfileNode));
+  node->symbol = symbol;
+  node->parent = parent;
+  if (parent != NULL) {
+    node->sibling = parent->children;
+    parent->children = node;
+  }
+  return node;
+}
+
+void initProfile(SymbolEntry* symbols, int symbolCount, CodeAddress entryPoint) {
+  int i;
+
+  cleanProfile();
+  memset(profileOpCodes, 0, sizeof(profileOpCodes));
+  for (i = 0; i < symbolCount; i ++)
+    addProfileSymbol(symbols[i].address, symbols[i].name);
+
+  profileNodes = (ProfileNode*) malloc(MAX_PROFILE_NODES * sizeof(ProfileNode));
+  profileRoot = newProfileNode(findProfileSymbol(entryPoint), NULL);
+  profileRoot->calls = 1;
+  profileSymbols[profileRoot->symbol].calls = 1;
+  profileCurrent = profileRoot;
+}
+
+void cleanProfile(void) {
+  free(profileSymbols);
+  free(profileNodes);
+  profileSymbols = NULL;
+  profileNodes = NULL;
+  profileSymbolCount = profileSymbolCapacity = 0;
+  profileNodeCount = 0;
+  profileRoot = profileCurrent = NULL;
+  profileTruncated = 0;
+}
+
+void profileCall(CodeAddress address) {
+  int symbol = findProfileSymbol(address);
+  ProfileNode* node;
+
+  for (node = profileCurrent->children; node != NULL; node = node->sibling)
+    if (node->symbol == symbol) break;
+  if (node == NULL)
+    node = newProfileNode(symbol, profileCurrent);
+  if (node == NULL) {
+    // Out of nodes: the callee is charged to its caller's context
+    profileTruncated ++;
+    node = profileCurrent;
+  }
+  node->calls ++;
+  profileSymbols[symbol].calls ++;
+  profileCurrent = node;
+}
+
+void profileReturn(void) {
+  if (profileTruncated > 0)
+    profileTruncated --;
+  else if (profileCurrent->parent != NULL)
+    profileCurrent = profileCurrent->parent;
+}
+
+/******************************************************************/
+
+void printOpCodeProfile(FILE* f, long long total) {
+  int order[NUM_OF_OPCODES];
+  int i, j, tmp;
+
+  for (i = 0; i < NUM_OF_OPCODES; i ++) order[i] = i;
+  for (i = 1; i < NUM_OF_OPCODES; i ++)
+    for (j = i; (j > 0) && (profileOpCodes[order[j]] > profileOpCodes[order[j - 1]]); j --) {
+      tmp = order[j];
+      order[j] = order[j - 1];
+      order[j - 1] = tmp;
+    }
+
+  fprintf(f, "Instructions by opcode:\n");
+  for (i = 0; i < NUM_OF_OPCODES; i ++)
+    if (profileOpCodes[order[i]] > 0)
+      fprintf(f, "  %-5s %14lld %6.2f%%\n", opCodeName((enum OpCode) order[i]),
+	      profileOpCodes[order[i]], 100.0 * profileOpCodes[order[i]] / total);
+}
+
+void printSymbolProfile(FILE* f, long long total) {
+  int i;
+
+  for (i = 0; i < profileSymbolCount; i ++)
+    profileSymbols[i].instructions = 0;
+  for (i = 0; i < profileNodeCount; i ++)
+    profileSymbols[profileNodes[i].symbol].instructions += profileNodes[i].instructions;
+
+  fprintf(f, "Subprograms:\n");
+  fprintf(f, "  %-30s %14s %6s %12s\n", "name", "instructions", "%", "calls");
+  for (i = 0; i < profileSymbolCount; i ++)
+    if (profileSymbols[i].calls > 0)
+      fprintf(f, "  %-30s %14lld %5.2f%% %12lld\n", profileSymbols[i].name, profileSymbols[i].instructions,
+	      100.0 * profileSymbols[i].instructions / total, profileSymbols[i].calls);
+}
+
+// Edges of the call graph, summed over every context of the caller
+void printCallGraph(FILE* f) {
+  long long* counts;
+  int n = profileSymbolCount;
+  int i, j;
+
+  counts = (long long*) calloc(n * n, sizeof(long long));
+  if (counts == NULL) return;
+  for (i = 1; i < profileNodeCount; i ++)
+    counts[profileNodes[i].parent->symbol * n + profileNodes[i].symbol] += profileNodes[i].calls;
+
+  fprintf(f, "Call graph:\n");
+  for (i = 0; i < n; i ++)
+    for (j = 0; j < n; j ++)
+      if (counts[i * n + j] > 0)
+	fprintf(f, "  %s -> %s %lld\n", profileSymbols[i].name, profileSymbols[j].name, counts[i * n + j]);
+  free(counts);
+}
+
+void printStack(FILE* f, ProfileNode* node) {
+  if (node->parent != NULL) {
+    printStack(f, node->parent);
+    putc(';', f);
+  }
+  fprintf(f, "%s", profileSymbols[node->symbol].name);
+}
+
+// One line per calling context: frames separated by ';' and the number of
+// instructions executed in the innermost one, as flamegraph tools expect
+void printCollapsedStacks(FILE* f) {
+  int i;
+
+  for (i = 0; i < profileNodeCount; i ++)
+    if (profileNodes[i].instructions > 0) {
+      printStack(f, profileNodes + i);
+      fprintf(f, " %lld\n", profileNodes[i].instructions);
+    }
+}
+
+void printProfile(FILE* f, int format) {
+  long long total = 0;
+  int i;
+
+  if (profileRoot == NULL) return;
+  if (format == PROFILE_COLLAPSED) {
+    printCollapsedStacks(f);
+    return;
+  }
+
+  for (i = 0; i < NUM_OF_OPCODES; i ++)
+    total += profileOpCodes[i];
+  fprintf(f, "Instructions executed: %lld\n", total);
+  if (total == 0) return;
+
+  printOpCodeProfile(f, total);
+  printSymbolProfile(f, total);
+  printCallGraph(f);
+}
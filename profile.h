@@ -0,0 +1,57 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <stdio.h>
+#include "instructions.h"
+#include "executable.h"
+
+#define PROFILE_TEXT 1
+#define PROFILE_COLLAPSED 2
+
+#define MAX_PROFILE_NODES 100000
+
+// A subprogram of the profiled program, known from the SYMBOLS section or
+// named after its address when the executable has none
+struct ProfileSymbol_ {
+  CodeAddress address;
+  char name[SYMBOL_NAME_LEN];
+  long long instructions;     // executed while it was the running subprogram
+  long long calls;
+};
+
+typedef struct ProfileSymbol_ ProfileSymbol;
+
+// Node of the calling context tree: one per distinct chain of calls
+struct ProfileNode_ {
+  int symbol;
+  struct ProfileNode_ *parent;
+  struct ProfileNode_ *children;
+  struct ProfileNode_ *sibling;
+  long long instructions;
+  long long calls;
+};
+
+typedef struct ProfileNode_ ProfileNode;
+
+void initProfile(SymbolEntry* symbols, int symbolCount, CodeAddress entryPoint);
+void cleanProfile(void);
+
+void profileCall(CodeAddress address);
+void profileReturn(void);
+
+void printProfile(FILE* f, int format);
+
+extern long long profileOpCodes[NUM_OF_OPCODES];
+extern ProfileNode* profileCurrent;
+
+// Called by the interpreter before each instruction
+#define PROFILE_INSTRUCTION(inst) \
+  do { profileOpCodes[(inst)->op] ++; profileCurrent->instructions ++; } while (0)
+
+#endif
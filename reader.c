@@ -6,32 +6,48 @@
 
 #include <stdio.h>
 #include "reader.h"
-
-FILE *inputStream;
-int lineNo, colNo;
-int currentChar;
+#include "compiler.h"
 
 int readChar(void) {
-  currentChar = getc(inputStream);
-  colNo ++;
-  if (currentChar == '\n') {
-    lineNo ++;
-    colNo = 0;
+  if (compiler->inputBuffer != NULL)
+    compiler->currentChar = (compiler->inputPos < compiler->inputSize) ?
+      (unsigned char) compiler->inputBuffer[compiler->inputPos ++] : EOF;
+  else compiler->currentChar = getc(compiler->inputStream);
+  compiler->colNo ++;
+  if (compiler->currentChar == '\n') {
+    compiler->lineNo ++;
+    compiler->colNo = 0;
   }
-  return currentChar;
+  return compiler->currentChar;
 }
 
 int openInputStream(char *fileName) {
-  inputStream = fopen(fileName, "rt");
-  if (inputStream == NULL)
+  compiler->inputBuffer = NULL;
+  compiler->inputStream = fopen(fileName, "rt");
+  if (compiler->inputStream == NULL)
     return IO_ERROR;
-  lineNo = 1;
-  colNo = 0;
+  compiler->lineNo = 1;
+  compiler->colNo = 0;
+  readChar();
+  return IO_SUCCESS;
+}
+
+// Reads the program from memory; the buffer must outlive the compilation
+int openInputBuffer(char *buffer, int size) {
+  compiler->inputStream = NULL;
+  compiler->inputBuffer = buffer;
+  compiler->inputSize = size;
+  compiler->inputPos = 0;
+  compiler->lineNo = 1;
+  compiler->colNo = 0;
   readChar();
   return IO_SUCCESS;
 }
 
 void closeInputStream() {
-  fclose(inputStream);
+  if (compiler->inputStream != NULL)
+    fclose(compiler->inputStream);
+  compiler->inputStream = NULL;
+  compiler->inputBuffer = NULL;
 }
 
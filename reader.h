@@ -12,6 +12,7 @@
 
 int readChar(void);
 int openInputStream(char *fileName);
+int openInputBuffer(char *buffer, int size);
 void closeInputStream(void);
 
 #endif
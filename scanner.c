@@ -13,25 +13,22 @@
 #include "token.h"
 #include "error.h"
 #include "scanner.h"
-
-
-extern int lineNo;
-extern int colNo;
-extern int currentChar;
+#include "compiler.h"
+#include "codegen.h"
 
 extern CharCode charCodes[];
 
 /***************************************************************/
 
 void skipBlank() {
-  while ((currentChar != EOF) && (charCodes[currentChar] == CHAR_SPACE))
+  while ((compiler->currentChar != EOF) && (charCodes[compiler->currentChar] == CHAR_SPACE))
     readChar();
 }
 
 void skipComment() {
   int state = 0;
-  while ((currentChar != EOF) && (state < 2)) {
-    switch (charCodes[currentChar]) {
+  while ((compiler->currentChar != EOF) && (state < 2)) {
+    switch (charCodes[compiler->currentChar]) {
     case CHAR_TIMES:
       state = 1;
       break;
@@ -45,24 +42,24 @@ void skipComment() {
     readChar();
   }
   if (state != 2) 
-    error(ERR_END_OF_COMMENT, lineNo, colNo);
+    reportError(ERR_END_OF_COMMENT, compiler->lineNo, compiler->colNo);
 }
 
 Token* readIdentKeyword(void) {
-  Token *token = makeToken(TK_NONE, lineNo, colNo);
+  Token *token = makeToken(TK_NONE, compiler->lineNo, compiler->colNo);
   int count = 1;
 
-  token->string[0] = toupper((char)currentChar);
+  token->string[0] = toupper((char)compiler->currentChar);
   readChar();
 
-  while ((currentChar != EOF) && 
-	 ((charCodes[currentChar] == CHAR_LETTER) || (charCodes[currentChar] == CHAR_DIGIT))) {
-    if (count <= MAX_IDENT_LEN) token->string[count++] = toupper((char)currentChar);
+  while ((compiler->currentChar != EOF) && 
+	 ((charCodes[compiler->currentChar] == CHAR_LETTER) || (charCodes[compiler->currentChar] == CHAR_DIGIT))) {
+    if (count <= MAX_IDENT_LEN) token->string[count++] = toupper((char)compiler->currentChar);
     readChar();
   }
 
   if (count > MAX_IDENT_LEN) {
-    error(ERR_IDENT_TOO_LONG, token->lineNo, token->colNo);
+    reportError(ERR_IDENT_TOO_LONG, token->lineNo, token->colNo);
     return token;
   }
 
@@ -76,11 +73,11 @@ Token* readIdentKeyword(void) {
 }
 
 Token* readNumber(void) {
-  Token *token = makeToken(TK_NUMBER, lineNo, colNo);
+  Token *token = makeToken(TK_NUMBER, compiler->lineNo, compiler->colNo);
   int count = 0;
 
-  while ((currentChar != EOF) && (charCodes[currentChar] == CHAR_DIGIT)) {
-    token->string[count++] = (char)currentChar;
+  while ((compiler->currentChar != EOF) && (charCodes[compiler->currentChar] == CHAR_DIGIT)) {
+    token->string[count++] = (char)compiler->currentChar;
     readChar();
   }
 
@@ -89,130 +86,137 @@ Token* readNumber(void) {
   return token;
 }
 
+// A quoted literal, with '' standing for a quote inside it. One character
+// is a TK_CHAR; anything else is a TK_STRING whose text goes to the constant
+// pool, token->value being its offset there (token->string keeps the start
+// of the text for printing).
 Token* readConstChar(void) {
-  Token *token = makeToken(TK_CHAR, lineNo, colNo);
-
-  readChar();
-  if (currentChar == EOF) {
-    token->tokenType = TK_NONE;
-    error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
-    return token;
-  }
-    
-  token->string[0] = currentChar;
-  token->string[1] = '\0';
-  token->value = currentChar;
+  Token *token = makeToken(TK_CHAR, compiler->lineNo, compiler->colNo);
+  int offset = beginStringConstant();
+  int count = 0;
 
   readChar();
-  if (currentChar == EOF) {
-    token->tokenType = TK_NONE;
-    error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
-    return token;
+  while (1) {
+    if ((compiler->currentChar == EOF) || (compiler->currentChar == '\n')) {
+      token->tokenType = TK_NONE;
+      reportError(ERR_END_OF_STRING, token->lineNo, token->colNo);
+      return token;
+    }
+    if (charCodes[compiler->currentChar] == CHAR_SINGLEQUOTE) {
+      readChar();
+      if ((compiler->currentChar == EOF) || (charCodes[compiler->currentChar] != CHAR_SINGLEQUOTE))
+	break;
+    }
+    appendStringConstant(offset, (char) compiler->currentChar);
+    if (count < MAX_IDENT_LEN) token->string[count] = compiler->currentChar;
+    count ++;
+    readChar();
   }
+  token->string[(count < MAX_IDENT_LEN) ? count : MAX_IDENT_LEN] = '\0';
 
-  if (charCodes[currentChar] == CHAR_SINGLEQUOTE) {
-    readChar();
-    return token;
+  if (count == 1) {
+    dropStringConstant(offset);
+    token->value = (unsigned char) token->string[0];
   } else {
-    token->tokenType = TK_NONE;
-    error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
-    return token;
+    token->tokenType = TK_STRING;
+    token->value = offset;
   }
+  return token;
 }
 
 Token* getToken(void) {
   Token *token;
   int ln, cn;
 
-  if (currentChar == EOF) 
-    return makeToken(TK_EOF, lineNo, colNo);
+  if (compiler->currentChar == EOF) 
+    return makeToken(TK_EOF, compiler->lineNo, compiler->colNo);
 
-  switch (charCodes[currentChar]) {
+  switch (charCodes[compiler->currentChar]) {
   case CHAR_SPACE: skipBlank(); return getToken();
   case CHAR_LETTER: return readIdentKeyword();
   case CHAR_DIGIT: return readNumber();
   case CHAR_PLUS: 
-    token = makeToken(SB_PLUS, lineNo, colNo);
+    token = makeToken(SB_PLUS, compiler->lineNo, compiler->colNo);
     readChar(); 
     return token;
   case CHAR_MINUS:
-    token = makeToken(SB_MINUS, lineNo, colNo);
+    token = makeToken(SB_MINUS, compiler->lineNo, compiler->colNo);
     readChar(); 
     return token;
   case CHAR_TIMES:
-    token = makeToken(SB_TIMES, lineNo, colNo);
+    token = makeToken(SB_TIMES, compiler->lineNo, compiler->colNo);
     readChar(); 
     return token;
   case CHAR_SLASH:
-    token = makeToken(SB_SLASH, lineNo, colNo);
+    token = makeToken(SB_SLASH, compiler->lineNo, compiler->colNo);
     readChar(); 
     return token;
   case CHAR_LT:
-    ln = lineNo;
-    cn = colNo;
+    ln = compiler->lineNo;
+    cn = compiler->colNo;
     readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
+    if ((compiler->currentChar != EOF) && (charCodes[compiler->currentChar] == CHAR_EQ)) {
       readChar();
       return makeToken(SB_LE, ln, cn);
     } else return makeToken(SB_LT, ln, cn);
   case CHAR_GT:
-    ln = lineNo;
-    cn = colNo;
+    ln = compiler->lineNo;
+    cn = compiler->colNo;
     readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
+    if ((compiler->currentChar != EOF) && (charCodes[compiler->currentChar] == CHAR_EQ)) {
       readChar();
       return makeToken(SB_GE, ln, cn);
     } else return makeToken(SB_GT, ln, cn);
   case CHAR_EQ: 
-    token = makeToken(SB_EQ, lineNo, colNo);
+    token = makeToken(SB_EQ, compiler->lineNo, compiler->colNo);
     readChar(); 
     return token;
   case CHAR_EXCLAIMATION:
-    ln = lineNo;
-    cn = colNo;
+    ln = compiler->lineNo;
+    cn = compiler->colNo;
     readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
+    if ((compiler->currentChar != EOF) && (charCodes[compiler->currentChar] == CHAR_EQ)) {
       readChar();
       return makeToken(SB_NEQ, ln, cn);
     } else {
       token = makeToken(TK_NONE, ln, cn);
-      error(ERR_INVALID_SYMBOL, ln, cn);
+      reportError(ERR_INVALID_SYMBOL, ln, cn);
       return token;
     }
   case CHAR_COMMA:
-    token = makeToken(SB_COMMA, lineNo, colNo);
+    token = makeToken(SB_COMMA, compiler->lineNo, compiler->colNo);
     readChar(); 
     return token;
   case CHAR_PERIOD:
-    ln = lineNo;
-    cn = colNo;
+    ln = compiler->lineNo;
+    cn = compiler->colNo;
     readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_RPAR)) {
+    if ((compiler->currentChar != EOF) && (charCodes[compiler->currentChar] == CHAR_RPAR)) {
       readChar();
       return makeToken(SB_RSEL, ln, cn);
     } else return makeToken(SB_PERIOD, ln, cn);
   case CHAR_SEMICOLON:
-    token = makeToken(SB_SEMICOLON, lineNo, colNo);
+    token = makeToken(SB_SEMICOLON, compiler->lineNo, compiler->colNo);
     readChar(); 
     return token;
   case CHAR_COLON:
-    ln = lineNo;
-    cn = colNo;
+    ln = compiler->lineNo;
+    cn = compiler->colNo;
     readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
+    if ((compiler->currentChar != EOF) && (charCodes[compiler->currentChar] == CHAR_EQ)) {
       readChar();
       return makeToken(SB_ASSIGN, ln, cn);
     } else return makeToken(SB_COLON, ln, cn);
   case CHAR_SINGLEQUOTE: return readConstChar();
   case CHAR_LPAR:
-    ln = lineNo;
-    cn = colNo;
+    ln = compiler->lineNo;
+    cn = compiler->colNo;
     readChar();
 
-    if (currentChar == EOF) 
+    if (compiler->currentChar == EOF) 
       return makeToken(SB_LPAR, ln, cn);
 
-    switch (charCodes[currentChar]) {
+    switch (charCodes[compiler->currentChar]) {
     case CHAR_PERIOD:
       readChar();
       return makeToken(SB_LSEL, ln, cn);
@@ -224,23 +228,35 @@ Token* getToken(void) {
       return makeToken(SB_LPAR, ln, cn);
     }
   case CHAR_RPAR:
-    token = makeToken(SB_RPAR, lineNo, colNo);
+    token = makeToken(SB_RPAR, compiler->lineNo, compiler->colNo);
     readChar(); 
     return token;
   default:
-    token = makeToken(TK_NONE, lineNo, colNo);
-    error(ERR_INVALID_SYMBOL, lineNo, colNo);
+    token = makeToken(TK_NONE, compiler->lineNo, compiler->colNo);
+    reportError(ERR_INVALID_SYMBOL, compiler->lineNo, compiler->colNo);
     readChar(); 
     return token;
   }
 }
 
+// With -stats the first SCAN_SAMPLE calls and then one in SCAN_SAMPLE are
+// timed, reading characters included; endScanAndParse scales the samples
+// to the whole scan
 Token* getValidToken(void) {
-  Token *token = getToken();
+  Stats* stats = compiler->stats;
+  int sample = (stats != NULL) && ((stats->tokens < SCAN_SAMPLE) || ((stats->tokens % SCAN_SAMPLE) == 0));
+  double wall, cpu;
+  Token *token;
+
+  if (sample) startPhase(&wall, &cpu);
+  token = getToken();
+  COUNT(tokens);
   while (token->tokenType == TK_NONE) {
     free(token);
     token = getToken();
+    COUNT(tokens);
   }
+  if (sample) endScanSample(stats, wall, cpu);
   return token;
 }
 
@@ -256,6 +272,7 @@ void printToken(Token *token) {
   case TK_IDENT: printf("TK_IDENT(%s)\n", token->string); break;
   case TK_NUMBER: printf("TK_NUMBER(%s)\n", token->string); break;
   case TK_CHAR: printf("TK_CHAR(\'%s\')\n", token->string); break;
+  case TK_STRING: printf("TK_STRING(\'%s\')\n", token->string); break;
   case TK_EOF: printf("TK_EOF\n"); break;
 
   case KW_PROGRAM: printf("KW_PROGRAM\n"); break;
@@ -278,6 +295,10 @@ void printToken(Token *token) {
   case KW_DO: printf("KW_DO\n"); break;
   case KW_FOR: printf("KW_FOR\n"); break;
   case KW_TO: printf("KW_TO\n"); break;
+  case KW_STRING: printf("KW_STRING\n"); break;
+  case KW_BYTES: printf("KW_BYTES\n"); break;
+  case KW_PARALLEL: printf("KW_PARALLEL\n"); break;
+  case KW_REDUCE: printf("KW_REDUCE\n"); break;
 
   case SB_SEMICOLON: printf("SB_SEMICOLON\n"); break;
   case SB_COLON: printf("SB_COLON\n"); break;
@@ -9,33 +9,32 @@
 #include "debug.h"
 #include "semantics.h"
 #include "error.h"
-
-extern SymTab* symtab;
-extern Token* currentToken;
+#include "compiler.h"
 
 Object* lookupObject(char *name) {
-  Scope* scope = symtab->currentScope;
+  Scope* scope = compiler->symtab->currentScope;
   Object* obj;
 
+  COUNT(lookups);
   while (scope != NULL) {
     obj = findObject(scope->objList, name);
     if (obj != NULL) return obj;
     scope = scope->outer;
   }
-  obj = findObject(symtab->globalObjectList, name);
+  obj = findObject(compiler->symtab->globalObjectList, name);
   if (obj != NULL) return obj;
   return NULL;
 }
 
 void checkFreshIdent(char *name) {
-  if (findObject(symtab->currentScope->objList, name) != NULL)
-    error(ERR_DUPLICATE_IDENT, currentToken->lineNo, currentToken->colNo);
+  if (findObject(compiler->symtab->currentScope->objList, name) != NULL)
+    error(ERR_DUPLICATE_IDENT, compiler->currentToken->lineNo, compiler->currentToken->colNo);
 }
 
 Object* checkDeclaredIdent(char* name) {
   Object* obj = lookupObject(name);
   if (obj == NULL) {
-    error(ERR_UNDECLARED_IDENT,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_IDENT,compiler->currentToken->lineNo, compiler->currentToken->colNo);
   }
   return obj;
 }
@@ -43,9 +42,9 @@ Object* checkDeclaredIdent(char* name) {
 Object* checkDeclaredConstant(char* name) {
   Object* obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_CONSTANT,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_CONSTANT,compiler->currentToken->lineNo, compiler->currentToken->colNo);
   if (obj->kind != OBJ_CONSTANT)
-    error(ERR_INVALID_CONSTANT,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_CONSTANT,compiler->currentToken->lineNo, compiler->currentToken->colNo);
 
   return obj;
 }
@@ -53,9 +52,9 @@ Object* checkDeclaredConstant(char* name) {
 Object* checkDeclaredType(char* name) {
   Object* obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_TYPE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_TYPE,compiler->currentToken->lineNo, compiler->currentToken->colNo);
   if (obj->kind != OBJ_TYPE)
-    error(ERR_INVALID_TYPE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_TYPE,compiler->currentToken->lineNo, compiler->currentToken->colNo);
 
   return obj;
 }
@@ -63,9 +62,9 @@ Object* checkDeclaredType(char* name) {
 Object* checkDeclaredVariable(char* name) {
   Object* obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_VARIABLE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_VARIABLE,compiler->currentToken->lineNo, compiler->currentToken->colNo);
   if (obj->kind != OBJ_VARIABLE)
-    error(ERR_INVALID_VARIABLE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_VARIABLE,compiler->currentToken->lineNo, compiler->currentToken->colNo);
 
   return obj;
 }
@@ -73,9 +72,9 @@ Object* checkDeclaredVariable(char* name) {
 Object* checkDeclaredFunction(char* name) {
   Object* obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_FUNCTION,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_FUNCTION,compiler->currentToken->lineNo, compiler->currentToken->colNo);
   if (obj->kind != OBJ_FUNCTION)
-    error(ERR_INVALID_FUNCTION,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_FUNCTION,compiler->currentToken->lineNo, compiler->currentToken->colNo);
 
   return obj;
 }
@@ -83,9 +82,9 @@ Object* checkDeclaredFunction(char* name) {
 Object* checkDeclaredProcedure(char* name) {
   Object* obj = lookupObject(name);
   if (obj == NULL) 
-    error(ERR_UNDECLARED_PROCEDURE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_PROCEDURE,compiler->currentToken->lineNo, compiler->currentToken->colNo);
   if (obj->kind != OBJ_PROCEDURE)
-    error(ERR_INVALID_PROCEDURE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_PROCEDURE,compiler->currentToken->lineNo, compiler->currentToken->colNo);
 
   return obj;
 }
@@ -95,22 +94,22 @@ Object* checkDeclaredLValueIdent(char* name) {
   Scope* scope;
 
   if (obj == NULL)
-    error(ERR_UNDECLARED_IDENT,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_IDENT,compiler->currentToken->lineNo, compiler->currentToken->colNo);
 
   switch (obj->kind) {
   case OBJ_VARIABLE:
   case OBJ_PARAMETER:
     break;
   case OBJ_FUNCTION:
-    scope = symtab->currentScope;
+    scope = compiler->symtab->currentScope;
     while ((scope != NULL) && (scope != obj->funcAttrs->scope)) 
       scope = scope->outer;
 
     if (scope == NULL)
-      error(ERR_INVALID_IDENT,currentToken->lineNo, currentToken->colNo);
+      error(ERR_INVALID_IDENT,compiler->currentToken->lineNo, compiler->currentToken->colNo);
     break;
   default:
-    error(ERR_INVALID_IDENT,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_IDENT,compiler->currentToken->lineNo, compiler->currentToken->colNo);
   }
 
   return obj;
@@ -120,30 +119,154 @@ Object* checkDeclaredLValueIdent(char* name) {
 void checkIntType(Type* type) {
   if ((type != NULL) && (type->typeClass == TP_INT))
     return;
-  else error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+  else error(ERR_TYPE_INCONSISTENCY, compiler->currentToken->lineNo, compiler->currentToken->colNo);
 }
 
 void checkCharType(Type* type) {
   if ((type != NULL) && (type->typeClass == TP_CHAR))
     return;
-  else error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+  else error(ERR_TYPE_INCONSISTENCY, compiler->currentToken->lineNo, compiler->currentToken->colNo);
 }
 
 void checkBasicType(Type* type) {
   if ((type != NULL) && ((type->typeClass == TP_INT) || (type->typeClass == TP_CHAR)))
     return;
-  else error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+  else error(ERR_TYPE_INCONSISTENCY, compiler->currentToken->lineNo, compiler->currentToken->colNo);
 }
 
 void checkArrayType(Type* type) {
   if ((type != NULL) && (type->typeClass == TP_ARRAY))
     return;
-  else error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+  else error(ERR_TYPE_INCONSISTENCY, compiler->currentToken->lineNo, compiler->currentToken->colNo);
 }
 
 void checkTypeEquality(Type* type1, Type* type2) {
   if (compareType(type1, type2) == 0)
-    error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+    error(ERR_TYPE_INCONSISTENCY, compiler->currentToken->lineNo, compiler->currentToken->colNo);
+}
+
+// A STRING can be assigned to or compared with a STRING of any capacity,
+// and a BYTES with a BYTES
+void checkPackedType(Type* type1, Type* type2) {
+  if ((type1 != NULL) && (type2 != NULL) && (type1->typeClass == TP_PACKED) &&
+      (type2->typeClass == TP_PACKED) && (type1->elementType == type2->elementType))
+    return;
+  else error(ERR_TYPE_INCONSISTENCY, compiler->currentToken->lineNo, compiler->currentToken->colNo);
 }
 
+// An open array parameter takes any array of its element type, an open
+// STRING or BYTES parameter any buffer of its kind (or either kind when it
+// has no element type, as for LENGTH); otherwise the sizes must match as well
+void checkArrayArgument(Type* paramType, Type* argType) {
+  if (paramType->typeClass == TP_PACKED) {
+    if (paramType->elementType == NULL) {
+      if ((argType == NULL) || (argType->typeClass != TP_PACKED))
+	error(ERR_TYPE_INCONSISTENCY, compiler->currentToken->lineNo, compiler->currentToken->colNo);
+    } else if (paramType->arraySize == OPEN_ARRAY_SIZE)
+      checkPackedType(paramType, argType);
+    else checkTypeEquality(paramType, argType);
+    return;
+  }
+  checkArrayType(argType);
+  if (paramType->arraySize == OPEN_ARRAY_SIZE)
+    checkTypeEquality(paramType->elementType, argType->elementType);
+  else checkTypeEquality(paramType, argType);
+}
+
+
+
+// Workers of a PARALLEL FOR run its body at the same time: it must not do
+// input or output, and may only assign the loop's own variables (those of
+// compiler->parallelScope) or elements of arrays. Both are also recorded
+// in the scope of the subprogram being compiled, since the same holds for
+// the subprograms the body calls (checkParallelCalls).
+void checkParallelIO(void) {
+  compiler->symtab->currentScope->doesIO = 1;
+  if (compiler->parallelScope != NULL)
+    error(ERR_PARALLEL_IO, compiler->currentToken->lineNo, compiler->currentToken->colNo);
+}
+
+void checkParallelLValue(Object* var, Type* lvalueType) {
+  Scope* current = compiler->symtab->currentScope;
+  Scope* scope = NULL;
+  Type* type = NULL;
+  int shared;
+
+  if (var->kind == OBJ_VARIABLE) {
+    scope = var->varAttrs->scope;
+    type = var->varAttrs->type;
+  } else if (var->kind == OBJ_PARAMETER) {
+    scope = var->paramAttrs->scope;
+    type = var->paramAttrs->type;
+  } else if (var->kind == OBJ_FUNCTION)
+    scope = var->funcAttrs->scope;
 
+  // anything but an element of an array
+  shared = (type == NULL) || (type->typeClass != TP_ARRAY) || (lvalueType == type);
+  if (shared && (scope != NULL) && (scope->level < current->writesLevel))
+    current->writesLevel = scope->level;
+
+  if (compiler->parallelScope == NULL) return;
+  if ((var->kind == OBJ_VARIABLE) && (scope == compiler->parallelScope)) return;
+  if (shared)
+    error(ERR_PARALLEL_ASSIGNMENT, compiler->currentToken->lineNo, compiler->currentToken->colNo);
+}
+
+// A call of a user procedure or function, at the current token
+void checkParallelCall(Object* subprogram) {
+  SubprogramCall* calls;
+  SubprogramCall* call;
+  int capacity;
+
+  if (compiler->callCount == compiler->callCapacity) {
+    capacity = (compiler->callCapacity == 0) ? 16 : compiler->callCapacity * 2;
+    calls = (SubprogramCall*) realloc(compiler->calls, capacity * sizeof(SubprogramCall));
+    if (calls == NULL) {
+      compiler->outOfMemory = 1;
+      return;
+    }
+    compiler->calls = calls;
+    compiler->callCapacity = capacity;
+  }
+  call = compiler->calls + compiler->callCount ++;
+  call->caller = compiler->symtab->currentScope;
+  call->callee = (subprogram->kind == OBJ_FUNCTION) ? subprogram->funcAttrs->scope : subprogram->procAttrs->scope;
+  call->parallel = (compiler->parallelScope != NULL);
+  call->lineNo = compiler->currentToken->lineNo;
+  call->colNo = compiler->currentToken->colNo;
+}
+
+// Once every subprogram is compiled: a caller takes on the input, output
+// and outside assignments of its callees, then the calls inside a PARALLEL
+// FOR of subprograms that have any of them are reported
+void checkParallelCalls(void) {
+  SubprogramCall* call;
+  int i, changed = 1;
+
+  while (changed) {
+    changed = 0;
+    for (i = 0; i < compiler->callCount; i ++) {
+      call = compiler->calls + i;
+      if (call->callee->doesIO && !call->caller->doesIO) {
+	call->caller->doesIO = 1;
+	changed = 1;
+      }
+      // the variables a callee assigns outside its frame are visible, so
+      // outside the frame of its caller or in it
+      if ((call->callee->writesLevel < call->callee->level) &&
+	  (call->callee->writesLevel < call->caller->writesLevel)) {
+	call->caller->writesLevel = call->callee->writesLevel;
+	changed = 1;
+      }
+    }
+  }
+
+  for (i = 0; i < compiler->callCount; i ++) {
+    call = compiler->calls + i;
+    if (!call->parallel) continue;
+    if (call->callee->doesIO)
+      reportError(ERR_PARALLEL_IO, call->lineNo, call->colNo);
+    else if (call->callee->writesLevel < call->callee->level)
+      reportError(ERR_PARALLEL_CALL, call->lineNo, call->colNo);
+  }
+}
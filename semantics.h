@@ -23,5 +23,11 @@ void checkCharType(Type* type);
 void checkArrayType(Type* type);
 void checkBasicType(Type* type);
 void checkTypeEquality(Type* type1, Type* type2);
+void checkPackedType(Type* type1, Type* type2);
+void checkArrayArgument(Type* paramType, Type* argType);
+void checkParallelIO(void);
+void checkParallelLValue(Object* var, Type* lvalueType);
+void checkParallelCall(Object* subprogram);
+void checkParallelCalls(void);
 
 #endif
@@ -0,0 +1,199 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+Stats* createStats(void) {
+  Stats* stats = (Stats*) malloc(sizeof(Stats));
+  memset(stats, 0, sizeof(Stats));
+  return stats;
+}
+
+void freeStats(Stats* stats) {
+  free(stats);
+}
+
+// Wall time and CPU time of the calling thread, in seconds
+void readClocks(double* wall, double* cpu) {
+#if defined(CLOCK_MONOTONIC) && defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  *wall = ts.tv_sec + ts.tv_nsec * 1e-9;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  *cpu = ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+  *wall = (double) time(NULL);
+  *cpu = (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+// Peak resident set size of the whole process in KB, 0 when unknown
+long readPeakMemory(void) {
+#ifndef _WIN32
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+  return 0;
+}
+
+void startPhase(double* wall, double* cpu) {
+  readClocks(wall, cpu);
+}
+
+// Adds the time since startPhase to phase
+void endPhase(Stats* stats, enum Phase phase, double wall, double cpu) {
+  double w, c;
+
+  readClocks(&w, &c);
+  stats->wall[phase] += w - wall;
+  stats->cpu[phase] += c - cpu;
+}
+
+// Adds the time since startPhase to the sampled scanning time
+void endScanSample(Stats* stats, double wall, double cpu) {
+  double w, c;
+
+  readClocks(&w, &c);
+  stats->scanWall += w - wall;
+  stats->scanCpu += c - cpu;
+  stats->scanSamples ++;
+}
+
+// Time a sample spends reading the clocks: the least of a few empty samples
+void clockCost(double* wall, double* cpu) {
+  double w0, c0, w1, c1;
+  int i;
+
+  *wall = *cpu = 1.0;
+  for (i = 0; i < 8; i ++) {
+    readClocks(&w0, &c0);
+    readClocks(&w1, &c1);
+    if (w1 - w0 < *wall) *wall = w1 - w0;
+    if (c1 - c0 < *cpu) *cpu = c1 - c0;
+  }
+}
+
+// Scanning and parsing take turns: the time since (*wall, *cpu) is split
+// between them. The scanner gets the time of the sampled tokens, less the
+// cost of reading the clocks, scaled to all the tokens and never more than
+// the whole interval; the parser gets the rest. (*wall, *cpu) is moved to
+// the end of the interval.
+void endScanAndParse(Stats* stats, double* wall, double* cpu) {
+  double w, c, scale = 0.0, scanWall, scanCpu, clockWall, clockCpu;
+
+  clockCost(&clockWall, &clockCpu);
+  readClocks(&w, &c);
+  if (stats->scanSamples > 0)
+    scale = (double) stats->tokens / stats->scanSamples;
+  scanWall = (stats->scanWall - stats->scanSamples * clockWall) * scale;
+  scanCpu = (stats->scanCpu - stats->scanSamples * clockCpu) * scale;
+  if (scanWall < 0.0) scanWall = 0.0;
+  if (scanCpu < 0.0) scanCpu = 0.0;
+  if (scanWall > w - *wall) scanWall = w - *wall;
+  if (scanCpu > c - *cpu) scanCpu = c - *cpu;
+  stats->wall[PHASE_SCAN] += scanWall;
+  stats->cpu[PHASE_SCAN] += scanCpu;
+  stats->wall[PHASE_PARSE] += (w - *wall) - scanWall;
+  stats->cpu[PHASE_PARSE] += (c - *cpu) - scanCpu;
+  *wall = w;
+  *cpu = c;
+}
+
+// The code buffer starts with initSize instructions and doubles when full
+void collectCodeStats(Stats* stats, CodeBlock* codeBlock, int initSize) {
+  int i, size;
+
+  for (i = 0; i < codeBlock->codeSize; i ++)
+    if ((codeBlock->code[i].op >= 0) && (codeBlock->code[i].op < NUM_OF_OPCODES))
+      stats->opCodes[codeBlock->code[i].op] ++;
+  stats->codeSize = codeBlock->codeSize;
+  stats->codeCapacity = codeBlock->maxSize;
+  stats->codeAllocs = 1;
+  for (size = initSize; size < codeBlock->maxSize; size *= 2)
+    stats->codeAllocs ++;
+}
+
+char* phaseNames[NUM_OF_PHASES] = { "scan", "parse+semantic+codegen", "serialize", "total" };
+
+void printStatsText(Stats* stats, char* fileName) {
+  int i;
+
+  if (fileName != NULL) printf("Statistics for %s\n", fileName);
+  printf("  %-24s %12s %12s\n", "phase", "wall (ms)", "cpu (ms)");
+  for (i = 0; i < NUM_OF_PHASES; i ++)
+    printf("  %-24s %12.3f %12.3f\n", phaseNames[i], stats->wall[i] * 1e3, stats->cpu[i] * 1e3);
+  printf("  tokens: %ld\n", stats->tokens);
+  printf("  lookupObject calls: %ld, list nodes visited: %ld\n", stats->lookups, stats->nodesVisited);
+  printf("  malloc: tokens %ld, arena blocks %ld (%lu bytes for %ld symbol table records), code buffer %ld\n",
+	 stats->tokenAllocs, stats->arenaBlocks, (unsigned long) stats->arenaBytes, stats->symbolAllocs, stats->codeAllocs);
+  printf("  code: %d instructions, buffer capacity %d\n", stats->codeSize, stats->codeCapacity);
+  printf("  optimizer: %ld computations reused, %ld frame words saved, %ld loops vectorized\n",
+	 stats->valuesReused, stats->frameWordsSaved, stats->loopsVectorized);
+  printf("  peak memory: %ld KB\n", stats->peakMemory);
+  for (i = 0; i < NUM_OF_OPCODES; i ++)
+    if (stats->opCodes[i] > 0)
+      printf("    %-5s %ld\n", opCodeName((enum OpCode) i), stats->opCodes[i]);
+}
+
+void printJsonString(char* s) {
+  putchar('"');
+  for (; *s != '\0'; s ++) {
+    if ((*s == '"') || (*s == '\\')) putchar('\\');
+    putchar(*s);
+  }
+  putchar('"');
+}
+
+void printStatsJson(Stats* stats, char* fileName) {
+  int i, first = 1;
+
+  printf("{");
+  if (fileName != NULL) {
+    printf("\"file\": ");
+    printJsonString(fileName);
+    printf(", ");
+  }
+  printf("\"phases\": {");
+  for (i = 0; i < NUM_OF_PHASES; i ++)
+    printf("%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", (i > 0) ? ", " : "",
+	   phaseNames[i], stats->wall[i] * 1e3, stats->cpu[i] * 1e3);
+  printf("}, \"tokens\": %ld, \"lookups\": %ld, \"nodes_visited\": %ld", 
+	 stats->tokens, stats->lookups, stats->nodesVisited);
+  printf(", \"malloc\": {\"tokens\": %ld, \"arena_blocks\": %ld, \"code_buffer\": %ld}",
+	 stats->tokenAllocs, stats->arenaBlocks, stats->codeAllocs);
+  printf(", \"symbol_records\": %ld, \"arena_bytes\": %lu", stats->symbolAllocs, (unsigned long) stats->arenaBytes);
+  printf(", \"peak_rss_kb\": %ld", stats->peakMemory);
+  printf(", \"values_reused\": %ld, \"frame_words_saved\": %ld, \"loops_vectorized\": %ld",
+	 stats->valuesReused, stats->frameWordsSaved, stats->loopsVectorized);
+  printf(", \"code_size\": %d, \"code_capacity\": %d, \"opcodes\": {", stats->codeSize, stats->codeCapacity);
+  for (i = 0; i < NUM_OF_OPCODES; i ++)
+    if (stats->opCodes[i] > 0) {
+      printf("%s\"%s\": %ld", first ? "" : ", ", opCodeName((enum OpCode) i), stats->opCodes[i]);
+      first = 0;
+    }
+  printf("}}\n");
+}
+
+void printStats(Stats* stats, char* fileName, int format) {
+  if (format == STATS_JSON)
+    printStatsJson(stats, fileName);
+  else printStatsText(stats, fileName);
+}
@@ -0,0 +1,74 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include "instructions.h"
+
+// Compile phases. The compiler is single pass: code is generated while
+// parsing, so parsing, semantic checks and code generation share a phase.
+enum Phase {
+  PHASE_SCAN,        // reading characters and building tokens
+  PHASE_PARSE,       // parsing, semantic checks and code generation
+  PHASE_SERIALIZE,   // writing the output
+  PHASE_TOTAL,
+  NUM_OF_PHASES
+};
+
+// Past the first SCAN_SAMPLE tokens getValidToken times one in SCAN_SAMPLE:
+// reading the clocks around every token would cost more than scanning it
+#define SCAN_SAMPLE 64
+
+#define STATS_TEXT 1
+#define STATS_JSON 2
+
+struct Stats_ {
+  double wall[NUM_OF_PHASES];   // seconds
+  double cpu[NUM_OF_PHASES];
+
+  long tokens;                  // tokens made by getToken
+  long scanSamples;             // tokens timed by getValidToken
+  double scanWall, scanCpu;     // time spent scanning them
+  long lookups;                 // lookupObject calls
+  long nodesVisited;            // object list nodes visited by findObject
+
+  long tokenAllocs;             // malloc by category
+  long symbolAllocs;            // arena allocations for the symbol table
+  long arenaBlocks;             // malloc made by the arena
+  size_t arenaBytes;
+  long codeAllocs;              // code buffer allocation and regrowths
+
+  long valuesReused;            // computations replaced by a saved value (optimizeCode)
+  long frameWordsSaved;         // words taken off the stack frames (compactFrames)
+  long loopsVectorized;         // FOR loops run by a vector instruction (genLoopIdiom)
+
+  long opCodes[NUM_OF_OPCODES]; // instructions emitted, by opcode
+  int codeSize;
+  int codeCapacity;
+
+  long peakMemory;              // peak resident set of the process, in KB
+};
+
+typedef struct Stats_ Stats;
+
+// Counters cost one test when -stats is off
+#define COUNT(counter) do { if (compiler->stats != NULL) compiler->stats->counter ++; } while (0)
+
+Stats* createStats(void);
+void freeStats(Stats* stats);
+
+void readClocks(double* wall, double* cpu);
+long readPeakMemory(void);
+void startPhase(double* wall, double* cpu);
+void endPhase(Stats* stats, enum Phase phase, double wall, double cpu);
+void endScanSample(Stats* stats, double wall, double cpu);
+void endScanAndParse(Stats* stats, double* wall, double* cpu);
+
+void collectCodeStats(Stats* stats, CodeBlock* codeBlock, int initSize);
+void printStats(Stats* stats, char* fileName, int format);
+
+#endif
@@ -11,74 +11,80 @@
 #include "symtab.h"
 #include "error.h"
 #include "codegen.h"
-
-void freeObject(Object* obj);
-void freeScope(Scope* scope);
-void freeObjectList(ObjectNode *objList);
-void freeReferenceList(ObjectNode *objList);
-
-SymTab* symtab;
-Type* intType;
-Type* charType;
-Object* writeiProcedure;
-Object* writecProcedure;
-Object* writelnProcedure;
-Object* readiFunction;
-Object* readcFunction;
+#include "arena.h"
+#include "compiler.h"
+
+// Every object, attribute record, scope, list node, type and constant of a
+// compilation lives in compiler->symArena; cleanSymTab releases all of it
+// at once. NEW never returns NULL: when the arena can not grow the
+// compilation stops with an out of memory error.
+#define NEW(T) ((T*) symbolAlloc(sizeof(T)))
+#define OBJECT_ATTRS(obj) ((void*) ((obj) + 1))
+
+void* symbolAlloc(size_t size) {
+  void* p;
+
+  COUNT(symbolAllocs);
+  p = arenaAlloc(compiler->symArena, size);
+  if (p == NULL) outOfMemory();
+  return p;
+}
 
 /******************* Type utilities ******************************/
 
-Type* makeIntType(void) {
-  Type* type = (Type*) malloc(sizeof(Type));
-  type->typeClass = TP_INT;
+// Types are hash-consed through compiler->typeTable: there is exactly one
+// Type per distinct shape, so types are shared instead of copied and
+// compared by pointer.
+#define ARRAY_TYPE_HASH(size, elem) \
+  ((((unsigned long) (size)) * 31u + (((unsigned long) (elem)) >> 3)) % TYPE_TABLE_SIZE)
+
+Type* makeBasicType(enum TypeClass typeClass) {
+  Type* type = NEW(Type);
+  type->typeClass = typeClass;
+  type->arraySize = 0;
+  type->elementType = NULL;
+  type->next = NULL;
   return type;
 }
 
+Type* makeIntType(void) {
+  return compiler->intType;
+}
+
 Type* makeCharType(void) {
-  Type* type = (Type*) malloc(sizeof(Type));
-  type->typeClass = TP_CHAR;
-  return type;
+  return compiler->charType;
 }
 
-Type* makeArrayType(int arraySize, Type* elementType) {
-  Type* type = (Type*) malloc(sizeof(Type));
-  type->typeClass = TP_ARRAY;
-  type->arraySize = arraySize;
+Type* makeCompositeType(enum TypeClass typeClass, int size, Type* elementType) {
+  unsigned long h = ARRAY_TYPE_HASH(size, elementType);
+  Type* type = compiler->typeTable[h];
+
+  while (type != NULL) {
+    if ((type->typeClass == typeClass) && (type->arraySize == size) && (type->elementType == elementType))
+      return type;
+    type = type->next;
+  }
+
+  type = NEW(Type);
+  type->typeClass = typeClass;
+  type->arraySize = size;
   type->elementType = elementType;
+  type->next = compiler->typeTable[h];
+  compiler->typeTable[h] = type;
   return type;
 }
 
-Type* duplicateType(Type* type) {
-  Type* resultType = (Type*) malloc(sizeof(Type));
-  resultType->typeClass = type->typeClass;
-  if (type->typeClass == TP_ARRAY) {
-    resultType->arraySize = type->arraySize;
-    resultType->elementType = duplicateType(type->elementType);
-  }
-  return resultType;
+Type* makeArrayType(int arraySize, Type* elementType) {
+  return makeCompositeType(TP_ARRAY, arraySize, elementType);
 }
 
-int compareType(Type* type1, Type* type2) {
-  if (type1->typeClass == type2->typeClass) {
-    if (type1->typeClass == TP_ARRAY) {
-      if (type1->arraySize == type2->arraySize)
-	return compareType(type1->elementType, type2->elementType);
-      else return 0;
-    } else return 1;
-  } else return 0;
+// A STRING or BYTES buffer; the arraySize of the type is its capacity in bytes
+Type* makePackedType(int capacity, Type* elementType) {
+  return makeCompositeType(TP_PACKED, capacity, elementType);
 }
 
-void freeType(Type* type) {
-  switch (type->typeClass) {
-  case TP_INT:
-  case TP_CHAR:
-    free(type);
-    break;
-  case TP_ARRAY:
-    freeType(type->elementType);
-    freeType(type);
-    break;
-  }
+int compareType(Type* type1, Type* type2) {
+  return type1 == type2;
 }
 
 int sizeOfType(Type* type) {
@@ -89,6 +95,8 @@ int sizeOfType(Type* type) {
     return CHAR_SIZE;
   case TP_ARRAY:
     return (type->arraySize * sizeOfType(type->elementType));
+  case TP_PACKED:
+    return PACKED_WORDS(type->arraySize);
   }
   return 0;
 }
@@ -96,21 +104,21 @@ int sizeOfType(Type* type) {
 /******************* Constant utility ******************************/
 
 ConstantValue* makeIntConstant(int i) {
-  ConstantValue* value = (ConstantValue*) malloc(sizeof(ConstantValue));
+  ConstantValue* value = NEW(ConstantValue);
   value->type = TP_INT;
   value->intValue = i;
   return value;
 }
 
 ConstantValue* makeCharConstant(char ch) {
-  ConstantValue* value = (ConstantValue*) malloc(sizeof(ConstantValue));
+  ConstantValue* value = NEW(ConstantValue);
   value->type = TP_CHAR;
   value->charValue = ch;
   return value;
 }
 
 ConstantValue* duplicateConstantValue(ConstantValue* v) {
-  ConstantValue* value = (ConstantValue*) malloc(sizeof(ConstantValue));
+  ConstantValue* value = NEW(ConstantValue);
   value->type = v->type;
   if (v->type == TP_INT) 
     value->intValue = v->intValue;
@@ -121,48 +129,56 @@ ConstantValue* duplicateConstantValue(ConstantValue* v) {
 
 /******************* Object utilities ******************************/
 
+// The attribute record is placed right after its object in the arena
+Object* allocObject(size_t attrsSize) {
+  return (Object*) symbolAlloc(sizeof(Object) + attrsSize);
+}
+
 Scope* createScope(Object* owner) {
-  Scope* scope = (Scope*) malloc(sizeof(Scope));
+  Scope* scope = NEW(Scope);
   scope->objList = NULL;
   scope->owner = owner;
   scope->outer = NULL;
   scope->frameSize = RESERVED_WORDS;
+  scope->level = 0;
+  scope->doesIO = 0;
+  scope->writesLevel = 0;
   return scope;
 }
 
 Object* createProgramObject(char *programName) {
-  Object* program = (Object*) malloc(sizeof(Object));
+  Object* program = allocObject(sizeof(ProgramAttributes));
   strcpy(program->name, programName);
   program->kind = OBJ_PROGRAM;
-  program->progAttrs = (ProgramAttributes*) malloc(sizeof(ProgramAttributes));
+  program->progAttrs = (ProgramAttributes*) OBJECT_ATTRS(program);
   program->progAttrs->scope = createScope(program);
   program->progAttrs->codeAddress = DC_VALUE;
-  symtab->program = program;
+  compiler->symtab->program = program;
 
   return program;
 }
 
 Object* createConstantObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
+  Object* obj = allocObject(sizeof(ConstantAttributes));
   strcpy(obj->name, name);
   obj->kind = OBJ_CONSTANT;
-  obj->constAttrs = (ConstantAttributes*) malloc(sizeof(ConstantAttributes));
+  obj->constAttrs = (ConstantAttributes*) OBJECT_ATTRS(obj);
   return obj;
 }
 
 Object* createTypeObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
+  Object* obj = allocObject(sizeof(TypeAttributes));
   strcpy(obj->name, name);
   obj->kind = OBJ_TYPE;
-  obj->typeAttrs = (TypeAttributes*) malloc(sizeof(TypeAttributes));
+  obj->typeAttrs = (TypeAttributes*) OBJECT_ATTRS(obj);
   return obj;
 }
 
 Object* createVariableObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
+  Object* obj = allocObject(sizeof(VariableAttributes));
   strcpy(obj->name, name);
   obj->kind = OBJ_VARIABLE;
-  obj->varAttrs = (VariableAttributes*) malloc(sizeof(VariableAttributes));
+  obj->varAttrs = (VariableAttributes*) OBJECT_ATTRS(obj);
   obj->varAttrs->type = NULL;
   obj->varAttrs->scope = NULL;
   obj->varAttrs->localOffset = 0;
@@ -170,10 +186,10 @@ Object* createVariableObject(char *name) {
 }
 
 Object* createFunctionObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
+  Object* obj = allocObject(sizeof(FunctionAttributes));
   strcpy(obj->name, name);
   obj->kind = OBJ_FUNCTION;
-  obj->funcAttrs = (FunctionAttributes*) malloc(sizeof(FunctionAttributes));
+  obj->funcAttrs = (FunctionAttributes*) OBJECT_ATTRS(obj);
   obj->funcAttrs->returnType = NULL;
   obj->funcAttrs->paramList = NULL;
   obj->funcAttrs->paramCount = 0;
@@ -183,10 +199,10 @@ Object* createFunctionObject(char *name) {
 }
 
 Object* createProcedureObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
+  Object* obj = allocObject(sizeof(ProcedureAttributes));
   strcpy(obj->name, name);
   obj->kind = OBJ_PROCEDURE;
-  obj->procAttrs = (ProcedureAttributes*) malloc(sizeof(ProcedureAttributes));
+  obj->procAttrs = (ProcedureAttributes*) OBJECT_ATTRS(obj);
   obj->procAttrs->paramList = NULL;
   obj->procAttrs->paramCount = 0;
   obj->procAttrs->codeAddress = DC_VALUE;
@@ -195,10 +211,10 @@ Object* createProcedureObject(char *name) {
 }
 
 Object* createParameterObject(char *name, enum ParamKind kind) {
-  Object* obj = (Object*) malloc(sizeof(Object));
+  Object* obj = allocObject(sizeof(ParameterAttributes));
   strcpy(obj->name, name);
   obj->kind = OBJ_PARAMETER;
-  obj->paramAttrs = (ParameterAttributes*) malloc(sizeof(ParameterAttributes));
+  obj->paramAttrs = (ParameterAttributes*) OBJECT_ATTRS(obj);
   obj->paramAttrs->kind = kind;
   obj->paramAttrs->type = NULL;
   obj->paramAttrs->scope = NULL;
@@ -206,70 +222,8 @@ Object* createParameterObject(char *name, enum ParamKind kind) {
   return obj;
 }
 
-void freeObject(Object* obj) {
-  switch (obj->kind) {
-  case OBJ_CONSTANT:
-    free(obj->constAttrs->value);
-    free(obj->constAttrs);
-    break;
-  case OBJ_TYPE:
-    free(obj->typeAttrs->actualType);
-    free(obj->typeAttrs);
-    break;
-  case OBJ_VARIABLE:
-    free(obj->varAttrs->type);
-    free(obj->varAttrs);
-    break;
-  case OBJ_FUNCTION:
-    freeReferenceList(obj->funcAttrs->paramList);
-    freeType(obj->funcAttrs->returnType);
-    freeScope(obj->funcAttrs->scope);
-    free(obj->funcAttrs);
-    break;
-  case OBJ_PROCEDURE:
-    freeReferenceList(obj->procAttrs->paramList);
-    freeScope(obj->procAttrs->scope);
-    free(obj->procAttrs);
-    break;
-  case OBJ_PROGRAM:
-    freeScope(obj->progAttrs->scope);
-    free(obj->progAttrs);
-    break;
-  case OBJ_PARAMETER:
-    freeType(obj->paramAttrs->type);
-    free(obj->paramAttrs);
-  }
-  free(obj);
-}
-
-void freeScope(Scope* scope) {
-  freeObjectList(scope->objList);
-  free(scope);
-}
-
-void freeObjectList(ObjectNode *objList) {
-  ObjectNode* list = objList;
-
-  while (list != NULL) {
-    ObjectNode* node = list;
-    list = list->next;
-    freeObject(node->object);
-    free(node);
-  }
-}
-
-void freeReferenceList(ObjectNode *objList) {
-  ObjectNode* list = objList;
-
-  while (list != NULL) {
-    ObjectNode* node = list;
-    list = list->next;
-    free(node);
-  }
-}
-
 void addObject(ObjectNode **objList, Object* obj) {
-  ObjectNode* node = (ObjectNode*) malloc(sizeof(ObjectNode));
+  ObjectNode* node = NEW(ObjectNode);
   node->object = obj;
   node->next = NULL;
   if ((*objList) == NULL) 
@@ -284,6 +238,7 @@ void addObject(ObjectNode **objList, Object* obj) {
 
 Object* findObject(ObjectNode *objList, char *name) {
   while (objList != NULL) {
+    COUNT(nodesVisited);
     if (strcmp(objList->object->name, name) == 0) 
       return objList->object;
     else objList = objList->next;
@@ -296,76 +251,100 @@ Object* findObject(ObjectNode *objList, char *name) {
 void initSymTab(void) {
   Object* param;
 
-  symtab = (SymTab*) malloc(sizeof(SymTab));
-  symtab->globalObjectList = NULL;
-  symtab->program = NULL;
-  symtab->currentScope = NULL;
+  if (compiler->symArena == NULL) {
+    compiler->symArena = createArena(ARENA_BLOCK_SIZE);
+    if (compiler->symArena == NULL) outOfMemory();
+  }
+
+  compiler->symtab = NEW(SymTab);
+  compiler->symtab->globalObjectList = NULL;
+  compiler->symtab->program = NULL;
+  compiler->symtab->currentScope = NULL;
+
+  memset(compiler->typeTable, 0, sizeof(compiler->typeTable));
+  compiler->intType = makeBasicType(TP_INT);
+  compiler->charType = makeBasicType(TP_CHAR);
   
-  readcFunction = createFunctionObject("READC");
-  declareObject(readcFunction);
-  readcFunction->funcAttrs->returnType = makeCharType();
+  compiler->readcFunction = createFunctionObject("READC");
+  declareObject(compiler->readcFunction);
+  compiler->readcFunction->funcAttrs->returnType = makeCharType();
 
-  readiFunction = createFunctionObject("READI");
-  declareObject(readiFunction);
-  readiFunction->funcAttrs->returnType = makeIntType();
+  compiler->readiFunction = createFunctionObject("READI");
+  declareObject(compiler->readiFunction);
+  compiler->readiFunction->funcAttrs->returnType = makeIntType();
 
 
-  writeiProcedure = createProcedureObject("WRITEI");
-  declareObject(writeiProcedure);
-  enterBlock(writeiProcedure->procAttrs->scope);
+  compiler->writeiProcedure = createProcedureObject("WRITEI");
+  declareObject(compiler->writeiProcedure);
+  enterBlock(compiler->writeiProcedure->procAttrs->scope);
     param = createParameterObject("i", PARAM_VALUE);
     param->paramAttrs->type = makeIntType();
     declareObject(param);
   exitBlock();
 
-  writecProcedure = createProcedureObject("WRITEC");
-  declareObject(writecProcedure);
-  enterBlock(writecProcedure->procAttrs->scope);
+  compiler->writecProcedure = createProcedureObject("WRITEC");
+  declareObject(compiler->writecProcedure);
+  enterBlock(compiler->writecProcedure->procAttrs->scope);
     param = createParameterObject("ch", PARAM_VALUE);
     param->paramAttrs->type = makeCharType();
     declareObject(param);
   exitBlock();
 
-  writelnProcedure = createProcedureObject("WRITELN");
-  declareObject(writelnProcedure);
+  compiler->writelnProcedure = createProcedureObject("WRITELN");
+  declareObject(compiler->writelnProcedure);
 
-  intType = makeIntType();
-  charType = makeCharType();
+  compiler->writesProcedure = createProcedureObject("WRITES");
+  declareObject(compiler->writesProcedure);
+  enterBlock(compiler->writesProcedure->procAttrs->scope);
+    param = createParameterObject("s", PARAM_CONST);
+    param->paramAttrs->type = makePackedType(OPEN_ARRAY_SIZE, makeCharType());
+    declareObject(param);
+  exitBlock();
+
+  // LENGTH takes a STRING or a BYTES: its parameter has no element type
+  compiler->lengthFunction = createFunctionObject("LENGTH");
+  declareObject(compiler->lengthFunction);
+  compiler->lengthFunction->funcAttrs->returnType = makeIntType();
+  enterBlock(compiler->lengthFunction->funcAttrs->scope);
+    param = createParameterObject("s", PARAM_CONST);
+    param->paramAttrs->type = makePackedType(OPEN_ARRAY_SIZE, NULL);
+    declareObject(param);
+  exitBlock();
 }
 
 void cleanSymTab(void) {
-  freeObject(symtab->program);
-  freeObjectList(symtab->globalObjectList);
-  free(symtab);
-  freeType(intType);
-  freeType(charType);
+  if (compiler->stats != NULL)
+    arenaUsage(compiler->symArena, &(compiler->stats->arenaBlocks), &(compiler->stats->arenaBytes));
+  // Keep the arena blocks so that the next compilation can reuse them
+  resetArena(compiler->symArena);
+  compiler->symtab = NULL;
 }
 
 void enterBlock(Scope* scope) {
-  symtab->currentScope = scope;
+  compiler->symtab->currentScope = scope;
 }
 
 void exitBlock(void) {
-  symtab->currentScope = symtab->currentScope->outer;
+  compiler->symtab->currentScope = compiler->symtab->currentScope->outer;
 }
 
 void declareObject(Object* obj) {
   Object* owner;
 
-  if (symtab->currentScope == NULL)  //  globalObject
-    addObject(&(symtab->globalObjectList), obj);
+  if (compiler->symtab->currentScope == NULL)  //  globalObject
+    addObject(&(compiler->symtab->globalObjectList), obj);
   else {
     switch (obj->kind) {
     case OBJ_VARIABLE:
-      obj->varAttrs->scope = symtab->currentScope;
-      obj->varAttrs->localOffset = symtab->currentScope->frameSize;
-      symtab->currentScope->frameSize += sizeOfType(obj->varAttrs->type);
+      obj->varAttrs->scope = compiler->symtab->currentScope;
+      obj->varAttrs->localOffset = compiler->symtab->currentScope->frameSize;
+      compiler->symtab->currentScope->frameSize += sizeOfType(obj->varAttrs->type);
       break;
     case OBJ_PARAMETER:
-      obj->paramAttrs->scope = symtab->currentScope;
-      obj->paramAttrs->localOffset = symtab->currentScope->frameSize;
-      symtab->currentScope->frameSize ++;
-      owner = symtab->currentScope->owner;
+      obj->paramAttrs->scope = compiler->symtab->currentScope;
+      obj->paramAttrs->localOffset = compiler->symtab->currentScope->frameSize;
+      compiler->symtab->currentScope->frameSize ++;
+      owner = compiler->symtab->currentScope->owner;
       switch (owner->kind) {
       case OBJ_FUNCTION:
 	addObject(&(owner->funcAttrs->paramList), obj);
@@ -380,14 +359,16 @@ void declareObject(Object* obj) {
       }
       break;
     case OBJ_FUNCTION:
-      obj->funcAttrs->scope->outer = symtab->currentScope;
+      obj->funcAttrs->scope->outer = compiler->symtab->currentScope;
+      obj->funcAttrs->scope->level = obj->funcAttrs->scope->writesLevel = compiler->symtab->currentScope->level + 1;
       break;
     case OBJ_PROCEDURE:
-      obj->procAttrs->scope->outer = symtab->currentScope;
+      obj->procAttrs->scope->outer = compiler->symtab->currentScope;
+      obj->procAttrs->scope->level = obj->procAttrs->scope->writesLevel = compiler->symtab->currentScope->level + 1;
       break;
     default: break;
     }
-    addObject(&(symtab->currentScope->objList), obj);
+    addObject(&(compiler->symtab->currentScope->objList), obj);
   }
   
 }
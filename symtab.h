@@ -13,7 +13,8 @@
 enum TypeClass {
   TP_INT,
   TP_CHAR,
-  TP_ARRAY
+  TP_ARRAY,
+  TP_PACKED        // STRING (CHAR elements) or BYTES (INTEGER elements)
 };
 
 enum ObjectKind {
@@ -28,13 +29,21 @@ enum ObjectKind {
 
 enum ParamKind {
   PARAM_VALUE,
-  PARAM_REFERENCE
+  PARAM_REFERENCE,
+  PARAM_CONST      // read-only reference, arrays only
 };
 
+// Size of an open array parameter (ARRAY OF T, STRING, BYTES): any size is accepted
+#define OPEN_ARRAY_SIZE 0
+
+#define TYPE_TABLE_SIZE 211
+
+// Types are canonical and immutable; never modify a Type once it is made
 struct Type_ {
   enum TypeClass typeClass;
   int arraySize;
   struct Type_ *elementType;
+  struct Type_ *next;     // next type in the same typeTable bucket
 };
 
 typedef struct Type_ Type;
@@ -136,6 +145,12 @@ struct Scope_ {
   Object *owner;
   struct Scope_ *outer;
   int frameSize;
+
+  // effects of the subprogram, for its calls inside a PARALLEL FOR
+  int level;                    // nesting depth, 0 for the program
+  int doesIO;                   // it reads or writes, itself or through its calls
+  int writesLevel;              // outermost level whose variables it assigns, itself or
+                                // through its calls: below level when it assigns outside its frame
 };
 
 typedef struct Scope_ Scope;
@@ -150,10 +165,10 @@ typedef struct SymTab_ SymTab;
 
 Type* makeIntType(void);
 Type* makeCharType(void);
+Type* makeCompositeType(enum TypeClass typeClass, int size, Type* elementType);
 Type* makeArrayType(int arraySize, Type* elementType);
-Type* duplicateType(Type* type);
+Type* makePackedType(int capacity, Type* elementType);
 int compareType(Type* type1, Type* type2);
-void freeType(Type* type);
 int sizeOfType(Type* type);
 
 ConstantValue* makeIntConstant(int i);
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include "token.h"
+#include "compiler.h"
 
 // Mảng ánh xạ từ chuỗi ký tự sang loại Token (TokenType)
 struct {
@@ -36,8 +37,12 @@ struct {
   {"MOD", KW_MOD},
   {"AND", KW_AND},
   {"OR", KW_OR},
-  {"NOT", KW_NOT}
+  {"NOT", KW_NOT},
   // -------------------------------------------------------------------
+  {"STRING", KW_STRING},
+  {"BYTES", KW_BYTES},
+  {"PARALLEL", KW_PARALLEL},
+  {"REDUCE", KW_REDUCE}
 };
 
 // Hàm so sánh 2 từ khóa
@@ -61,6 +66,7 @@ TokenType checkKeyword(char *string) {
 // Hàm tạo mới một token
 Token* makeToken(TokenType tokenType, int lineNo, int colNo) {
   Token *token = (Token*)malloc(sizeof(Token));
+  COUNT(tokenAllocs);
   token->tokenType = tokenType;
   token->lineNo = lineNo;
   token->colNo = colNo;
@@ -74,6 +80,7 @@ char *tokenToString(TokenType tokenType) {
   case TK_IDENT: return "an identification";
   case TK_NUMBER: return "a number";
   case TK_CHAR: return "a constant char";
+  case TK_STRING: return "a constant string";
   case TK_EOF: return "end of file";
 
   case KW_PROGRAM: return "keyword PROGRAM";
@@ -103,6 +110,10 @@ char *tokenToString(TokenType tokenType) {
   case KW_OR: return "keyword OR";
   case KW_NOT: return "keyword NOT";
   // ------------------------------------------------
+  case KW_STRING: return "keyword STRING";
+  case KW_BYTES: return "keyword BYTES";
+  case KW_PARALLEL: return "keyword PARALLEL";
+  case KW_REDUCE: return "keyword REDUCE";
 
   case SB_SEMICOLON: return "\';\'";
   case SB_COLON: return "\':\'";
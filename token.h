@@ -8,7 +8,7 @@
 #define __TOKEN_H__
 
 #define MAX_IDENT_LEN 15
-#define KEYWORDS_COUNT 24
+#define KEYWORDS_COUNT 28
 
 typedef enum {
   TK_NONE, TK_IDENT, TK_NUMBER, TK_CHAR, TK_EOF,TK_STRING, TK_BYTES,
@@ -27,6 +27,8 @@ typedef enum {
   KW_AND,  // Toán tử logic VÀ
   KW_OR,   // Toán tử logic HOẶC
   KW_NOT,  // Toán tử logic PHỦ ĐỊNH
+  KW_PARALLEL,  // PARALLEL FOR
+  KW_REDUCE,
 
   SB_SEMICOLON, SB_COLON, SB_PERIOD, SB_COMMA,
   SB_ASSIGN, SB_EQ, SB_NEQ, SB_LT, SB_LE, SB_GT, SB_GE,
@@ -0,0 +1,1136 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include "vm.h"
+#include "executable.h"
+#include "profile.h"
+#include "vmio.h"
+#include "vmvec.h"
+
+VMProgram mainProgram;      // kplrun's program and VM (initVM, run...)
+VM mainVM;
+
+int profiling = 0;          // only the main VM is profiled
+
+// Run counters of the main VM. Instructions and calls are only counted
+// when counting is set (kplrun -stats); the peak stack is always kept.
+int counting = 0;
+long long instructionCount;
+long long callCount;
+int peakStack;
+
+// Threads for PARALLEL FOR, the main one included; 0 for one per processor
+int workerCount = 0;
+
+// Limits of the main VM's next run, 0 for none, and what the run used
+long long fuelBudget = 0;
+long long fuelUsed;
+long long outputLimit = 0;
+long long outputBytes;
+
+#ifndef _WIN32
+// Worker pool, started by the first PARALLEL FOR that is worth splitting.
+// Every job is announced by a new generation; poolBusy counts the workers
+// that have not finished it yet.
+pthread_t poolThreads[MAX_WORKERS];
+int poolSize = 0;             // threads started besides the main one
+int poolStarted = 0;
+int poolStopping = 0;
+int poolGeneration = 0;
+int poolBusy = 0;
+ParallelJob* poolJob = NULL;
+pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t poolWake = PTHREAD_COND_INITIALIZER;
+pthread_cond_t poolIdle = PTHREAD_COND_INITIALIZER;
+pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;   // ranges and ps of the job
+ParallelJob parallelJob;      // only the main thread starts jobs
+#endif
+
+// Static link is stored at offset 3 of each frame
+#define STATIC_LINK(base) (stack[(base) + 3])
+
+// Fails the program with a stack overflow unless [0, top] fits in the
+// thread's part of the stack. Every push goes through here, so this is
+// also where the peak stack is kept.
+#define CHECK_STACK(top) \
+  if ((top) >= limit) { ps = PS_STACK_OVERFLOW; break; } \
+  if ((top) >= peak) peak = (top) + 1;
+
+#define CHECK_ADDRESS(addr) \
+  if (((addr) < 0) || ((addr) >= stackSize)) { ps = PS_STACK_OVERFLOW; break; }
+
+// STRING/BYTES buffer at addr: length word, capacity word, packed bytes
+#define PACKED_LENGTH(addr) (stack[addr])
+#define PACKED_CAPACITY(addr) (stack[(addr) + 1])
+#define PACKED_BYTES(addr) ((unsigned char*) (stack + (addr) + PACKED_HEADER_SIZE))
+
+// Fails unless there is a consistent buffer at addr that fits in the stack
+#define CHECK_PACKED(addr) \
+  if (((addr) < 0) || ((addr) + PACKED_HEADER_SIZE > stackSize) || \
+      (PACKED_CAPACITY(addr) < 0) || (PACKED_LENGTH(addr) < 0) || \
+      (PACKED_LENGTH(addr) > PACKED_CAPACITY(addr)) || \
+      ((PACKED_CAPACITY(addr) - 1) / BYTES_PER_WORD >= stackSize - (addr) - PACKED_HEADER_SIZE)) { \
+    ps = PS_STACK_OVERFLOW; break; }
+
+// Fails unless there is a whole string constant at offset in the DATA section
+#define CHECK_CONSTANT(offset) \
+  if (((offset) < 0) || ((offset) >= constantSize) || (constants[offset] < 0) || \
+      ((constants[offset] + BYTES_PER_WORD - 1) / BYTES_PER_WORD >= constantSize - (offset))) { \
+    ps = PS_INVALID_CODE; break; }
+
+#define CHECK_INDEX(addr, index) \
+  if (((index) < 0) || ((index) >= PACKED_CAPACITY(addr))) { ps = PS_INDEX_ERROR; break; }
+
+// Tasks run in no particular order: they can not read or write
+#define CHECK_IO() \
+  if (inTask) { ps = PS_PARALLEL_IO; break; }
+
+// Backward jumps and calls use up the fuel of the thread; it yields once
+// there is none left
+#define CHARGE_FUEL() \
+  if ((fuel -= fuelCost[pc]) <= 0) ps = PS_YIELD;
+
+// A failed write is past the output limit, or out of memory
+#define CHECK_WRITE(written) \
+  if (!(written)) { ps = io->outputOverLimit ? PS_OUTPUT_LIMIT : PS_IO_ERROR; break; }
+
+void initProgram(VMProgram* program) {
+  program->ownCode = createCodeBlock(INIT_CODE_SIZE);
+  program->codeBlock = program->ownCode;
+  program->executable = NULL;
+  program->entryPoint = 0;
+  program->constants = NULL;
+  program->constantSize = 0;
+  program->fuelCost = NULL;
+}
+
+void cleanProgram(VMProgram* program) {
+  free(program->fuelCost);
+  program->fuelCost = NULL;
+  freeCodeBlock(program->ownCode);
+  if (program->executable != NULL)
+    closeExecutable(program->executable);
+  program->executable = NULL;
+}
+
+// Loads raw or compact code from a stream into the program's own code block
+int loadProgramStream(VMProgram* program, FILE* f) {
+  if (!loadCode(program->ownCode, f)) return 0;
+  program->codeBlock = program->ownCode;
+  program->entryPoint = 0;
+  program->constants = NULL;
+  program->constantSize = 0;
+  return computeFuelCosts(program);
+}
+
+// Container files are mapped and executed in place; anything else is
+// read through loadProgramStream. Returns one of the EXEC_* results.
+int loadProgramFile(VMProgram* program, char* fileName) {
+  FILE* f;
+  int result;
+  unsigned int size;
+
+  if (program->executable != NULL) {
+    closeExecutable(program->executable);
+    program->executable = NULL;
+  }
+
+  result = openExecutable(fileName, &(program->executable));
+  if (result == EXEC_OK) {
+    program->codeBlock = &(program->executable->code);
+    program->entryPoint = program->executable->header->entryPoint;
+    program->constants = (WORD*) findSection(program->executable, SECTION_DATA, &size);
+    program->constantSize = (program->constants == NULL) ? 0 : size / sizeof(WORD);
+    return computeFuelCosts(program) ? EXEC_OK : EXEC_OUT_OF_MEMORY;
+  }
+  program->executable = NULL;
+  if (result != EXEC_NOT_CONTAINER)
+    return result;
+
+  f = fopen(fileName, "rb");
+  if (f == NULL) return EXEC_IO_ERROR;
+  result = loadProgramStream(program, f);
+  fclose(f);
+  return result ? EXEC_OK : EXEC_BAD_FORMAT;
+}
+
+// Instructions a call runs from pc before the first jump or return of the
+// callee, following the forward J over its nested subprograms
+int callFuel(Instruction* code, int codeSize, int pc) {
+  int fuel = 1;
+
+  while ((pc >= 0) && (pc < codeSize) && (fuel < MAX_CALL_FUEL)) {
+    fuel ++;
+    switch (code[pc].op) {
+    case OP_J:
+      if (code[pc].q <= pc) return fuel;
+      pc = code[pc].q;
+      break;
+    case OP_FJ:
+    case OP_CALL:
+    case OP_EP:
+    case OP_EF:
+    case OP_HL:
+    case OP_PFOR:
+      return fuel;
+    default:
+      pc ++;
+    }
+  }
+  return fuel;
+}
+
+// Fuel is only charged where the program can go back or enter a
+// subprogram, so straight-line code pays nothing: a backward J/FJ costs the
+// instructions of the loop it closes, a CALL the call and the start of the
+// callee. Fuel thus stays close to the instructions executed. Returns 0 when
+// there is no memory for the costs.
+int computeFuelCosts(VMProgram* program) {
+  Instruction* code = program->codeBlock->code;
+  int codeSize = program->codeBlock->codeSize;
+  int pc;
+
+  free(program->fuelCost);
+  program->fuelCost = (int*) calloc((codeSize > 0) ? codeSize : 1, sizeof(int));
+  if (program->fuelCost == NULL) return 0;
+  for (pc = 0; pc < codeSize; pc ++)
+    switch (code[pc].op) {
+    case OP_J:
+    case OP_FJ:
+      if (code[pc].q <= pc)
+	program->fuelCost[pc] = (code[pc].q >= 0) ? pc - code[pc].q + 1 : 1;
+      break;
+    case OP_CALL:
+      program->fuelCost[pc] = callFuel(code, codeSize, code[pc].q);
+      break;
+    default:
+      break;
+    }
+  return 1;
+}
+
+// A VM that runs program with a stack of stackSize words, without input
+// and keeping its output in memory until initIO gives it files. Returns 0
+// when the stack can not be allocated.
+int initInstance(VM* vm, VMProgram* program, int stackSize) {
+  vm->program = program;
+  vm->stackSize = stackSize;
+  vm->stack = (WORD*) malloc(stackSize * sizeof(WORD));
+  initIO(&(vm->io), NULL, NULL);
+  vm->parallel = 0;
+  vm->counting = 0;
+  vm->mainThread.suspended = NULL;
+  resetInstance(vm);
+  return (vm->stack != NULL);
+}
+
+void cleanInstance(VM* vm) {
+  freeSuspended(&(vm->mainThread));
+  closeIO(&(vm->io));
+  free(vm->stack);
+  vm->stack = NULL;
+}
+
+void resetInstance(VM* vm) {
+  VMThread* thread = &(vm->mainThread);
+
+  freeSuspended(thread);
+  thread->vm = vm;
+  thread->t = -1;
+  thread->b = 0;
+  thread->pc = vm->program->entryPoint;
+  thread->bottom = 0;
+  thread->limit = vm->stackSize;
+  thread->inTask = 0;
+  thread->fuel = NO_PREEMPTION;
+  thread->instructionCount = 0;
+  thread->callCount = 0;
+  thread->peakStack = 0;
+  vm->ps = PS_INACTIVE;
+}
+
+void initVM(int size) {
+  initVectorKernels();
+  initProgram(&mainProgram);
+  initInstance(&mainVM, &mainProgram, size);
+  initIO(&(mainVM.io), stdin, stdout);
+  mainVM.parallel = 1;
+}
+
+void cleanVM(void) {
+  stopPool();
+  cleanInstance(&mainVM);
+  cleanProgram(&mainProgram);
+}
+
+void resetVM(void) {
+  resetInstance(&mainVM);
+}
+
+int loadExecutable(FILE* f) {
+  if (!loadProgramStream(&mainProgram, f)) return 0;
+  resetVM();
+  return 1;
+}
+
+int loadExecutableFile(char* fileName) {
+  int result = loadProgramFile(&mainProgram, fileName);
+
+  resetVM();
+  return result;
+}
+
+// Counts executed instructions by opcode and by subprogram during the next
+// run; the names come from the SYMBOLS section of the executable
+void startProfile(void) {
+  SymbolEntry* symbols = NULL;
+  unsigned int size = 0;
+
+  if (mainProgram.executable != NULL)
+    symbols = (SymbolEntry*) findSection(mainProgram.executable, SECTION_SYMBOLS, &size);
+  initProfile(symbols, size / sizeof(SymbolEntry), mainProgram.entryPoint);
+  profiling = 1;
+}
+
+void stopProfile(void) {
+  profiling = 0;
+  cleanProfile();
+}
+
+int base(WORD* stack, int b, int p) {
+  int currentBase = b;
+  while (p > 0) {
+    currentBase = STATIC_LINK(currentBase);
+    p --;
+  }
+  return currentBase;
+}
+
+// Combines two partial results of a reduction; they wrap around on
+// overflow, so the order in which the parts finish does not matter
+WORD reduce(int reduction, WORD x, WORD y) {
+  if (reduction == REDUCE_MUL)
+    return (WORD) ((unsigned int) x * (unsigned int) y);
+  return (WORD) ((unsigned int) x + (unsigned int) y);
+}
+
+// Sets the thread up to run the task function on the iterations [lo, hi]
+// with its frame at the bottom of the thread's part of the stack. The frame
+// is set up as a CALL would: return value, dynamic link, return address,
+// static link, then the bounds as parameters.
+int startTask(VMThread* thread, CodeAddress entry, int staticLink, WORD lo, WORD hi) {
+  WORD* stack = thread->vm->stack;
+  int frame = thread->bottom;
+
+  if (frame + 6 > thread->limit) return PS_STACK_OVERFLOW;
+  stack[frame] = 0;
+  stack[frame + 1] = -1;          // no dynamic link: EF ends the task
+  stack[frame + 2] = -1;
+  stack[frame + 3] = staticLink;
+  stack[frame + 4] = lo;
+  stack[frame + 5] = hi;
+  thread->t = frame - 1;
+  thread->b = frame;
+  thread->pc = entry;
+  if (profiling) profileCall(entry);
+  if (thread->vm->counting) thread->callCount ++;
+  thread->suspended = NULL;
+  return PS_ACTIVE;
+}
+
+// Runs a started task until its function returns (PS_ACTIVE, with its
+// result) or until it fails. A serial task (job NULL) that runs out of
+// fuel returns PS_YIELD; a task of a pool job takes more fuel from the job
+// and fails with PS_OUT_OF_BUDGET once the job has none left.
+int continueTask(VMThread* thread, ParallelJob* job, WORD* result) {
+  int ps;
+
+  for (;;) {
+    ps = execute(thread);
+    if ((ps != PS_YIELD) || (job == NULL)) break;
+#ifndef _WIN32
+    if (!takeFuel(job, thread)) return PS_OUT_OF_BUDGET;
+#endif
+  }
+  if (ps != PS_TASK_DONE) return ps;
+  *result = thread->vm->stack[thread->bottom];
+  return PS_ACTIVE;
+}
+
+int runTask(VMThread* thread, ParallelJob* job, CodeAddress entry, int staticLink, WORD lo, WORD hi, WORD* result) {
+  int ps = startTask(thread, entry, staticLink, lo, hi);
+
+  if (ps != PS_ACTIVE) return ps;
+  return continueTask(thread, job, result);
+}
+
+// Moves what a serial task has used so far to its caller, which lends it
+// its fuel
+void chargeTask(VMThread* caller, VMThread* task) {
+  caller->instructionCount += task->instructionCount;
+  caller->callCount += task->callCount;
+  if (task->peakStack > caller->peakStack) caller->peakStack = task->peakStack;
+  caller->fuel = task->fuel;
+  task->instructionCount = 0;
+  task->callCount = 0;
+}
+
+// Drops the suspended tasks of a thread, nested ones included
+void freeSuspended(VMThread* thread) {
+  SuspendedTask* suspended = thread->suspended;
+
+  thread->suspended = NULL;
+  if (suspended == NULL) return;
+  freeSuspended(&(suspended->thread));
+  free(suspended);
+}
+
+#ifndef _WIN32
+// Gives a worker of the job FUEL_GRANT more fuel, or what is left; returns
+// 0 when there is none left or when a task failed
+int takeFuel(ParallelJob* job, VMThread* thread) {
+  long long grant;
+
+  pthread_mutex_lock(&jobLock);
+  grant = (job->fuel < FUEL_GRANT) ? job->fuel : FUEL_GRANT;
+  if ((job->ps != PS_ACTIVE) || (grant < 0)) grant = 0;
+  job->fuel -= grant;
+  pthread_mutex_unlock(&jobLock);
+  thread->fuel += grant;
+  return (grant > 0);
+}
+
+// Takes the next chunk of worker i's iterations; when it has none left,
+// steals the upper half of the largest range of another worker first.
+// Returns 0 when there is nothing left, or when a task failed.
+int takeWork(ParallelJob* job, int i, WORD* lo, WORD* hi) {
+  TaskRange* range = job->ranges + i;
+  TaskRange* victim;
+  long long left, mostLeft = 0;
+  int found = 0;
+  int j;
+
+  pthread_mutex_lock(&jobLock);
+  if (job->ps == PS_ACTIVE) {
+    if (range->next > range->last) {
+      victim = NULL;
+      for (j = 0; j < job->workers; j ++) {
+	left = job->ranges[j].last - job->ranges[j].next + 1;
+	if (left > mostLeft) {
+	  mostLeft = left;
+	  victim = job->ranges + j;
+	}
+      }
+      if (victim != NULL) {
+	range->next = victim->next + mostLeft / 2;
+	range->last = victim->last;
+	victim->last = range->next - 1;
+      }
+    }
+    if (range->next <= range->last) {
+      *lo = (WORD) range->next;
+      *hi = (WORD) ((range->last - range->next < job->chunk) ? range->last : range->next + job->chunk - 1);
+      range->next = (long long) *hi + 1;
+      found = 1;
+    }
+  }
+  pthread_mutex_unlock(&jobLock);
+  return found;
+}
+
+// Runs chunks of the job on worker i until there are none left
+void workOn(ParallelJob* job, int i) {
+  VMThread* thread = job->threads + i;
+  WORD lo, hi, value;
+  int ps;
+
+  while (takeWork(job, i, &lo, &hi)) {
+    ps = runTask(thread, job, job->entry, job->staticLink, lo, hi, &value);
+    if (ps != PS_ACTIVE) {
+      pthread_mutex_lock(&jobLock);
+      if (job->ps == PS_ACTIVE) job->ps = ps;
+      pthread_mutex_unlock(&jobLock);
+      break;
+    }
+    job->results[i] = reduce(job->reduction, job->results[i], value);
+  }
+}
+
+void* poolWorker(void* arg) {
+  int index = (int) (long) arg;
+  int seen = 0;
+  ParallelJob* job;
+
+  pthread_mutex_lock(&poolLock);
+  for (;;) {
+    while ((poolGeneration == seen) && !poolStopping)
+      pthread_cond_wait(&poolWake, &poolLock);
+    if (poolStopping) break;
+    seen = poolGeneration;
+    job = poolJob;
+    pthread_mutex_unlock(&poolLock);
+
+    if (index < job->workers) workOn(job, index);
+
+    pthread_mutex_lock(&poolLock);
+    poolBusy --;
+    if (poolBusy == 0) pthread_cond_signal(&poolIdle);
+  }
+  pthread_mutex_unlock(&poolLock);
+  return NULL;
+}
+
+// Starts workerCount - 1 threads, or one per processor besides the main one
+void startPool(void) {
+  int requested = workerCount;
+  long i;
+
+  if (poolStarted) return;
+  poolStarted = 1;
+  if (requested <= 0) requested = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (requested > MAX_WORKERS) requested = MAX_WORKERS;
+  for (i = 1; i < requested; i ++) {
+    if (pthread_create(poolThreads + poolSize, NULL, poolWorker, (void*) i) != 0) break;
+    poolSize ++;
+  }
+}
+
+// Splits [from, to] and the free stack above the caller's top among the
+// workers, runs the job with the caller as worker 0, and waits for the
+// others. The workers share the caller's fuel: they take it FUEL_GRANT at a
+// time, and what they have not used goes back to the caller.
+int runJob(VMThread* caller, int workers, CodeAddress entry, int reduction, WORD from, WORD to, WORD* result) {
+  ParallelJob* job = &parallelJob;
+  VMThread* thread;
+  long long count = (long long) to - from + 1;
+  long long share = count / workers;
+  long long next = from;
+  int room = (caller->limit - caller->t - 1) / workers;
+  int i;
+
+  job->entry = entry;
+  job->staticLink = caller->b;
+  job->reduction = reduction;
+  job->workers = workers;
+  job->chunk = (share / CHUNKS_PER_WORKER > 0) ? share / CHUNKS_PER_WORKER : 1;
+  job->fuel = caller->fuel;
+  job->ps = PS_ACTIVE;
+  for (i = 0; i < workers; i ++) {
+    job->ranges[i].next = next;
+    next += share + ((i < count % workers) ? 1 : 0);
+    job->ranges[i].last = next - 1;
+    job->results[i] = *result;
+
+    thread = job->threads + i;
+    thread->vm = caller->vm;
+    thread->bottom = caller->t + 1 + i * room;
+    thread->limit = thread->bottom + room;
+    thread->inTask = 1;
+    thread->fuel = 0;
+    thread->suspended = NULL;
+    thread->instructionCount = 0;
+    thread->callCount = 0;
+    thread->peakStack = 0;
+    takeFuel(job, thread);
+  }
+
+  pthread_mutex_lock(&poolLock);
+  poolJob = job;
+  poolGeneration ++;
+  poolBusy = poolSize;
+  pthread_cond_broadcast(&poolWake);
+  pthread_mutex_unlock(&poolLock);
+
+  workOn(job, 0);
+
+  pthread_mutex_lock(&poolLock);
+  while (poolBusy > 0)
+    pthread_cond_wait(&poolIdle, &poolLock);
+  pthread_mutex_unlock(&poolLock);
+
+  caller->fuel = job->fuel;
+  for (i = 0; i < workers; i ++) {
+    *result = reduce(reduction, *result, job->results[i]);
+    caller->instructionCount += job->threads[i].instructionCount;
+    caller->callCount += job->threads[i].callCount;
+    caller->fuel += job->threads[i].fuel;
+    if (job->threads[i].peakStack > caller->peakStack)
+      caller->peakStack = job->threads[i].peakStack;
+    freeSuspended(job->threads + i);
+  }
+  return job->ps;
+}
+#endif
+
+void stopPool(void) {
+#ifndef _WIN32
+  int i;
+
+  if (!poolStarted) return;
+  pthread_mutex_lock(&poolLock);
+  poolStopping = 1;
+  pthread_cond_broadcast(&poolWake);
+  pthread_mutex_unlock(&poolLock);
+  for (i = 0; i < poolSize; i ++)
+    pthread_join(poolThreads[i], NULL);
+  poolSize = 0;
+  poolStarted = 0;
+  poolStopping = 0;
+  poolGeneration = 0;
+#endif
+}
+
+// Runs the task function on the iterations [from, to], split among the
+// worker pool when there are workers, iterations and stack enough. A task
+// runs serially inside another task, when profiling, as the profile
+// follows a single thread, and in VMs that may not use the pool. A serial
+// task runs on the caller's fuel; when it is used up, the task is kept in
+// caller->suspended and PS_YIELD returned (see resumeParallel). A job of
+// the pool can not be suspended: when its workers run out of fuel it fails
+// with PS_OUT_OF_BUDGET.
+int runParallel(VMThread* caller, CodeAddress entry, int reduction, WORD from, WORD to, WORD* result) {
+  VMThread task;
+  SuspendedTask* suspended;
+  long long count = (long long) to - from + 1;
+  int ps;
+#ifndef _WIN32
+  int workers;
+#endif
+
+  *result = (reduction == REDUCE_MUL) ? 1 : 0;
+  if (count <= 0) return PS_ACTIVE;
+
+#ifndef _WIN32
+  if (!caller->inTask && !profiling && caller->vm->parallel) {
+    startPool();
+    workers = poolSize + 1;
+    if (workers > count) workers = (int) count;
+    if (workers > (caller->limit - caller->t - 1) / MIN_WORKER_STACK)
+      workers = (caller->limit - caller->t - 1) / MIN_WORKER_STACK;
+    if (workers > 1)
+      return runJob(caller, workers, entry, reduction, from, to, result);
+  }
+#endif
+
+  task = *caller;
+  task.bottom = caller->t + 1;
+  task.inTask = 1;
+  task.instructionCount = 0;
+  task.callCount = 0;
+  ps = runTask(&task, NULL, entry, caller->b, from, to, result);
+  chargeTask(caller, &task);
+  if (ps != PS_YIELD) return ps;
+
+  suspended = (SuspendedTask*) malloc(sizeof(SuspendedTask));
+  if (suspended == NULL) {
+    freeSuspended(&task);
+    return PS_OUT_OF_MEMORY;
+  }
+  suspended->thread = task;
+  suspended->resultAddr = -1;
+  caller->suspended = suspended;
+  return PS_YIELD;
+}
+
+// Goes on with the suspended task of the caller, on the caller's fuel
+int resumeParallel(VMThread* caller, WORD* result) {
+  SuspendedTask* suspended = caller->suspended;
+  int ps;
+
+  suspended->thread.fuel = caller->fuel;
+  ps = continueTask(&(suspended->thread), NULL, result);
+  chargeTask(caller, &(suspended->thread));
+  if (ps != PS_YIELD) freeSuspended(caller);
+  return ps;
+}
+
+// Words [base + from, base + to] lie in the stack
+int wordsInStack(VM* vm, int base, WORD from, WORD to) {
+  return ((long long) base + from >= 0) && ((long long) base + to < vm->stackSize);
+}
+
+// Runs the loop of a vector instruction, its operands at t-3..t (see
+// OP_VFIL), and leaves the counter as the loop would. The words it goes
+// through are charged to fuel first.
+int runVector(VM* vm, enum OpCode op, int t, long long* fuel) {
+  WORD* stack = vm->stack;
+  int stackSize = vm->stackSize;
+  int counter = stack[t - 3];
+  int array = stack[t - 1];
+  int sum = stack[t];
+  WORD from, to;
+  int n;
+
+  if ((counter < 0) || (counter >= stackSize)) return PS_STACK_OVERFLOW;
+  from = stack[counter];
+  to = stack[t - 2];
+  *fuel -= 1 + ((from <= to) ? ((long long) to - from + 1) / VECTOR_FUEL_WORDS : 0);
+  if (from > to) return PS_ACTIVE;
+  if (!wordsInStack(vm, array, from, to)) return PS_STACK_OVERFLOW;
+  n = to - from + 1;
+
+  switch (op) {
+  case OP_VFIL:
+    fillWords(stack + array + from, stack[t], n);
+    break;
+  case OP_VCPY:
+    if (!wordsInStack(vm, stack[t], from, to)) return PS_STACK_OVERFLOW;
+    memmove(stack + array + from, stack + stack[t] + from, n * sizeof(WORD));
+    break;
+  case OP_VADD:
+    addWords(stack + array + from, stack[t], n);
+    break;
+  default:
+    if ((sum < 0) || (sum >= stackSize)) return PS_STACK_OVERFLOW;
+    stack[sum] = (WORD) ((unsigned int) stack[sum] + (unsigned int) sumWords(stack + array + from, n));
+    break;
+  }
+  stack[counter] = to + 1;
+  return PS_ACTIVE;
+}
+
+// Runs the thread from its pc until the program stops, until the task it
+// runs returns (PS_TASK_DONE) or until its fuel is used up (PS_YIELD)
+int execute(VMThread* thread) {
+  VM* vm = thread->vm;
+  WORD* stack = vm->stack;
+  int stackSize = vm->stackSize;
+  Instruction* code = vm->program->codeBlock->code;
+  Instruction* inst;
+  int codeSize = vm->program->codeBlock->codeSize;
+  WORD* constants = vm->program->constants;
+  int constantSize = vm->program->constantSize;
+  VMIO* io = &(vm->io);
+  int counting = vm->counting;
+  int* fuelCost = vm->program->fuelCost;
+  long long fuel = thread->fuel;
+  int t = thread->t;
+  int b = thread->b;
+  int pc = thread->pc;
+  int limit = thread->limit;
+  int inTask = thread->inTask;
+  long long executed = 0;
+  long long calls = 0;
+  int peak = thread->peakStack;
+  int ps = PS_ACTIVE;
+  int addr;
+  int len;
+  WORD value;
+
+  while (ps == PS_ACTIVE) {
+    if ((pc < 0) || (pc >= codeSize)) {
+      ps = PS_INVALID_CODE;
+      break;
+    }
+    inst = code + pc;
+
+    if (profiling) {
+      if ((inst->op < 0) || (inst->op >= NUM_OF_OPCODES)) {
+	ps = PS_INVALID_CODE;
+	break;
+      }
+      PROFILE_INSTRUCTION(inst);
+    }
+
+    switch (inst->op) {
+    case OP_LA:
+      CHECK_STACK(t + 1);
+      t ++;
+      stack[t] = base(stack, b, inst->p) + inst->q;
+      break;
+    case OP_LV:
+      CHECK_STACK(t + 1);
+      addr = base(stack, b, inst->p) + inst->q;
+      CHECK_ADDRESS(addr);
+      t ++;
+      stack[t] = stack[addr];
+      break;
+    case OP_LC:
+      CHECK_STACK(t + 1);
+      t ++;
+      stack[t] = inst->q;
+      break;
+    case OP_LI:
+      CHECK_ADDRESS(stack[t]);
+      stack[t] = stack[stack[t]];
+      break;
+    case OP_INT:
+      CHECK_STACK(t + inst->q);
+      t += inst->q;
+      break;
+    case OP_DCT:
+      t -= inst->q;
+      break;
+    case OP_J:
+      if (inst->q <= pc) CHARGE_FUEL();
+      pc = inst->q - 1;
+      break;
+    case OP_FJ:
+      if (stack[t] == FALSE) {
+	if (inst->q <= pc) CHARGE_FUEL();
+	pc = inst->q - 1;
+      }
+      t --;
+      break;
+    case OP_HL:
+      ps = PS_NORMAL_EXIT;
+      break;
+    case OP_ST:
+      CHECK_ADDRESS(stack[t - 1]);
+      stack[stack[t - 1]] = stack[t];
+      t -= 2;
+      break;
+    case OP_CALL:
+      CHECK_STACK(t + 4);
+      stack[t + 2] = b;                 // dynamic link
+      stack[t + 3] = pc;                // return address
+      stack[t + 4] = base(stack, b, inst->p);     // static link
+      b = t + 1;
+      CHARGE_FUEL();
+      pc = inst->q - 1;
+      if (profiling) profileCall(inst->q);
+      if (counting) calls ++;
+      break;
+    case OP_EP:
+      t = b - 1;
+      pc = stack[b + 2];
+      b = stack[b + 1];
+      if (profiling) profileReturn();
+      break;
+    case OP_EF:
+      t = b;
+      pc = stack[b + 2];
+      b = stack[b + 1];
+      if (profiling) profileReturn();
+      if (b < 0) ps = PS_TASK_DONE;       // the dynamic link of a task frame is -1
+      break;
+    case OP_RC:
+      CHECK_IO();
+      CHECK_STACK(t + 1);
+      t ++;
+      stack[t] = readInputChar(io);
+      break;
+    case OP_RI:
+      CHECK_IO();
+      CHECK_STACK(t + 1);
+      t ++;
+      if (!readInputInt(io, &stack[t]))
+	ps = PS_IO_ERROR;
+      break;
+    case OP_WRC:
+      CHECK_IO();
+      CHECK_WRITE(writeOutputChar(io, stack[t]));
+      t --;
+      break;
+    case OP_WRI:
+      CHECK_IO();
+      CHECK_WRITE(writeOutputInt(io, stack[t]));
+      t --;
+      break;
+    case OP_WLN:
+      CHECK_IO();
+      CHECK_WRITE(writeOutputChar(io, '\n'));
+      break;
+    case OP_AD:
+      t --;
+      stack[t] += stack[t + 1];
+      break;
+    case OP_SB:
+      t --;
+      stack[t] -= stack[t + 1];
+      break;
+    case OP_ML:
+      t --;
+      stack[t] *= stack[t + 1];
+      break;
+    case OP_DV:
+      t --;
+      if (stack[t + 1] == 0) {
+	ps = PS_DIVIDE_BY_ZERO;
+	break;
+      }
+      stack[t] /= stack[t + 1];
+      break;
+    case OP_MOD:
+      t --;
+      if (stack[t + 1] == 0) {
+	ps = PS_DIVIDE_BY_ZERO;
+	break;
+      }
+      stack[t] %= stack[t + 1];
+      break;
+    case OP_NEG:
+      stack[t] = - stack[t];
+      break;
+    case OP_CV:
+      CHECK_STACK(t + 1);
+      stack[t + 1] = stack[t];
+      t ++;
+      break;
+    case OP_EQ:
+      t --;
+      stack[t] = (stack[t] == stack[t + 1]);
+      break;
+    case OP_NE:
+      t --;
+      stack[t] = (stack[t] != stack[t + 1]);
+      break;
+    case OP_GT:
+      t --;
+      stack[t] = (stack[t] > stack[t + 1]);
+      break;
+    case OP_LT:
+      t --;
+      stack[t] = (stack[t] < stack[t + 1]);
+      break;
+    case OP_GE:
+      t --;
+      stack[t] = (stack[t] >= stack[t + 1]);
+      break;
+    case OP_LE:
+      t --;
+      stack[t] = (stack[t] <= stack[t + 1]);
+      break;
+    case OP_AND:
+      t --;
+      stack[t] = (stack[t] && stack[t + 1]);
+      break;
+    case OP_OR:
+      t --;
+      stack[t] = (stack[t] || stack[t + 1]);
+      break;
+    case OP_NOT:
+      stack[t] = !stack[t];
+      break;
+    case OP_CPY:
+      if (inst->q < 0) {
+	ps = PS_INVALID_CODE;
+	break;
+      }
+      CHECK_ADDRESS(stack[t - 1]);
+      CHECK_ADDRESS(stack[t - 1] + inst->q - 1);
+      CHECK_ADDRESS(stack[t]);
+      CHECK_ADDRESS(stack[t] + inst->q - 1);
+      memmove(stack + stack[t - 1], stack + stack[t], inst->q * sizeof(WORD));
+      t -= 2;
+      break;
+    case OP_INB:
+      addr = stack[t];
+      if ((addr < 0) || (inst->q < 0) || (addr + PACKED_WORDS(inst->q) > stackSize)) {
+	ps = PS_STACK_OVERFLOW;
+	break;
+      }
+      PACKED_LENGTH(addr) = 0;
+      PACKED_CAPACITY(addr) = inst->q;
+      t --;
+      break;
+    case OP_LDB:
+      addr = stack[t - 1];
+      CHECK_PACKED(addr);
+      CHECK_INDEX(addr, stack[t]);
+      t --;
+      stack[t] = PACKED_BYTES(addr)[stack[t + 1]];
+      break;
+    case OP_STB:
+      addr = stack[t - 2];
+      CHECK_PACKED(addr);
+      CHECK_INDEX(addr, stack[t - 1]);
+      PACKED_BYTES(addr)[stack[t - 1]] = (unsigned char) stack[t];
+      if (stack[t - 1] >= PACKED_LENGTH(addr))
+	PACKED_LENGTH(addr) = stack[t - 1] + 1;
+      t -= 3;
+      break;
+    case OP_CPS:
+      CHECK_PACKED(stack[t - 1]);
+      CHECK_PACKED(stack[t]);
+      len = PACKED_LENGTH(stack[t]);
+      if (len > PACKED_CAPACITY(stack[t - 1]))
+	len = PACKED_CAPACITY(stack[t - 1]);
+      memmove(PACKED_BYTES(stack[t - 1]), PACKED_BYTES(stack[t]), len);
+      PACKED_LENGTH(stack[t - 1]) = len;
+      t -= 2;
+      break;
+    case OP_CMPS:
+      CHECK_PACKED(stack[t - 1]);
+      CHECK_PACKED(stack[t]);
+      len = PACKED_LENGTH(stack[t - 1]);
+      if (len > PACKED_LENGTH(stack[t]))
+	len = PACKED_LENGTH(stack[t]);
+      len = memcmp(PACKED_BYTES(stack[t - 1]), PACKED_BYTES(stack[t]), len);
+      if (len == 0)
+	len = PACKED_LENGTH(stack[t - 1]) - PACKED_LENGTH(stack[t]);
+      t --;
+      stack[t] = (len > 0) - (len < 0);
+      break;
+    case OP_WRS:
+      CHECK_IO();
+      CHECK_PACKED(stack[t]);
+      CHECK_WRITE(writeOutputBytes(io, PACKED_BYTES(stack[t]), PACKED_LENGTH(stack[t])));
+      t --;
+      break;
+    case OP_WRK:
+      CHECK_IO();
+      CHECK_CONSTANT(inst->q);
+      CHECK_WRITE(writeOutputBytes(io, constants + inst->q + 1, constants[inst->q]));
+      break;
+    case OP_CPK:
+      CHECK_CONSTANT(inst->q);
+      CHECK_PACKED(stack[t]);
+      len = constants[inst->q];
+      if (len > PACKED_CAPACITY(stack[t]))
+	len = PACKED_CAPACITY(stack[t]);
+      memcpy(PACKED_BYTES(stack[t]), constants + inst->q + 1, len);
+      PACKED_LENGTH(stack[t]) = len;
+      t --;
+      break;
+    case OP_SV:
+      addr = base(stack, b, inst->p) + inst->q;
+      CHECK_ADDRESS(addr);
+      stack[addr] = stack[t];
+      break;
+    case OP_PFOR:
+      len = (inst->p != REDUCE_NONE) ? 3 : 2;
+      if (thread->suspended != NULL)
+	addr = thread->suspended->resultAddr;
+      else {
+	if (t - len + 1 < 0) {
+	  ps = PS_INVALID_CODE;
+	  break;
+	}
+	addr = stack[t];
+	if (inst->p != REDUCE_NONE) {
+	  CHECK_ADDRESS(addr);
+	}
+      }
+      thread->t = t - len;
+      thread->b = b;
+      thread->instructionCount += executed;
+      thread->callCount += calls;
+      thread->peakStack = peak;
+      thread->fuel = fuel;
+      executed = calls = 0;
+      if (thread->suspended != NULL)
+	ps = resumeParallel(thread, &value);
+      else {
+	// the task's frame goes over the operands: a suspended task keeps addr
+	ps = runParallel(thread, inst->q, inst->p, stack[t - len + 1], stack[t - len + 2], &value);
+	if (ps == PS_YIELD) thread->suspended->resultAddr = addr;
+      }
+      peak = thread->peakStack;
+      fuel = thread->fuel;
+      if (ps == PS_YIELD) {
+	pc --;                          // the PFOR runs again when the thread goes on
+	break;
+      }
+      if (ps != PS_ACTIVE) break;
+      t -= len;
+      if (inst->p != REDUCE_NONE)
+	stack[addr] = reduce(inst->p, stack[addr], value);
+      if (fuel <= 0) ps = PS_YIELD;
+      break;
+    case OP_VFIL:
+    case OP_VCPY:
+    case OP_VADD:
+    case OP_VSUM:
+      if (t < 3) {
+	ps = PS_INVALID_CODE;
+	break;
+      }
+      ps = runVector(vm, inst->op, t, &fuel);
+      t -= 4;
+      if ((ps == PS_ACTIVE) && (fuel <= 0)) ps = PS_YIELD;
+      break;
+    case OP_BP:
+      break;
+    default:
+      ps = PS_INVALID_CODE;
+      break;
+    }
+
+    if (counting) executed ++;
+    pc ++;
+  }
+
+  thread->t = t;
+  thread->b = b;
+  thread->pc = pc;
+  thread->instructionCount += executed;
+  thread->callCount += calls;
+  if (peak > thread->peakStack) thread->peakStack = peak;
+  thread->fuel = fuel;
+  return ps;
+}
+
+// Runs the VM until its program stops, or until it has used up fuel
+// (PS_YIELD); the next call goes on from there
+int runSlice(VM* vm, long long fuel) {
+  int ps;
+
+  vm->mainThread.fuel = fuel;
+  ps = execute(&(vm->mainThread));
+  if (ps == PS_TASK_DONE) ps = PS_INVALID_CODE;   // EF with no caller
+  if (ps != PS_YIELD) flushOutput(&(vm->io));
+  vm->ps = ps;
+  return ps;
+}
+
+// Runs the main VM within fuelBudget and outputLimit; the program is
+// stopped with PS_OUT_OF_BUDGET once it has used up its fuel
+int run(void) {
+  long long fuel = (fuelBudget > 0) ? fuelBudget : NO_PREEMPTION;
+  int ps;
+
+  mainVM.counting = counting;
+  mainVM.mainThread.instructionCount = 0;
+  mainVM.mainThread.callCount = 0;
+  mainVM.mainThread.peakStack = 0;
+  mainVM.io.outputLimit = (outputLimit > 0) ? outputLimit : NO_OUTPUT_LIMIT;
+  fuelUsed = 0;
+  do {
+    ps = runSlice(&mainVM, fuel);
+    fuelUsed += fuel - mainVM.mainThread.fuel;
+  } while ((ps == PS_YIELD) && (fuelBudget == 0));
+  if (ps == PS_YIELD) {
+    flushOutput(&(mainVM.io));
+    ps = PS_OUT_OF_BUDGET;
+  }
+  instructionCount = mainVM.mainThread.instructionCount;
+  callCount = mainVM.mainThread.callCount;
+  peakStack = mainVM.mainThread.peakStack;
+  outputBytes = outputSize(&(mainVM.io));
+  return ps;
+}
+
+// Short name of a program state, for reports
+char* statusName(int ps) {
+  switch (ps) {
+  case PS_INACTIVE: return "inactive";
+  case PS_ACTIVE: return "active";
+  case PS_NORMAL_EXIT: return "ok";
+  case PS_IO_ERROR: return "io_error";
+  case PS_STACK_OVERFLOW: return "stack_overflow";
+  case PS_DIVIDE_BY_ZERO: return "divide_by_zero";
+  case PS_INVALID_CODE: return "invalid_code";
+  case PS_INDEX_ERROR: return "index_error";
+  case PS_PARALLEL_IO: return "parallel_io";
+  case PS_YIELD: return "yield";
+  case PS_OUT_OF_BUDGET: return "out_of_budget";
+  case PS_OUTPUT_LIMIT: return "output_limit";
+  case PS_OUT_OF_MEMORY: return "out_of_memory";
+  default: return "unknown";
+  }
+}
+
+void printVMCode(void) {
+  printCodeBlock(mainProgram.codeBlock);
+}
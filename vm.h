@@ -0,0 +1,182 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __VM_H__
+#define __VM_H__
+
+#include <stdio.h>
+#include "instructions.h"
+#include "executable.h"
+#include "vmio.h"
+
+#define DEFAULT_STACK_SIZE 65536
+#define INIT_CODE_SIZE 1024
+
+// Program states
+#define PS_INACTIVE -1
+#define PS_ACTIVE 0
+#define PS_NORMAL_EXIT 1
+#define PS_IO_ERROR 2
+#define PS_STACK_OVERFLOW 3
+#define PS_DIVIDE_BY_ZERO 4
+#define PS_INVALID_CODE 5
+#define PS_INDEX_ERROR 6
+#define PS_TASK_DONE 7          // a PARALLEL FOR task returned to the VM
+#define PS_PARALLEL_IO 8
+#define PS_YIELD 9              // the thread used up its fuel; it can go on
+#define PS_OUT_OF_BUDGET 10
+#define PS_OUTPUT_LIMIT 11
+#define PS_OUT_OF_MEMORY 12
+
+// Fuel of a thread that never yields
+#define NO_PREEMPTION 0x7fffffffffffffffLL
+
+// Fuel charged by a call at most, however long the start of the callee
+#define MAX_CALL_FUEL 256
+
+// Threads of the worker pool that runs PARALLEL FOR, the caller included
+#define MAX_WORKERS 64
+// A worker takes that fraction of its share of the iterations at a time,
+// leaving the rest to be stolen by the workers that are done
+#define CHUNKS_PER_WORKER 16
+// Words of stack a worker gets at least; fewer workers are used otherwise
+#define MIN_WORKER_STACK 1024
+// Fuel a worker takes at a time from what its job has left
+#define FUEL_GRANT 100000
+// A vector instruction costs a unit of fuel, and one more for every
+// VECTOR_FUEL_WORDS words it goes through: about the time an instruction takes
+#define VECTOR_FUEL_WORDS 8
+
+// State of a thread running the program: the main thread, or a worker
+// running iterations of a PARALLEL FOR
+struct VMThread_ {
+  struct VM_* vm;
+  int t;              // top of the stack
+  int b;              // base of the current frame
+  int pc;             // program counter
+  int bottom, limit;  // its part of the stack, [bottom, limit)
+  int inTask;         // running a task: no I/O, nested PARALLEL FOR runs serially
+  long long fuel;     // left before it yields; see computeFuelCosts
+  struct SuspendedTask_* suspended;   // task of the PFOR at pc that ran out of fuel
+  long long instructionCount;
+  long long callCount;
+  int peakStack;
+};
+
+typedef struct VMThread_ VMThread;
+
+// A PARALLEL FOR run serially whose task used up the fuel of its caller.
+// The caller stops at the PFOR and yields; running the PFOR again goes on
+// with the task.
+struct SuspendedTask_ {
+  VMThread thread;
+  int resultAddr;           // where the reduction goes
+};
+
+typedef struct SuspendedTask_ SuspendedTask;
+
+// Iterations of a worker not started yet, none when next > last
+struct TaskRange_ {
+  long long next, last;
+};
+
+typedef struct TaskRange_ TaskRange;
+
+// A PARALLEL FOR being run by the worker pool
+struct ParallelJob_ {
+  CodeAddress entry;        // the task function
+  int staticLink;
+  int reduction;
+  int workers;
+  long long chunk;          // iterations taken at a time
+  TaskRange ranges[MAX_WORKERS];
+  VMThread threads[MAX_WORKERS];
+  WORD results[MAX_WORKERS];
+  long long fuel;           // of the caller, not given to the workers yet
+  int ps;                   // PS_ACTIVE, or the state of the first task that failed
+};
+
+typedef struct ParallelJob_ ParallelJob;
+
+// Code of a loaded program, never written by the VMs that run it
+struct VMProgram_ {
+  CodeBlock* codeBlock;       // either ownCode or the code section of executable
+  CodeBlock* ownCode;
+  Executable* executable;
+  CodeAddress entryPoint;
+  WORD* constants;            // DATA section of the executable: string literals
+  int constantSize;           // in words
+  int* fuelCost;              // of every backward J/FJ and CALL, 0 for the other instructions
+};
+
+typedef struct VMProgram_ VMProgram;
+
+// An instance of a program: its stack, its I/O and its counters
+struct VM_ {
+  VMProgram* program;
+  WORD* stack;
+  int stackSize;
+  VMThread mainThread;
+  VMIO io;
+  int ps;
+  int parallel;               // PARALLEL FOR may use the worker pool
+  int counting;               // count the instructions and calls of the threads
+};
+
+typedef struct VM_ VM;
+
+void initProgram(VMProgram* program);
+void cleanProgram(VMProgram* program);
+int loadProgramStream(VMProgram* program, FILE* f);
+int loadProgramFile(VMProgram* program, char* fileName);
+int computeFuelCosts(VMProgram* program);
+
+int initInstance(VM* vm, VMProgram* program, int stackSize);
+void cleanInstance(VM* vm);
+void resetInstance(VM* vm);
+int runSlice(VM* vm, long long fuel);
+char* statusName(int ps);
+
+// kplrun's program and VM
+void initVM(int stackSize);
+void cleanVM(void);
+void resetVM(void);
+
+int loadExecutable(FILE* f);
+int loadExecutableFile(char* fileName);
+
+extern int counting;
+extern long long instructionCount;
+extern long long callCount;
+extern int peakStack;
+extern int workerCount;
+extern long long fuelBudget;
+extern long long fuelUsed;
+extern long long outputLimit;
+extern long long outputBytes;
+
+void startProfile(void);
+void stopProfile(void);
+
+WORD reduce(int reduction, WORD x, WORD y);
+int startTask(VMThread* thread, CodeAddress entry, int staticLink, WORD lo, WORD hi);
+int continueTask(VMThread* thread, ParallelJob* job, WORD* result);
+int runTask(VMThread* thread, ParallelJob* job, CodeAddress entry, int staticLink, WORD lo, WORD hi, WORD* result);
+void chargeTask(VMThread* caller, VMThread* task);
+void freeSuspended(VMThread* thread);
+int runParallel(VMThread* caller, CodeAddress entry, int reduction, WORD from, WORD to, WORD* result);
+int resumeParallel(VMThread* caller, WORD* result);
+int takeFuel(ParallelJob* job, VMThread* thread);
+void stopPool(void);
+
+int base(WORD* stack, int b, int p);
+int wordsInStack(VM* vm, int base, WORD from, WORD to);
+int runVector(VM* vm, enum OpCode op, int t, long long* fuel);
+int execute(VMThread* thread);
+int run(void);
+void printVMCode(void);
+
+#endif
@@ -0,0 +1,320 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include "vmhost.h"
+#include "vmvec.h"
+
+void lockHost(VMHost* host) {
+#ifndef _WIN32
+  pthread_mutex_lock(&(host->lock));
+#endif
+}
+
+void unlockHost(VMHost* host) {
+#ifndef _WIN32
+  pthread_mutex_unlock(&(host->lock));
+#endif
+}
+
+// Adds the instance at the back of the queue; 0 when it can not grow
+int pushInstance(RunQueue* queue, HostInstance* instance) {
+  HostInstance** items;
+  int capacity, i;
+
+  if (queue->count == queue->capacity) {
+    capacity = (queue->capacity == 0) ? 16 : queue->capacity * 2;
+    items = (HostInstance**) malloc(capacity * sizeof(HostInstance*));
+    if (items == NULL) return 0;
+    for (i = 0; i < queue->count; i ++)
+      items[i] = queue->items[(queue->head + i) % queue->capacity];
+    free(queue->items);
+    queue->items = items;
+    queue->head = 0;
+    queue->capacity = capacity;
+  }
+  queue->items[(queue->head + queue->count) % queue->capacity] = instance;
+  queue->count ++;
+  return 1;
+}
+
+// The instance at the front of the thread's queue or, when it is empty,
+// the one at the back of the longest queue; NULL when none is ready. The
+// host must be locked.
+HostInstance* takeInstance(VMHost* host, int index) {
+  RunQueue* queue = host->queues + index;
+  HostInstance* instance;
+  int i;
+
+  if (queue->count > 0) {
+    instance = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count --;
+    return instance;
+  }
+  for (i = 0; i < host->threadCount; i ++)
+    if (host->queues[i].count > queue->count)
+      queue = host->queues + i;
+  if (queue->count == 0) return NULL;
+  queue->count --;
+  return queue->items[(queue->head + queue->count) % queue->capacity];
+}
+
+// Runs a slice of the instance; returns 1 once it is over
+int runInstance(HostInstance* instance) {
+  VM* vm = &(instance->vm);
+  long long fuel = HOST_SLICE_FUEL;
+  int ps;
+
+  if ((instance->budget > 0) && (instance->budget - instance->fuelUsed < fuel))
+    fuel = instance->budget - instance->fuelUsed;
+  ps = (fuel > 0) ? runSlice(vm, fuel) : PS_YIELD;
+  if (fuel > 0)
+    instance->fuelUsed += fuel - vm->mainThread.fuel;
+  if (ps != PS_YIELD) {
+    instance->status = ps;
+    return 1;
+  }
+  if ((instance->budget > 0) && (instance->fuelUsed >= instance->budget)) {
+    flushOutput(&(vm->io));
+    instance->status = PS_OUT_OF_BUDGET;
+    return 1;
+  }
+  return 0;
+}
+
+// Reports an instance that is over; the host must not be locked
+void endInstance(VMHost* host, HostInstance* instance) {
+  if (host->finished != NULL) host->finished(instance);
+  lockHost(host);
+  host->pending --;
+#ifndef _WIN32
+  if (host->pending == 0) pthread_cond_broadcast(&(host->idle));
+#endif
+  unlockHost(host);
+}
+
+#ifndef _WIN32
+void* hostWorker(void* arg) {
+  HostThread* self = (HostThread*) arg;
+  VMHost* host = self->host;
+  HostInstance* instance;
+
+  lockHost(host);
+  for (;;) {
+    instance = takeInstance(host, self->index);
+    if (instance == NULL) {
+      if (host->stopping) break;
+      pthread_cond_wait(&(host->work), &(host->lock));
+      continue;
+    }
+    unlockHost(host);
+
+    if (runInstance(instance)) {
+      endInstance(host, instance);
+      lockHost(host);
+    } else {
+      lockHost(host);
+      if (pushInstance(host->queues + self->index, instance)) {
+	if (host->queues[self->index].count > 1)
+	  pthread_cond_signal(&(host->work));
+      } else {
+	unlockHost(host);
+	instance->status = PS_OUT_OF_MEMORY;
+	endInstance(host, instance);
+	lockHost(host);
+      }
+    }
+  }
+  unlockHost(host);
+  return NULL;
+}
+#endif
+
+// threadCount <= 0 starts one thread per processor. Instances get stacks
+// of stackSize words; finished may be NULL.
+VMHost* createHost(int threadCount, int stackSize, void (*finished)(HostInstance* instance)) {
+  VMHost* host = (VMHost*) calloc(1, sizeof(VMHost));
+#ifndef _WIN32
+  int i;
+#endif
+
+  if (host == NULL) return NULL;
+  initVectorKernels();
+  host->stackSize = stackSize;
+  host->finished = finished;
+  host->threadCount = 1;      // one queue for waitHost when no thread starts
+#ifndef _WIN32
+  if (threadCount <= 0) threadCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (threadCount <= 0) threadCount = 1;
+  if (threadCount > MAX_HOST_THREADS) threadCount = MAX_HOST_THREADS;
+  pthread_mutex_init(&(host->lock), NULL);
+  pthread_cond_init(&(host->work), NULL);
+  pthread_cond_init(&(host->idle), NULL);
+  lockHost(host);
+  for (i = 0; i < threadCount; i ++) {
+    host->threads[i].host = host;
+    host->threads[i].index = i;
+    if (pthread_create(&(host->threads[i].thread), NULL, hostWorker, host->threads + i) != 0) break;
+    host->workerCount ++;
+  }
+  if (host->workerCount > 0) host->threadCount = host->workerCount;
+  unlockHost(host);
+#endif
+  return host;
+}
+
+// Waits until every submitted instance is over; without worker threads,
+// runs them here in turn
+void waitHost(VMHost* host) {
+  HostInstance* instance;
+
+  if (host->workerCount == 0) {
+    while ((instance = takeInstance(host, 0)) != NULL) {
+      if (runInstance(instance))
+	endInstance(host, instance);
+      else if (!pushInstance(host->queues, instance)) {
+	instance->status = PS_OUT_OF_MEMORY;
+	endInstance(host, instance);
+      }
+    }
+    return;
+  }
+#ifndef _WIN32
+  lockHost(host);
+  while (host->pending > 0)
+    pthread_cond_wait(&(host->idle), &(host->lock));
+  unlockHost(host);
+#endif
+}
+
+// Waits for the pending instances, stops the threads and frees the programs
+void freeHost(VMHost* host) {
+  HostedProgram* program;
+  int i;
+
+  waitHost(host);
+#ifndef _WIN32
+  lockHost(host);
+  host->stopping = 1;
+  pthread_cond_broadcast(&(host->work));
+  unlockHost(host);
+  for (i = 0; i < host->workerCount; i ++)
+    pthread_join(host->threads[i].thread, NULL);
+  pthread_mutex_destroy(&(host->lock));
+  pthread_cond_destroy(&(host->work));
+  pthread_cond_destroy(&(host->idle));
+#endif
+  for (i = 0; i < MAX_HOST_THREADS; i ++)
+    free(host->queues[i].items);
+  while (host->programs != NULL) {
+    program = host->programs;
+    host->programs = program->next;
+    cleanProgram(&(program->program));
+    free(program->fileName);
+    free(program);
+  }
+  free(host);
+}
+
+/******************************************************************/
+
+// The program of an executable file, loaded by the first call for that file
+// and shared afterwards. Returns NULL, with the EXEC_* result, when it can
+// not be loaded.
+HostedProgram* loadHostedProgram(VMHost* host, char* fileName, int* result) {
+  HostedProgram* program;
+  HostedProgram* other;
+
+  *result = EXEC_OK;
+  lockHost(host);
+  for (program = host->programs; program != NULL; program = program->next)
+    if (strcmp(program->fileName, fileName) == 0) break;
+  unlockHost(host);
+  if (program != NULL) return program;
+
+  // Loaded without the lock, so that the threads go on meanwhile
+  program = (HostedProgram*) malloc(sizeof(HostedProgram));
+  if (program == NULL) {
+    *result = EXEC_OUT_OF_MEMORY;
+    return NULL;
+  }
+  program->fileName = (char*) malloc(strlen(fileName) + 1);
+  if (program->fileName == NULL) {
+    free(program);
+    *result = EXEC_OUT_OF_MEMORY;
+    return NULL;
+  }
+  strcpy(program->fileName, fileName);
+  initProgram(&(program->program));
+  *result = loadProgramFile(&(program->program), fileName);
+  if (*result != EXEC_OK) {
+    cleanProgram(&(program->program));
+    free(program->fileName);
+    free(program);
+    return NULL;
+  }
+
+  lockHost(host);
+  for (other = host->programs; other != NULL; other = other->next)
+    if (strcmp(other->fileName, fileName) == 0) break;
+  if (other == NULL) {
+    program->next = host->programs;
+    host->programs = program;
+  }
+  unlockHost(host);
+  if (other == NULL) return program;
+  cleanProgram(&(program->program));
+  free(program->fileName);
+  free(program);
+  return other;
+}
+
+// A new instance of the program, without input and keeping its output in
+// memory; initIO or setInputBuffer on instance->vm.io may change that before
+// it is submitted. budget is the fuel it may use, 0 for no limit.
+HostInstance* createInstance(VMHost* host, HostedProgram* program, long long budget) {
+  HostInstance* instance = (HostInstance*) calloc(1, sizeof(HostInstance));
+
+  if (instance == NULL) return NULL;
+  if (!initInstance(&(instance->vm), &(program->program), host->stackSize)) {
+    cleanInstance(&(instance->vm));
+    free(instance);
+    return NULL;
+  }
+  instance->program = program;
+  instance->budget = budget;
+  instance->status = PS_INACTIVE;
+  return instance;
+}
+
+// Queues the instance to run; host->finished reports it once it is over
+void submitInstance(VMHost* host, HostInstance* instance) {
+  int queued;
+
+  lockHost(host);
+  host->pending ++;
+  queued = pushInstance(host->queues + host->nextQueue, instance);
+  host->nextQueue = (host->nextQueue + 1) % host->threadCount;
+#ifndef _WIN32
+  if (queued) pthread_cond_signal(&(host->work));
+#endif
+  unlockHost(host);
+  if (!queued) {
+    instance->status = PS_OUT_OF_MEMORY;
+    endInstance(host, instance);
+  }
+}
+
+void freeInstance(HostInstance* instance) {
+  cleanInstance(&(instance->vm));
+  free(instance);
+}
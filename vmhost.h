@@ -0,0 +1,104 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __VMHOST_H__
+#define __VMHOST_H__
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include "vm.h"
+
+// A host runs many instances of programs in one process. Each executable
+// is loaded once and its code shared by all its instances; every instance
+// has its own stack, I/O and budget. Instances are run in slices on a
+// fixed pool of threads, each with its own queue of ready instances: an
+// instance gives way after HOST_SLICE_FUEL fuel (see computeFuelCosts) and
+// goes to the back of the queue, and a thread whose queue is empty steals
+// from the longest one. Without pthreads (Windows) the instances run in
+// turn in waitHost.
+
+#define HOST_SLICE_FUEL 100000
+#define MAX_HOST_THREADS 64
+
+struct HostedProgram_ {
+  char* fileName;
+  VMProgram program;
+  struct HostedProgram_* next;
+};
+
+typedef struct HostedProgram_ HostedProgram;
+
+struct HostInstance_ {
+  VM vm;
+  HostedProgram* program;
+  long long budget;           // fuel it may use, 0 for no limit
+  long long fuelUsed;
+  int status;                 // PS_INACTIVE until it is over, then its program state
+  void* data;                 // left to the caller
+};
+
+typedef struct HostInstance_ HostInstance;
+
+// Ready instances of a thread, in a ring
+struct RunQueue_ {
+  HostInstance** items;
+  int head, count, capacity;
+};
+
+typedef struct RunQueue_ RunQueue;
+
+struct VMHost_;
+
+struct HostThread_ {
+  struct VMHost_* host;
+  int index;
+#ifndef _WIN32
+  pthread_t thread;
+#endif
+};
+
+typedef struct HostThread_ HostThread;
+
+struct VMHost_ {
+  int threadCount;            // threads, and queues
+  int workerCount;            // threads started: 0 when the instances run in waitHost
+  int stackSize;              // of every instance, in words
+  HostThread threads[MAX_HOST_THREADS];
+  RunQueue queues[MAX_HOST_THREADS];
+  int nextQueue;              // queue of the next submitted instance
+  int pending;                // submitted instances that are not over
+  int stopping;
+  HostedProgram* programs;
+  // Called on the thread that ran the last slice of an instance, once it
+  // is over; the instance is no longer used by the host
+  void (*finished)(HostInstance* instance);
+#ifndef _WIN32
+  pthread_mutex_t lock;       // queues, pending, stopping and programs
+  pthread_cond_t work;        // an instance is ready, or the host stops
+  pthread_cond_t idle;        // no instance is pending
+#endif
+};
+
+typedef struct VMHost_ VMHost;
+
+VMHost* createHost(int threadCount, int stackSize, void (*finished)(HostInstance* instance));
+void freeHost(VMHost* host);
+HostedProgram* loadHostedProgram(VMHost* host, char* fileName, int* result);
+
+HostInstance* createInstance(VMHost* host, HostedProgram* program, long long budget);
+void submitInstance(VMHost* host, HostInstance* instance);
+void freeInstance(HostInstance* instance);
+void waitHost(VMHost* host);
+
+void lockHost(VMHost* host);
+void unlockHost(VMHost* host);
+int pushInstance(RunQueue* queue, HostInstance* instance);
+HostInstance* takeInstance(VMHost* host, int index);
+int runInstance(HostInstance* instance);
+void endInstance(VMHost* host, HostInstance* instance);
+
+#endif
@@ -0,0 +1,255 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "vmio.h"
+
+void initIO(VMIO* io, FILE* inputFile, FILE* outputFile) {
+  memset(io, 0, sizeof(VMIO));
+  io->inputFile = inputFile;
+  io->outputFile = outputFile;
+  io->outputLimit = NO_OUTPUT_LIMIT;
+}
+
+// The program reads data[0, size) and then sees the end of the input; the
+// caller keeps data until the run is over
+void setInputBuffer(VMIO* io, unsigned char* data, int size) {
+  closeInput(io);
+  io->inputBuffer = data;
+  io->inputEnd = size;
+  io->inputAtEof = 1;
+  io->inputOpened = 1;
+}
+
+// Maps the input file when it is a regular file, from its current offset
+// to its end; otherwise allocates the block buffer that refillInput reads
+// into
+void openInput(VMIO* io) {
+#ifndef _WIN32
+  struct stat st;
+  off_t offset;
+  void* image;
+  int fd;
+#endif
+
+  io->inputOpened = 1;
+  if (io->inputFile == NULL) {
+    io->inputAtEof = 1;
+    return;
+  }
+#ifndef _WIN32
+  fd = fileno(io->inputFile);
+  io->inputInteractive = isatty(fd);
+  if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) &&
+      (st.st_size > 0) && (st.st_size <= 0x7fffffff)) {
+    offset = lseek(fd, 0, SEEK_CUR);
+    if ((offset >= 0) && (offset < st.st_size)) {
+      image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (image != MAP_FAILED) {
+	io->inputBuffer = (unsigned char*) image;
+	io->inputMappedSize = st.st_size;
+	io->inputPos = offset;
+	io->inputEnd = st.st_size;
+	io->inputAtEof = 1;
+	return;
+      }
+    }
+  }
+#endif
+  io->inputBuffer = (unsigned char*) malloc(IO_BUFFER_SIZE);
+  io->inputOwned = 1;
+  io->inputPos = io->inputEnd = 0;
+  io->inputAtEof = (io->inputBuffer == NULL);
+}
+
+// Next byte of the input without consuming it, reading another block when
+// the buffer is used up; EOF at the end of the input
+int refillInput(VMIO* io) {
+  int n;
+
+  if (!io->inputOpened) openInput(io);
+  if (io->inputPos < io->inputEnd) return io->inputBuffer[io->inputPos];
+  if (io->inputAtEof) return EOF;
+
+#ifndef _WIN32
+  if (io->inputInteractive) flushOutput(io);
+  n = read(fileno(io->inputFile), io->inputBuffer, IO_BUFFER_SIZE);
+#else
+  // Read up to the end of the line, as a console would return it
+  flushOutput(io);
+  n = 0;
+  while (n < IO_BUFFER_SIZE) {
+    int ch = getc(io->inputFile);
+    if (ch == EOF) break;
+    io->inputBuffer[n ++] = (unsigned char) ch;
+    if (ch == '\n') break;
+  }
+#endif
+  if (n <= 0) {
+    io->inputAtEof = 1;
+    return EOF;
+  }
+  io->inputPos = 0;
+  io->inputEnd = n;
+  return io->inputBuffer[0];
+}
+
+#define PEEK_INPUT(io) (((io)->inputPos < (io)->inputEnd) ? (io)->inputBuffer[(io)->inputPos] : refillInput(io))
+
+int readInputChar(VMIO* io) {
+  int ch = PEEK_INPUT(io);
+
+  if (ch != EOF) io->inputPos ++;
+  return ch;
+}
+
+// Reads a decimal integer as scanf("%d") does: blanks are skipped, a sign
+// may precede the digits, and there must be at least one digit. Returns 1
+// on success, 0 otherwise.
+int readInputInt(VMIO* io, int* value) {
+  unsigned int n = 0;
+  int negative = 0;
+  int ch = PEEK_INPUT(io);
+
+  while ((ch == ' ') || (ch == '\n') || (ch == '\t') || (ch == '\r') || (ch == '\v') || (ch == '\f')) {
+    io->inputPos ++;
+    ch = PEEK_INPUT(io);
+  }
+  if ((ch == '-') || (ch == '+')) {
+    negative = (ch == '-');
+    io->inputPos ++;
+    ch = PEEK_INPUT(io);
+  }
+  if ((ch < '0') || (ch > '9')) return 0;
+
+  do {
+    n = n * 10 + (ch - '0');
+    io->inputPos ++;
+    ch = PEEK_INPUT(io);
+  } while ((ch >= '0') && (ch <= '9'));
+
+  *value = (int) (negative ? 0u - n : n);
+  return 1;
+}
+
+void closeInput(VMIO* io) {
+#ifndef _WIN32
+  if (io->inputMappedSize > 0) {
+    munmap(io->inputBuffer, io->inputMappedSize);
+    io->inputMappedSize = 0;
+  }
+#endif
+  if (io->inputOwned) free(io->inputBuffer);
+  io->inputBuffer = NULL;
+  io->inputOwned = 0;
+  io->inputPos = io->inputEnd = 0;
+  io->inputOpened = 0;
+  io->inputAtEof = 0;
+}
+
+void closeIO(VMIO* io) {
+  closeInput(io);
+  free(io->outputBuffer);
+  io->outputBuffer = NULL;
+  io->outputPos = io->outputCapacity = 0;
+  io->outputFlushed = 0;
+}
+
+/******************************************************************/
+
+void flushOutput(VMIO* io) {
+  if (io->outputFile == NULL) return;
+  if (io->outputPos > 0)
+    fwrite(io->outputBuffer, 1, io->outputPos, io->outputFile);
+  io->outputFlushed += io->outputPos;
+  io->outputPos = 0;
+  fflush(io->outputFile);
+}
+
+// Makes room for size more bytes in the buffer: writes it out, or grows it
+// when the output is kept in memory. Returns 0 when there is no room.
+int reserveOutput(VMIO* io, int size) {
+  unsigned char* buffer;
+  int capacity = io->outputCapacity;
+
+  if (io->outputPos + size <= capacity) return 1;
+  if ((io->outputFile != NULL) && (capacity > 0)) {
+    flushOutput(io);
+    if (size <= capacity) return 1;
+  }
+  if (capacity == 0) capacity = IO_BUFFER_SIZE;
+  while (io->outputPos + size > capacity) {
+    if (capacity > 0x3fffffff) return 0;
+    capacity *= 2;
+  }
+  buffer = (unsigned char*) realloc(io->outputBuffer, capacity);
+  if (buffer == NULL) return 0;
+  io->outputBuffer = buffer;
+  io->outputCapacity = capacity;
+  return 1;
+}
+
+// Bytes written by the program so far
+long long outputSize(VMIO* io) {
+  return io->outputFlushed + io->outputPos;
+}
+
+// Fails the write of size more bytes when they would pass the limit
+int checkOutputLimit(VMIO* io, int size) {
+  if (io->outputFlushed + io->outputPos + size <= io->outputLimit) return 1;
+  io->outputOverLimit = 1;
+  return 0;
+}
+
+// The write functions return 0 when they wrote nothing: past the output
+// limit, or out of memory
+int writeOutputChar(VMIO* io, int ch) {
+  if (!checkOutputLimit(io, 1)) return 0;
+  if ((io->outputPos == io->outputCapacity) && !reserveOutput(io, 1)) return 0;
+  io->outputBuffer[io->outputPos ++] = (unsigned char) ch;
+  return 1;
+}
+
+int writeOutputInt(VMIO* io, int value) {
+  char digits[12];
+  unsigned int n = (value < 0) ? 0u - (unsigned int) value : (unsigned int) value;
+  int count = 0;
+
+  do {
+    digits[count ++] = (char) ('0' + n % 10);
+    n /= 10;
+  } while (n != 0);
+  if (!checkOutputLimit(io, count + (value < 0))) return 0;
+  if ((io->outputPos + 12 > io->outputCapacity) && !reserveOutput(io, 12)) return 0;
+  if (value < 0) io->outputBuffer[io->outputPos ++] = '-';
+  while (count > 0)
+    io->outputBuffer[io->outputPos ++] = digits[-- count];
+  return 1;
+}
+
+int writeOutputBytes(VMIO* io, void* bytes, int size) {
+  if (!checkOutputLimit(io, size)) return 0;
+  if (io->outputPos + size > io->outputCapacity) {
+    if ((io->outputFile != NULL) && (size >= IO_BUFFER_SIZE)) {
+      flushOutput(io);
+      fwrite(bytes, 1, size, io->outputFile);
+      io->outputFlushed += size;
+      return 1;
+    }
+    if (!reserveOutput(io, size)) return 0;
+  }
+  memcpy(io->outputBuffer + io->outputPos, bytes, size);
+  io->outputPos += size;
+  return 1;
+}
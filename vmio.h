@@ -0,0 +1,59 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __VMIO_H__
+#define __VMIO_H__
+
+#include <stdio.h>
+
+#define IO_BUFFER_SIZE 65536
+#define NO_OUTPUT_LIMIT 0x7fffffffffffffffLL
+
+// Input and output of a running program. Input is mapped when it is a
+// regular file and read in large blocks otherwise, or taken from memory
+// (setInputBuffer); output is collected in a buffer, written out when it is
+// full, before a read from a terminal and at the end of the run
+// (flushOutput). Without an output file the buffer grows and keeps all the
+// output. A write that would take the output past outputLimit bytes fails
+// and writes nothing.
+struct VMIO_ {
+  FILE* inputFile;            // NULL: no input besides the buffer
+  unsigned char* inputBuffer;
+  int inputPos;
+  int inputEnd;
+  int inputOpened;
+  int inputAtEof;
+  int inputInteractive;       // a terminal: flush the output before reading
+  int inputOwned;             // inputBuffer was allocated by openInput
+  long inputMappedSize;       // size of the mapping when the input is mapped, 0 otherwise
+
+  FILE* outputFile;
+  unsigned char* outputBuffer;
+  int outputPos;
+  int outputCapacity;
+  long long outputFlushed;    // bytes already written out of the buffer
+  long long outputLimit;
+  int outputOverLimit;        // a write failed because of outputLimit
+};
+
+typedef struct VMIO_ VMIO;
+
+void initIO(VMIO* io, FILE* inputFile, FILE* outputFile);
+void setInputBuffer(VMIO* io, unsigned char* data, int size);
+
+int readInputChar(VMIO* io);
+int readInputInt(VMIO* io, int* value);
+
+int writeOutputChar(VMIO* io, int ch);
+int writeOutputInt(VMIO* io, int value);
+int writeOutputBytes(VMIO* io, void* bytes, int size);
+long long outputSize(VMIO* io);
+void flushOutput(VMIO* io);
+
+void closeInput(VMIO* io);
+void closeIO(VMIO* io);
+
+#endif
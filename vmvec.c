@@ -0,0 +1,122 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include "vmvec.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define VECTOR_X86
+#include <immintrin.h>
+#endif
+
+void fillWordsScalar(WORD* words, WORD value, int n) {
+  int i;
+
+  for (i = 0; i < n; i ++)
+    words[i] = value;
+}
+
+void addWordsScalar(WORD* words, WORD value, int n) {
+  int i;
+
+  for (i = 0; i < n; i ++)
+    words[i] = (WORD) ((unsigned int) words[i] + (unsigned int) value);
+}
+
+WORD sumWordsScalar(WORD* words, int n) {
+  unsigned int sum = 0;
+  int i;
+
+  for (i = 0; i < n; i ++)
+    sum += (unsigned int) words[i];
+  return (WORD) sum;
+}
+
+#ifdef VECTOR_X86
+
+void fillWordsSSE2(WORD* words, WORD value, int n) {
+  __m128i v = _mm_set1_epi32(value);
+  int i = 0;
+
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_si128((__m128i*) (words + i), v);
+  fillWordsScalar(words + i, value, n - i);
+}
+
+void addWordsSSE2(WORD* words, WORD value, int n) {
+  __m128i v = _mm_set1_epi32(value);
+  int i = 0;
+
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_si128((__m128i*) (words + i),
+		     _mm_add_epi32(_mm_loadu_si128((__m128i*) (words + i)), v));
+  addWordsScalar(words + i, value, n - i);
+}
+
+WORD sumWordsSSE2(WORD* words, int n) {
+  __m128i sum = _mm_setzero_si128();
+  WORD lanes[4];
+  int i = 0;
+
+  for (; i + 4 <= n; i += 4)
+    sum = _mm_add_epi32(sum, _mm_loadu_si128((__m128i*) (words + i)));
+  _mm_storeu_si128((__m128i*) lanes, sum);
+  return (WORD) ((unsigned int) sumWordsScalar(lanes, 4) + (unsigned int) sumWordsScalar(words + i, n - i));
+}
+
+__attribute__((target("avx2")))
+void fillWordsAVX2(WORD* words, WORD value, int n) {
+  __m256i v = _mm256_set1_epi32(value);
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_si256((__m256i*) (words + i), v);
+  fillWordsScalar(words + i, value, n - i);
+}
+
+__attribute__((target("avx2")))
+void addWordsAVX2(WORD* words, WORD value, int n) {
+  __m256i v = _mm256_set1_epi32(value);
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_si256((__m256i*) (words + i),
+			_mm256_add_epi32(_mm256_loadu_si256((__m256i*) (words + i)), v));
+  addWordsScalar(words + i, value, n - i);
+}
+
+__attribute__((target("avx2")))
+WORD sumWordsAVX2(WORD* words, int n) {
+  __m256i sum = _mm256_setzero_si256();
+  WORD lanes[8];
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    sum = _mm256_add_epi32(sum, _mm256_loadu_si256((__m256i*) (words + i)));
+  _mm256_storeu_si256((__m256i*) lanes, sum);
+  return (WORD) ((unsigned int) sumWordsScalar(lanes, 8) + (unsigned int) sumWordsScalar(words + i, n - i));
+}
+
+#endif
+
+void (*fillWords)(WORD* words, WORD value, int n) = fillWordsScalar;
+void (*addWords)(WORD* words, WORD value, int n) = addWordsScalar;
+WORD (*sumWords)(WORD* words, int n) = sumWordsScalar;
+
+void initVectorKernels(void) {
+#ifdef VECTOR_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    fillWords = fillWordsAVX2;
+    addWords = addWordsAVX2;
+    sumWords = sumWordsAVX2;
+    return;
+  }
+  fillWords = fillWordsSSE2;
+  addWords = addWordsSSE2;
+  sumWords = sumWordsSSE2;
+#endif
+}
@@ -0,0 +1,23 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __VMVEC_H__
+#define __VMVEC_H__
+
+#include "instructions.h"
+
+// Kernels of the vector instructions (VFIL, VADD, VSUM). initVectorKernels
+// picks the AVX2 versions when the processor has AVX2, the SSE2 ones on
+// other x86 processors and plain loops elsewhere. Additions wrap around on
+// overflow like AD.
+
+extern void (*fillWords)(WORD* words, WORD value, int n);
+extern void (*addWords)(WORD* words, WORD value, int n);
+extern WORD (*sumWords)(WORD* words, int n);
+
+void initVectorKernels(void);
+
+#endif